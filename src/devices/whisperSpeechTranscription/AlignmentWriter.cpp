@@ -0,0 +1,38 @@
+/*
+ * SPDX-FileCopyrightText: 2023-2023 Istituto Italiano di Tecnologia (IIT)
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "AlignmentWriter.h"
+
+void AlignmentWriter::write(const std::string& text, double score, const std::vector<SegmentResult>& segments, yarp::os::Bottle& b)
+{
+    b.clear();
+    b.addString(text);
+    b.addFloat32(float(score));
+    yarp::os::Bottle& sl = b.addList();
+    std::vector<TokenRecord> records;
+    for (const auto& seg : segments)
+    {
+        yarp::os::Bottle& sb = sl.addList();
+        sb.addFloat32(float(seg.t0));
+        sb.addFloat32(float(seg.t1));
+        sb.addInt32(seg.speaker);
+        sb.addString(seg.text);
+        yarp::os::Bottle& words = sb.addList();
+        for (const auto& w : seg.words)
+        {
+            yarp::os::Bottle& wb = words.addList();
+            wb.addString(w.text);
+            wb.addFloat32(float(w.t0));
+            wb.addFloat32(float(w.t1));
+            wb.addFloat32(float(w.confidence));
+        }
+        records.clear();
+        for (const auto& t : seg.tokens)
+        {
+            records.push_back({ t.id, t.p, float(t.t0), float(t.t1) });
+        }
+        sb.add(yarp::os::Value(records.data(), int(records.size() * sizeof(TokenRecord))));
+    }
+}
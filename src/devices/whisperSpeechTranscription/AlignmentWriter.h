@@ -0,0 +1,40 @@
+/*
+ * SPDX-FileCopyrightText: 2023-2023 Istituto Italiano di Tecnologia (IIT)
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef WHISPER_ALIGNMENTWRITER_H
+#define WHISPER_ALIGNMENTWRITER_H
+
+#include <yarp/os/Bottle.h>
+
+#include <string>
+#include <vector>
+
+#include "TranscriptionResult.h"
+
+/**
+ * \brief Compact encoding of a TranscriptionResult, for the clients aligning the transcription to the audio.
+ * \code
+ * result  := "text" score (segment ...)
+ * segment := (t0 t1 speaker "text" (word ...) tokens)
+ * word    := ("text" t0 t1 confidence)
+ * tokens  := blob of records { int32 id; float32 p; float32 t0; float32 t1 }, in the byte order of the host
+ * \endcode
+ * Times are in seconds from the beginning of the request, -1 if not available. speaker is -1 if unknown.
+ */
+class AlignmentWriter
+{
+public:
+    struct TokenRecord
+    {
+        int32_t id;
+        float   p;
+        float   t0;
+        float   t1;
+    };
+
+    static void write(const std::string& text, double score, const std::vector<SegmentResult>& segments, yarp::os::Bottle& b);
+};
+
+#endif
@@ -0,0 +1,497 @@
+/*
+ * SPDX-FileCopyrightText: 2023-2023 Istituto Italiano di Tecnologia (IIT)
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "AudioFrontEnd.h"
+
+#include <yarp/os/LogComponent.h>
+#include <yarp/os/LogStream.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  include <emmintrin.h>
+#  define WHISPER_FRONTEND_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#  include <arm_neon.h>
+#  define WHISPER_FRONTEND_NEON
+#endif
+
+namespace {
+YARP_LOG_COMPONENT(WHISPER_FRONTEND, "yarp.device.WhisperSpeechTranscription.AudioFrontEnd")
+
+constexpr double pi = 3.14159265358979323846;
+constexpr size_t base_taps_per_phase = 16;
+constexpr float  filter_rolloff = 0.92f;
+constexpr float  int16_gain = 1.0f / 32768.0f;
+// largest delay between two microphones considered by the beamformer, ~34 cm at 343 m/s
+constexpr double beamform_max_delay_s = 0.001;
+
+template <bool accumulate>
+inline void convertInt16(const int16_t* src, float* dst, size_t n, float gain)
+{
+    size_t i = 0;
+#if defined(WHISPER_FRONTEND_SSE2)
+    const __m128 vgain = _mm_set1_ps(gain);
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        // sign-extend the 16 bit samples to 32 bits
+        __m128 lo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+        __m128 hi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16));
+        lo = _mm_mul_ps(lo, vgain);
+        hi = _mm_mul_ps(hi, vgain);
+        if (accumulate)
+        {
+            lo = _mm_add_ps(lo, _mm_loadu_ps(dst + i));
+            hi = _mm_add_ps(hi, _mm_loadu_ps(dst + i + 4));
+        }
+        _mm_storeu_ps(dst + i, lo);
+        _mm_storeu_ps(dst + i + 4, hi);
+    }
+#elif defined(WHISPER_FRONTEND_NEON)
+    for (; i + 8 <= n; i += 8)
+    {
+        int16x8_t v = vld1q_s16(src + i);
+        float32x4_t lo = vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))), gain);
+        float32x4_t hi = vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(v))), gain);
+        if (accumulate)
+        {
+            lo = vaddq_f32(lo, vld1q_f32(dst + i));
+            hi = vaddq_f32(hi, vld1q_f32(dst + i + 4));
+        }
+        vst1q_f32(dst + i, lo);
+        vst1q_f32(dst + i + 4, hi);
+    }
+#endif
+    for (; i < n; i++)
+    {
+        if (accumulate) { dst[i] += float(src[i]) * gain; }
+        else            { dst[i]  = float(src[i]) * gain; }
+    }
+}
+} // namespace
+
+// ------------------------------------------------------------------------------------------------
+// PolyphaseResampler
+// ------------------------------------------------------------------------------------------------
+bool PolyphaseResampler::configure(size_t inRate, size_t outRate)
+{
+    if (inRate == 0 || outRate == 0)
+    {
+        return false;
+    }
+    if (inRate == m_inRate && outRate == m_outRate)
+    {
+        return true;
+    }
+
+    m_inRate = inRate;
+    m_outRate = outRate;
+    size_t g = std::gcd(inRate, outRate);
+    m_up = outRate / g;
+    m_down = inRate / g;
+    m_coeffs.clear();
+    m_tapsPerPhase = 0;
+    resetStream();
+    if (isPassthrough())
+    {
+        return true;
+    }
+
+    // the filter works at the upsampled rate, its cutoff is the smaller of the two Nyquist frequencies
+    size_t ratio = (std::max(m_up, m_down) + m_up - 1) / m_up;
+    m_tapsPerPhase = base_taps_per_phase * ratio;
+    const size_t n_taps = m_up * m_tapsPerPhase;
+    const double fc = 0.5 * filter_rolloff / double(std::max(m_up, m_down));
+    // centering the filter on an integer sample makes the delay compensation in process() exact
+    const double center = double((n_taps - 1) / 2);
+
+    std::vector<double> h(n_taps);
+    for (size_t n = 0; n < n_taps; n++)
+    {
+        double x = double(n) - center;
+        double sinc = (x == 0.0) ? 1.0 : std::sin(2.0 * pi * fc * x) / (2.0 * pi * fc * x);
+        double w = 0.42 - 0.5 * std::cos(2.0 * pi * n / (n_taps - 1)) + 0.08 * std::cos(4.0 * pi * n / (n_taps - 1));
+        // the gain m_up compensates the zeros inserted by the upsampling
+        h[n] = 2.0 * fc * sinc * w * double(m_up);
+    }
+
+    m_coeffs.resize(n_taps);
+    for (size_t p = 0; p < m_up; p++)
+    {
+        for (size_t k = 0; k < m_tapsPerPhase; k++)
+        {
+            m_coeffs[p * m_tapsPerPhase + k] = float(h[p + k * m_up]);
+        }
+    }
+
+    yCDebug(WHISPER_FRONTEND, "Resampler configured %zu Hz -> %zu Hz (L=%zu, M=%zu, %zu taps/phase)",
+            inRate, outRate, m_up, m_down, m_tapsPerPhase);
+    return true;
+}
+
+size_t PolyphaseResampler::outputSize(size_t inSamples) const
+{
+    return (inSamples * m_up + m_down - 1) / m_down;
+}
+
+void PolyphaseResampler::process(const float* in, size_t inSamples, std::vector<float>& out) const
+{
+    if (isPassthrough())
+    {
+        out.assign(in, in + inSamples);
+        return;
+    }
+
+    const size_t n_out = outputSize(inSamples);
+    out.resize(n_out);
+
+    // compensate the group delay of the linear-phase filter
+    const size_t delay = (m_up * m_tapsPerPhase - 1) / 2;
+    for (size_t m = 0; m < n_out; m++)
+    {
+        const size_t t = m * m_down + delay;
+        const size_t base = t / m_up;
+        const float* c = &m_coeffs[(t % m_up) * m_tapsPerPhase];
+
+        // input index is base - k, only the taps falling inside the buffer contribute
+        size_t k_begin = base >= inSamples ? base - inSamples + 1 : 0;
+        size_t k_end = std::min(m_tapsPerPhase, base + 1);
+        float acc = 0.0f;
+        for (size_t k = k_begin; k < k_end; k++)
+        {
+            acc += c[k] * in[base - k];
+        }
+        out[m] = acc;
+    }
+}
+
+void PolyphaseResampler::resetStream()
+{
+    m_stream.clear();
+    m_streamT = 0;
+    m_streamInit = false;
+}
+
+void PolyphaseResampler::processStream(const float* in, size_t inSamples, std::vector<float>& out)
+{
+    if (isPassthrough())
+    {
+        out.assign(in, in + inSamples);
+        return;
+    }
+
+    const size_t history = m_tapsPerPhase - 1;
+    if (!m_streamInit)
+    {
+        // the stream starts with silence, the first output sample is aligned to the first input sample
+        m_stream.assign(history, 0.0f);
+        m_streamT = history * m_up;
+        m_streamInit = true;
+    }
+    m_stream.insert(m_stream.end(), in, in + inSamples);
+
+    out.clear();
+    out.reserve(outputSize(inSamples) + 1);
+    while (m_streamT / m_up < m_stream.size())
+    {
+        const size_t base = m_streamT / m_up;
+        const float* c = &m_coeffs[(m_streamT % m_up) * m_tapsPerPhase];
+        float acc = 0.0f;
+        for (size_t k = 0; k < m_tapsPerPhase; k++)
+        {
+            acc += c[k] * m_stream[base - k];
+        }
+        out.push_back(acc);
+        m_streamT += m_down;
+    }
+
+    // keep only the samples still needed by the filter
+    const size_t consumed = m_stream.size() - history;
+    m_stream.erase(m_stream.begin(), m_stream.begin() + consumed);
+    m_streamT -= consumed * m_up;
+}
+
+// ------------------------------------------------------------------------------------------------
+// AudioFrontEnd
+// ------------------------------------------------------------------------------------------------
+bool AudioFrontEnd::parseDownmix(const std::string& str, Downmix& mode)
+{
+    if      (str == "first")    { mode = Downmix::first; }
+    else if (str == "average")  { mode = Downmix::average; }
+    else if (str == "select")   { mode = Downmix::select; }
+    else if (str == "beamform") { mode = Downmix::beamform; }
+    else { return false; }
+    return true;
+}
+
+void AudioFrontEnd::int16ToFloat(const int16_t* src, float* dst, size_t n, float gain)
+{
+    convertInt16<false>(src, dst, n, gain);
+}
+
+void AudioFrontEnd::int16Accumulate(const int16_t* src, float* dst, size_t n, float gain)
+{
+    convertInt16<true>(src, dst, n, gain);
+}
+
+bool AudioFrontEnd::configure(const yarp::sig::Sound& sound)
+{
+    const size_t samples = sound.getSamples();
+    const size_t channels = sound.getChannels();
+    if (samples == 0 || channels == 0)
+    {
+        return false;
+    }
+
+    size_t channel = (m_downmix == Downmix::select) ? m_channel : 0;
+    if (channel >= channels)
+    {
+        yCError(WHISPER_FRONTEND) << "Requested channel" << channel << "but the sound has only" << channels << "channels";
+        return false;
+    }
+
+    size_t rate = sound.getFrequency() > 0 ? size_t(sound.getFrequency()) : m_targetRate;
+    if (!m_resampler.configure(rate, m_targetRate))
+    {
+        yCError(WHISPER_FRONTEND) << "Unable to resample from" << rate << "Hz to" << m_targetRate << "Hz";
+        return false;
+    }
+    return true;
+}
+
+bool AudioFrontEnd::toMono(const yarp::sig::Sound& sound, std::vector<float>& mono)
+{
+    if (!configure(sound))
+    {
+        return false;
+    }
+    const size_t samples = sound.getSamples();
+    const size_t channels = sound.getChannels();
+    const size_t channel = (m_downmix == Downmix::select) ? m_channel : 0;
+
+    if (m_downmix == Downmix::beamform && channels > 1)
+    {
+        if (!toChannels(sound, m_channels))
+        {
+            return false;
+        }
+        downmix(m_channels, m_resampler.inputRate(), mono);
+        return true;
+    }
+
+    mono.resize(samples);
+
+    // The Sound stores the samples as a planar int16 image: one row per channel.
+    const unsigned char* raw = sound.getRawData();
+    const size_t row_bytes = channels > 0 ? sound.getRawDataSize() / channels : 0;
+    if (raw != nullptr && sound.getBytesPerSample() == 2 && row_bytes >= samples * 2)
+    {
+        auto row = [&](size_t c) { return reinterpret_cast<const int16_t*>(raw + c * row_bytes); };
+        if (m_downmix == Downmix::average && channels > 1)
+        {
+            const float gain = int16_gain / float(channels);
+            int16ToFloat(row(0), mono.data(), samples, gain);
+            for (size_t c = 1; c < channels; c++)
+            {
+                int16Accumulate(row(c), mono.data(), samples, gain);
+            }
+        }
+        else
+        {
+            int16ToFloat(row(channel), mono.data(), samples, int16_gain);
+        }
+    }
+    else
+    {
+        // slow path, for sounds whose raw layout is not the expected one
+        for (size_t i = 0; i < samples; i++)
+        {
+            if (m_downmix == Downmix::average)
+            {
+                float acc = 0;
+                for (size_t c = 0; c < channels; c++) { acc += float(sound.get(i, c)); }
+                mono[i] = acc * int16_gain / float(channels);
+            }
+            else
+            {
+                mono[i] = float(sound.get(i, channel)) * int16_gain;
+            }
+        }
+    }
+    return true;
+}
+
+bool AudioFrontEnd::toChannels(const yarp::sig::Sound& sound, std::vector<std::vector<float>>& channels)
+{
+    const size_t samples = sound.getSamples();
+    const size_t n_channels = sound.getChannels();
+    channels.resize(n_channels);
+    for (auto& ch : channels)
+    {
+        ch.resize(samples);
+    }
+
+    const unsigned char* raw = sound.getRawData();
+    const size_t row_bytes = n_channels > 0 ? sound.getRawDataSize() / n_channels : 0;
+    if (raw != nullptr && sound.getBytesPerSample() == 2 && row_bytes >= samples * 2)
+    {
+        for (size_t c = 0; c < n_channels; c++)
+        {
+            int16ToFloat(reinterpret_cast<const int16_t*>(raw + c * row_bytes), channels[c].data(), samples, int16_gain);
+        }
+    }
+    else
+    {
+        // slow path, one pass over the samples of all the channels
+        for (size_t i = 0; i < samples; i++)
+        {
+            for (size_t c = 0; c < n_channels; c++)
+            {
+                channels[c][i] = float(sound.get(i, c)) * int16_gain;
+            }
+        }
+    }
+    return true;
+}
+
+void AudioFrontEnd::downmix(const std::vector<std::vector<float>>& channels, size_t rate, std::vector<float>& mono) const
+{
+    if (channels.size() == 1 || m_downmix == Downmix::first)
+    {
+        mono.assign(channels.front().begin(), channels.front().end());
+    }
+    else if (m_downmix == Downmix::select)
+    {
+        mono.assign(channels[m_channel].begin(), channels[m_channel].end());
+    }
+    else if (m_downmix == Downmix::average)
+    {
+        const float gain = 1.0f / float(channels.size());
+        mono.assign(channels.front().size(), 0.0f);
+        for (const auto& ch : channels)
+        {
+            for (size_t i = 0; i < mono.size(); i++)
+            {
+                mono[i] += ch[i] * gain;
+            }
+        }
+    }
+    else
+    {
+        delayAndSum(channels, size_t(std::ceil(rate * beamform_max_delay_s)), mono);
+    }
+}
+
+void AudioFrontEnd::delayAndSum(const std::vector<std::vector<float>>& channels, size_t max_lag, std::vector<float>& out)
+{
+    const std::vector<float>& ref = channels.front();
+    const size_t n = ref.size();
+    const long lag = long(std::min(max_lag, n > 0 ? n - 1 : 0));
+    out.assign(ref.begin(), ref.end());
+    for (size_t c = 1; c < channels.size(); c++)
+    {
+        // delay of channel c with respect to channel 0: ref[i] ~ x[i + d]
+        const std::vector<float>& x = channels[c];
+        long best_d = 0;
+        double best_corr = -std::numeric_limits<double>::infinity();
+        for (long d = -lag; d <= lag; d++)
+        {
+            const size_t i_begin = d < 0 ? size_t(-d) : 0;
+            const size_t i_end = d > 0 ? n - size_t(d) : n;
+            double corr = 0;
+            for (size_t i = i_begin; i < i_end; i++)
+            {
+                corr += double(ref[i]) * x[i + d];
+            }
+            if (corr > best_corr)
+            {
+                best_corr = corr;
+                best_d = d;
+            }
+        }
+        const size_t i_begin = best_d < 0 ? size_t(-best_d) : 0;
+        const size_t i_end = best_d > 0 ? n - size_t(best_d) : n;
+        for (size_t i = i_begin; i < i_end; i++)
+        {
+            out[i] += x[i + best_d];
+        }
+    }
+    const float gain = 1.0f / float(channels.size());
+    for (auto& v : out)
+    {
+        v *= gain;
+    }
+}
+
+bool AudioFrontEnd::process(const yarp::sig::Sound& sound, std::vector<float>& pcm)
+{
+    // when no resampling is needed the conversion is performed directly into the output buffer
+    size_t rate = sound.getFrequency() > 0 ? size_t(sound.getFrequency()) : m_targetRate;
+    if (rate == m_targetRate)
+    {
+        return toMono(sound, pcm);
+    }
+    if (!toMono(sound, m_mono))
+    {
+        return false;
+    }
+    m_resampler.process(m_mono.data(), m_mono.size(), pcm);
+    return true;
+}
+
+bool AudioFrontEnd::process(const yarp::sig::Sound& sound, std::vector<float>& pcm, std::vector<std::vector<float>>& channels)
+{
+    // every channel is converted once, resampled, then downmixed
+    if (!configure(sound) || !toChannels(sound, m_channels))
+    {
+        return false;
+    }
+    channels.resize(m_channels.size());
+    for (size_t c = 0; c < m_channels.size(); c++)
+    {
+        m_resampler.process(m_channels[c].data(), m_channels[c].size(), channels[c]);
+    }
+    downmix(channels, m_targetRate, pcm);
+    return true;
+}
+
+bool AudioFrontEnd::processStream(const yarp::sig::Sound& sound, std::vector<float>& pcm)
+{
+    if (!toMono(sound, m_mono))
+    {
+        return false;
+    }
+    m_resampler.processStream(m_mono.data(), m_mono.size(), pcm);
+    return true;
+}
+
+bool AudioFrontEnd::processStream(const int16_t* const* rows, size_t channels, size_t n, size_t rate, std::vector<float>& pcm)
+{
+    const size_t channel = (m_downmix == Downmix::select) ? m_channel : 0;
+    if (channels == 0 || channel >= channels || !m_resampler.configure(rate, m_targetRate))
+    {
+        return false;
+    }
+    m_mono.resize(n);
+    if ((m_downmix == Downmix::average || m_downmix == Downmix::beamform) && channels > 1)
+    {
+        const float gain = int16_gain / float(channels);
+        int16ToFloat(rows[0], m_mono.data(), n, gain);
+        for (size_t c = 1; c < channels; c++)
+        {
+            int16Accumulate(rows[c], m_mono.data(), n, gain);
+        }
+    }
+    else
+    {
+        int16ToFloat(rows[channel], m_mono.data(), n, int16_gain);
+    }
+    m_resampler.processStream(m_mono.data(), n, pcm);
+    return true;
+}
@@ -0,0 +1,107 @@
+/*
+ * SPDX-FileCopyrightText: 2023-2023 Istituto Italiano di Tecnologia (IIT)
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef WHISPER_AUDIOFRONTEND_H
+#define WHISPER_AUDIOFRONTEND_H
+
+#include <yarp/sig/Sound.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * \brief Polyphase FIR resampler converting between two integer sample rates.
+ * The conversion ratio is reduced to L/M (upsample by L, decimate by M) and the
+ * anti-aliasing low-pass filter is split into L phases, so that each output sample
+ * costs only taps_per_phase multiply-accumulates.
+ */
+class PolyphaseResampler
+{
+public:
+    bool   configure(size_t inRate, size_t outRate);
+    bool   isPassthrough() const { return m_up == m_down; }
+    size_t outputSize(size_t inSamples) const;
+    size_t inputRate() const { return m_inRate; }
+
+    // Resamples a whole buffer. Samples before the start and after the end are assumed to be zero.
+    void process(const float* in, size_t inSamples, std::vector<float>& out) const;
+
+    // Resamples one chunk of a continuous stream. The filter history is kept between calls,
+    // so that chunk boundaries do not introduce discontinuities. The output is delayed by half the filter length.
+    void processStream(const float* in, size_t inSamples, std::vector<float>& out);
+    void resetStream();
+
+private:
+    size_t             m_inRate = 0;
+    size_t             m_outRate = 0;
+    size_t             m_up = 1;
+    size_t             m_down = 1;
+    size_t             m_tapsPerPhase = 0;
+    std::vector<float> m_coeffs;          // phase-major: m_coeffs[phase * m_tapsPerPhase + k]
+    std::vector<float> m_stream;          // filter history followed by the current chunk
+    size_t             m_streamT = 0;     // time of the next output sample, at the upsampled rate, relative to m_stream[0]
+    bool               m_streamInit = false;
+};
+
+/**
+ * \brief Converts a yarp::sig::Sound into the mono, float, 16kHz PCM stream expected by whisper.
+ * The int16 to float conversion reads the raw planar buffer of the Sound in bulk (SSE2/NEON when available),
+ * the channels are downmixed according to the selected policy and the result is resampled to the target rate.
+ */
+class AudioFrontEnd
+{
+public:
+    enum class Downmix
+    {
+        first,      // use only channel 0
+        average,    // average of all the channels
+        select,     // use only the channel selected with setChannel()
+        beamform    // delay-and-sum: the channels are aligned to channel 0 and averaged
+    };
+
+    static bool parseDownmix(const std::string& str, Downmix& mode);
+
+    void setDownmix(Downmix mode) { m_downmix = mode; }
+    void setChannel(size_t channel) { m_channel = channel; }
+    void setTargetRate(size_t rate) { m_targetRate = rate; }
+    Downmix getDownmix() const { return m_downmix; }
+
+    // Fills pcm with the converted audio. Returns false if the sound cannot be converted.
+    bool process(const yarp::sig::Sound& sound, std::vector<float>& pcm);
+    // Same as process(), also filling channels with every channel of the sound, converted and resampled.
+    bool process(const yarp::sig::Sound& sound, std::vector<float>& pcm, std::vector<std::vector<float>>& channels);
+    // Same as process(), for consecutive chunks of the same audio stream.
+    bool processStream(const yarp::sig::Sound& sound, std::vector<float>& pcm);
+    // Same as processStream(), reading n samples of planar int16 channels, e.g. straight from a SharedAudioRing.
+    // beamform is applied as average, since the delays cannot be estimated reliably on short chunks.
+    bool processStream(const int16_t* const* rows, size_t channels, size_t n, size_t rate, std::vector<float>& pcm);
+    void resetStream() { m_resampler.resetStream(); }
+
+    // dst[i] = src[i] * gain
+    static void int16ToFloat(const int16_t* src, float* dst, size_t n, float gain);
+    // dst[i] += src[i] * gain
+    static void int16Accumulate(const int16_t* src, float* dst, size_t n, float gain);
+    // Delay-and-sum beamforming: each channel is shifted by the delay, up to max_lag samples, maximizing its
+    // correlation with channel 0, then the channels are averaged.
+    static void delayAndSum(const std::vector<std::vector<float>>& channels, size_t max_lag, std::vector<float>& out);
+
+private:
+    bool configure(const yarp::sig::Sound& sound);
+    bool toMono(const yarp::sig::Sound& sound, std::vector<float>& mono);
+    // Converts every channel of the sound, reading its buffer once.
+    bool toChannels(const yarp::sig::Sound& sound, std::vector<std::vector<float>>& channels);
+    void downmix(const std::vector<std::vector<float>>& channels, size_t rate, std::vector<float>& mono) const;
+
+    Downmix             m_downmix = Downmix::first;
+    size_t              m_channel = 0;
+    size_t              m_targetRate = 16000;
+    PolyphaseResampler  m_resampler;
+    std::vector<float>  m_mono;
+    std::vector<std::vector<float>> m_channels;     // channels at the input rate
+};
+
+#endif
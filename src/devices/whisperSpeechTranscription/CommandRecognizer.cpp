@@ -0,0 +1,345 @@
+/*
+ * SPDX-FileCopyrightText: 2023-2023 Istituto Italiano di Tecnologia (IIT)
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "CommandRecognizer.h"
+
+#include <yarp/os/LogComponent.h>
+#include <yarp/os/LogStream.h>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <limits>
+
+namespace {
+YARP_LOG_COMPONENT(WHISPER_COMMANDS, "yarp.device.WhisperSpeechTranscription.commands")
+
+constexpr double neg_inf = -std::numeric_limits<double>::infinity();
+
+double msSince(std::chrono::steady_clock::time_point t)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t).count();
+}
+
+double logAdd(double a, double b)
+{
+    if (a == neg_inf) { return b; }
+    if (b == neg_inf) { return a; }
+    double m = std::max(a, b);
+    return m + std::log(std::exp(a - m) + std::exp(b - m));
+}
+
+std::vector<uint32_t> decodeUtf8(const std::string& str)
+{
+    std::vector<uint32_t> cps;
+    for (size_t i = 0; i < str.size();)
+    {
+        auto c = static_cast<unsigned char>(str[i]);
+        int len = c < 0x80 ? 1 : (c >> 5) == 0x6 ? 2 : (c >> 4) == 0xE ? 3 : (c >> 3) == 0x1E ? 4 : 1;
+        uint32_t cp = len == 1 ? c : c & (0xFF >> (len + 1));
+        for (int k = 1; k < len && i + k < str.size(); k++)
+        {
+            cp = (cp << 6) | (static_cast<unsigned char>(str[i + k]) & 0x3F);
+        }
+        cps.push_back(cp);
+        i += len;
+    }
+    return cps;
+}
+
+// node of the prefix tree of the tokenized commands
+struct TrieNode
+{
+    whisper_token    token = -1;
+    std::vector<int> children;
+    std::vector<int> commands;      // commands ending at this node
+};
+}
+
+bool CommandRecognizer::parseMode(const std::string& str, Mode& mode)
+{
+    if      (str == "score")   { mode = Mode::score; }
+    else if (str == "grammar") { mode = Mode::grammar; }
+    else { return false; }
+    return true;
+}
+
+bool CommandRecognizer::loadFile(const std::string& path)
+{
+    std::ifstream in(path);
+    if (!in.is_open())
+    {
+        yCError(WHISPER_COMMANDS) << "Unable to open the command list" << path;
+        return false;
+    }
+    std::vector<std::string> commands;
+    std::string line;
+    while (std::getline(in, line))
+    {
+        size_t first = line.find_first_not_of(" \t\r");
+        size_t last = line.find_last_not_of(" \t\r");
+        if (first == std::string::npos || line[first] == '#')
+        {
+            continue;
+        }
+        commands.push_back(line.substr(first, last - first + 1));
+    }
+    if (commands.empty())
+    {
+        yCError(WHISPER_COMMANDS) << "The command list" << path << "is empty";
+        return false;
+    }
+    setCommands(commands);
+    yCInfo(WHISPER_COMMANDS) << "Loaded" << commands.size() << "commands from" << path;
+    return true;
+}
+
+void CommandRecognizer::setCommands(const std::vector<std::string>& commands)
+{
+    m_commands = commands;
+    m_normalized.clear();
+    for (const auto& c : m_commands)
+    {
+        m_normalized.push_back(normalize(c));
+    }
+    buildGrammar();
+}
+
+std::string CommandRecognizer::normalize(const std::string& text)
+{
+    std::string out;
+    bool space = false;
+    for (char ch : text)
+    {
+        auto c = static_cast<unsigned char>(ch);
+        if (std::isalnum(c) || c >= 0x80)
+        {
+            if (space && !out.empty()) { out += ' '; }
+            out += char(std::tolower(c));
+            space = false;
+        }
+        else
+        {
+            space = true;
+        }
+    }
+    return out;
+}
+
+int CommandRecognizer::match(const std::string& text) const
+{
+    auto it = std::find(m_normalized.begin(), m_normalized.end(), normalize(text));
+    return it == m_normalized.end() ? -1 : int(it - m_normalized.begin());
+}
+
+void CommandRecognizer::buildGrammar()
+{
+    //root ::= " " [cC][mM][dD]1 | " " [cC][mM][dD]2 | ...
+    m_rules.assign(1, {});
+    auto& root = m_rules.front();
+    for (size_t c = 0; c < m_commands.size(); c++)
+    {
+        if (c > 0)
+        {
+            root.push_back({WHISPER_GRETYPE_ALT, 0});
+        }
+        root.push_back({WHISPER_GRETYPE_CHAR, ' '});
+        for (uint32_t cp : decodeUtf8(m_commands[c]))
+        {
+            if (cp < 0x80 && std::isalpha(int(cp)))
+            {
+                root.push_back({WHISPER_GRETYPE_CHAR, uint32_t(std::tolower(int(cp)))});
+                root.push_back({WHISPER_GRETYPE_CHAR_ALT, uint32_t(std::toupper(int(cp)))});
+            }
+            else
+            {
+                root.push_back({WHISPER_GRETYPE_CHAR, cp});
+            }
+        }
+    }
+    root.push_back({WHISPER_GRETYPE_END, 0});
+
+    m_rulePtrs.clear();
+    for (const auto& rule : m_rules)
+    {
+        m_rulePtrs.push_back(rule.data());
+    }
+}
+
+void CommandRecognizer::applyGrammar(whisper_full_params& params, float penalty) const
+{
+    //whisper only reads the rules
+    params.grammar_rules = const_cast<const whisper_grammar_element**>(m_rulePtrs.data());
+    params.n_grammar_rules = m_rulePtrs.size();
+    params.i_start_rule = 0;
+    params.grammar_penalty = penalty;
+}
+
+bool CommandRecognizer::score(whisper_context* ctx, whisper_state* state, const std::vector<float>& pcm, int n_threads, const char* language, Result& result) const
+{
+    result = Result();
+    if (m_commands.empty())
+    {
+        return false;
+    }
+    const int n_vocab = whisper_n_vocab(ctx);
+
+    //prefix tree of the commands, each one as written and with a capital initial (as at the beginning of a sentence)
+    std::vector<TrieNode> trie(1);
+    std::vector<whisper_token> tokens(128);
+    for (size_t c = 0; c < m_commands.size(); c++)
+    {
+        for (int variant = 0; variant < 2; variant++)
+        {
+            std::string text = " " + m_commands[c];
+            if (variant == 1)
+            {
+                if (!std::islower(static_cast<unsigned char>(text[1]))) { continue; }
+                text[1] = char(std::toupper(static_cast<unsigned char>(text[1])));
+            }
+            int n = whisper_tokenize(ctx, text.c_str(), tokens.data(), int(tokens.size()));
+            if (n <= 0)
+            {
+                yCWarning(WHISPER_COMMANDS) << "Unable to tokenize the command" << m_commands[c];
+                continue;
+            }
+            int node = 0;
+            for (int i = 0; i < n; i++)
+            {
+                int next = -1;
+                for (int child : trie[node].children)
+                {
+                    if (trie[child].token == tokens[i]) { next = child; break; }
+                }
+                if (next < 0)
+                {
+                    next = int(trie.size());
+                    trie.emplace_back();
+                    trie.back().token = tokens[i];
+                    trie[node].children.push_back(next);
+                }
+                node = next;
+            }
+            trie[node].commands.push_back(int(c));
+        }
+    }
+
+    //tokens that can follow a complete command
+    std::vector<whisper_token> terminators = { whisper_token_eot(ctx) };
+    for (const char* punct : { ".", "!", "?", "," })
+    {
+        whisper_token t;
+        if (whisper_tokenize(ctx, punct, &t, 1) == 1) { terminators.push_back(t); }
+    }
+
+    std::vector<whisper_token> prompt = { whisper_token_sot(ctx) };
+    if (whisper_is_multilingual(ctx))
+    {
+        int lang_id = language ? whisper_lang_id(language) : -1;
+        prompt.push_back(whisper_token_lang(ctx, lang_id >= 0 ? lang_id : whisper_lang_id("en")));
+        prompt.push_back(whisper_token_transcribe(ctx));
+    }
+    prompt.push_back(whisper_token_not(ctx));
+
+    auto t_encode = std::chrono::steady_clock::now();
+    if (whisper_pcm_to_mel_with_state(ctx, state, pcm.data(), int(pcm.size()), n_threads) != 0 ||
+        whisper_encode_with_state(ctx, state, 0, n_threads) != 0)
+    {
+        yCError(WHISPER_COMMANDS) << "Encoder pass failed";
+        return false;
+    }
+    result.encode_ms = msSince(t_encode);
+
+    auto t_decode = std::chrono::steady_clock::now();
+    if (whisper_decode_with_state(ctx, state, prompt.data(), int(prompt.size()), 0, n_threads) != 0)
+    {
+        yCError(WHISPER_COMMANDS) << "Decoder pass failed";
+        return false;
+    }
+
+    //depth-first visit: the kv cache of the decoder holds the tokens from the root to the current node
+    std::vector<double> command_logp(m_commands.size(), neg_inf);
+    std::vector<double> command_mean_logp(m_commands.size(), neg_inf);
+    std::function<bool(int, int, double)> visit = [&](int node, int n_past, double logp) {
+        const float* logits = whisper_get_logits_from_state(state);
+        float max_logit = *std::max_element(logits, logits + n_vocab);
+        double sum = 0;
+        for (int i = 0; i < n_vocab; i++)
+        {
+            sum += std::exp(double(logits[i] - max_logit));
+        }
+        const double lse = max_logit + std::log(sum);
+
+        if (!trie[node].commands.empty())
+        {
+            double p_end = 0;
+            for (whisper_token t : terminators)
+            {
+                p_end += std::exp(logits[t] - lse);
+            }
+            double lp = logp + std::log(std::max(p_end, 1e-10));
+            const double n_tokens = double(n_past - int(prompt.size()) + 1);
+            for (int c : trie[node].commands)
+            {
+                command_logp[c] = logAdd(command_logp[c], lp);
+                command_mean_logp[c] = std::max(command_mean_logp[c], lp / n_tokens);
+            }
+        }
+
+        //the logits are overwritten by the next decoder pass
+        std::vector<double> child_logp;
+        for (int child : trie[node].children)
+        {
+            child_logp.push_back(logits[trie[child].token] - lse);
+        }
+        for (size_t k = 0; k < trie[node].children.size(); k++)
+        {
+            int child = trie[node].children[k];
+            whisper_token token = trie[child].token;
+            if (whisper_decode_with_state(ctx, state, &token, 1, n_past, n_threads) != 0)
+            {
+                return false;
+            }
+            result.decoded_tokens++;
+            if (!visit(child, n_past + 1, logp + child_logp[k]))
+            {
+                return false;
+            }
+        }
+        return true;
+    };
+    if (!visit(0, int(prompt.size()), 0.0))
+    {
+        yCError(WHISPER_COMMANDS) << "Decoder pass failed";
+        return false;
+    }
+    result.decode_ms = msSince(t_decode);
+
+    //probabilities normalized over the set of commands
+    double max_logp = *std::max_element(command_logp.begin(), command_logp.end());
+    if (max_logp == neg_inf)
+    {
+        return false;
+    }
+    double total = 0;
+    for (double lp : command_logp)
+    {
+        total += std::exp(lp - max_logp);
+    }
+    for (size_t c = 0; c < m_commands.size(); c++)
+    {
+        result.candidates.push_back({ m_commands[c], std::exp(command_logp[c] - max_logp) / total, std::exp(command_mean_logp[c]) });
+    }
+    std::stable_sort(result.candidates.begin(), result.candidates.end(),
+                     [](const Candidate& a, const Candidate& b) { return a.probability > b.probability; });
+    result.index = int(std::max_element(command_logp.begin(), command_logp.end()) - command_logp.begin());
+    result.probability = result.candidates.front().probability;
+    result.confidence = result.candidates.front().confidence;
+    return true;
+}
@@ -0,0 +1,76 @@
+/*
+ * SPDX-FileCopyrightText: 2023-2023 Istituto Italiano di Tecnologia (IIT)
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef WHISPER_COMMANDRECOGNIZER_H
+#define WHISPER_COMMANDRECOGNIZER_H
+
+#include <string>
+#include <vector>
+
+#include "whisper.h"
+
+/**
+ * \brief Recognition of a closed set of commands.
+ * Two strategies are available:
+ * - score: the audio is encoded once, then the tokens of every command are decoded along a prefix tree
+ *   (commands sharing a prefix share its decoder passes). The probability of each command, terminator included,
+ *   is normalized over the set, which tells the commands apart but is high also when none was spoken: the
+ *   confidence, geometric mean of the probabilities of the tokens of the command, rejects the other speech;
+ * - grammar: whisper_full() runs with a grammar accepting only the commands, the output is then matched to the list.
+ */
+class CommandRecognizer
+{
+public:
+    enum class Mode
+    {
+        score,
+        grammar
+    };
+
+    struct Candidate
+    {
+        std::string command;
+        double      probability = 0;
+        double      confidence = 0;     // geometric mean of the probabilities of the tokens, terminator included
+    };
+
+    struct Result
+    {
+        int                    index = -1;          // best command, -1 if none
+        double                 probability = 0;
+        double                 confidence = 0;
+        std::vector<Candidate> candidates;          // sorted by decreasing probability
+        double                 encode_ms = 0;
+        double                 decode_ms = 0;
+        int                    decoded_tokens = 0;
+    };
+
+    static bool parseMode(const std::string& str, Mode& mode);
+
+    // One command per line, empty lines and lines starting with '#' are skipped.
+    bool loadFile(const std::string& path);
+    void setCommands(const std::vector<std::string>& commands);
+    bool isEnabled() const { return !m_commands.empty(); }
+    const std::vector<std::string>& commands() const { return m_commands; }
+
+    // Sets a grammar accepting exactly one of the commands (letters are case insensitive).
+    void applyGrammar(whisper_full_params& params, float penalty) const;
+    // Index of the command equal to text, ignoring case, punctuation and spacing; -1 if none.
+    int match(const std::string& text) const;
+    // Scores all the commands against pcm, using the state for the encoder and decoder passes.
+    bool score(whisper_context* ctx, whisper_state* state, const std::vector<float>& pcm, int n_threads, const char* language, Result& result) const;
+
+    static std::string normalize(const std::string& text);
+
+private:
+    void buildGrammar();
+
+    std::vector<std::string>                          m_commands;
+    std::vector<std::string>                          m_normalized;
+    std::vector<std::vector<whisper_grammar_element>> m_rules;
+    std::vector<const whisper_grammar_element*>       m_rulePtrs;
+};
+
+#endif
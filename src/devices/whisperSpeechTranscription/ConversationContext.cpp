@@ -0,0 +1,67 @@
+/*
+ * SPDX-FileCopyrightText: 2023-2023 Istituto Italiano di Tecnologia (IIT)
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "ConversationContext.h"
+
+namespace {
+// upper bound of the characters of a token, to bound the history before it is tokenized
+constexpr size_t max_chars_per_token = 8;
+}
+
+bool ConversationContext::expiredLocked() const
+{
+    return m_cfg.timeout_s > 0 && !m_history.empty() &&
+           std::chrono::duration<double>(clock::now() - m_last).count() > m_cfg.timeout_s;
+}
+
+void ConversationContext::get(std::string& text)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    text.clear();
+    if (expiredLocked())
+    {
+        m_history.clear();
+        m_chars = 0;
+    }
+    for (const auto& utterance : m_history)
+    {
+        text += utterance;
+    }
+}
+
+void ConversationContext::append(const std::string& text)
+{
+    if (text.empty() || !isEnabled())
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (expiredLocked())
+    {
+        m_history.clear();
+        m_chars = 0;
+    }
+    m_history.push_back(text);
+    m_chars += text.size();
+    while (m_history.size() > 1 && m_chars - m_history.front().size() >= m_cfg.max_tokens * max_chars_per_token)
+    {
+        m_chars -= m_history.front().size();
+        m_history.pop_front();
+    }
+    m_last = clock::now();
+}
+
+void ConversationContext::reset()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_history.clear();
+    m_chars = 0;
+}
+
+size_t ConversationContext::size() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_history.size();
+}
@@ -0,0 +1,51 @@
+/*
+ * SPDX-FileCopyrightText: 2023-2023 Istituto Italiano di Tecnologia (IIT)
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef WHISPER_CONVERSATIONCONTEXT_H
+#define WHISPER_CONVERSATIONCONTEXT_H
+
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+
+/**
+ * \brief Text of the last utterances of a conversation, used as decoder prompt of the next one.
+ * The text is kept rather than the tokens, since consecutive requests can be served by models with different
+ * vocabularies. The history is forgotten when no utterance is added for `timeout_s`.
+ */
+class ConversationContext
+{
+public:
+    struct Config
+    {
+        size_t max_tokens = 0;          // 0 disables the context
+        double timeout_s = 30.0;        // 0 = never expires
+    };
+
+    void setConfig(const Config& cfg) { m_cfg = cfg; }
+    const Config& getConfig() const { return m_cfg; }
+    bool isEnabled() const { return m_cfg.max_tokens > 0; }
+
+    // Copies the history into text, oldest utterance first. The history is cleared if it has expired.
+    void get(std::string& text);
+    void append(const std::string& text);
+    void reset();
+    size_t size() const;
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    bool expiredLocked() const;
+
+    Config                  m_cfg;
+    mutable std::mutex      m_mutex;
+    std::deque<std::string> m_history;
+    size_t                  m_chars = 0;
+    clock::time_point       m_last;
+};
+
+#endif
@@ -0,0 +1,109 @@
+/*
+ * SPDX-FileCopyrightText: 2023-2023 Istituto Italiano di Tecnologia (IIT)
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "DecodingPolicy.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+// weight of the last request in the moving averages
+constexpr double ewma_alpha = 0.2;
+constexpr double window_s = 30.0;
+}
+
+void DecodingPolicy::setConfig(const Config& cfg)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_cfg = cfg;
+}
+
+DecodingPolicy::Config DecodingPolicy::getConfig() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_cfg;
+}
+
+bool DecodingPolicy::isEnabled() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_cfg.budget_s > 0;
+}
+
+void DecodingPolicy::apply(double duration_s, whisper_full_params& params) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_cfg.budget_s <= 0 || duration_s <= 0)
+    {
+        return;
+    }
+    const double budget = m_cfg.budget_s * m_cfg.margin;
+    const int beam_size = params.beam_search.beam_size;
+
+    //until beam search is measured, its attempts are assumed to cost half a greedy attempt per beam
+    Estimate beam = m_beam;
+    if (!beam.measured)
+    {
+        beam.encode_s = m_greedy.encode_s;
+        beam.decode_rtf = m_greedy.decode_rtf * std::max(1, beam_size) / 2.0;
+    }
+    const double windows = std::max(1.0, std::ceil(duration_s / window_s));
+    auto predict = [duration_s, windows](const Estimate& e, int retries) {
+        return std::max(windows * e.encode_s + duration_s * e.decode_rtf * (1 + retries), duration_s * e.min_rtf);
+    };
+
+    //a guess that turned out too low is not tried again
+    const bool beam_allowed = beam.measured || !beam.aborted;
+    const bool use_beam = params.strategy == WHISPER_SAMPLING_BEAM_SEARCH && beam_size > 1 && beam_allowed && predict(beam, 0) <= budget;
+    if (!use_beam)
+    {
+        params.strategy = WHISPER_SAMPLING_GREEDY;
+    }
+    const Estimate& e = use_beam ? beam : m_greedy;
+
+    //whisper retries at temperature, temperature + inc, ... up to 1: the increment sets the number of retries
+    const float span = 1.0f - params.temperature;
+    const int max_retries = params.temperature_inc > 0 ? int(std::floor(span / params.temperature_inc + 1e-3f)) : 0;
+    const double spare = budget - predict(e, 0);
+    const double retry_s = duration_s * e.decode_rtf;
+    const int retries = spare > 0 && retry_s > 0 ? std::min(max_retries, int(spare / retry_s)) : 0;
+    params.temperature_inc = retries > 0 ? span / float(retries) : 0.0f;
+}
+
+void DecodingPolicy::record(bool beam, double audio_s, double encode_ms, double decode_ms, int windows, int fallbacks)
+{
+    if (audio_s <= 0 || windows <= 0)
+    {
+        return;
+    }
+    const double attempts = 1.0 + double(fallbacks) / windows;
+    const double encode_s = encode_ms / 1000.0 / windows;
+    const double decode_rtf = decode_ms / 1000.0 / audio_s / attempts;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Estimate& e = beam ? m_beam : m_greedy;
+    e.min_rtf = 0;
+    if (!e.measured)
+    {
+        e.encode_s = encode_s;
+        e.decode_rtf = decode_rtf;
+        e.measured = true;
+        return;
+    }
+    e.encode_s += ewma_alpha * (encode_s - e.encode_s);
+    e.decode_rtf += ewma_alpha * (decode_rtf - e.decode_rtf);
+}
+
+void DecodingPolicy::recordAborted(bool beam, double audio_s, double elapsed_ms)
+{
+    if (audio_s <= 0)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Estimate& e = beam ? m_beam : m_greedy;
+    e.min_rtf = std::max(e.min_rtf, elapsed_ms / 1000.0 / audio_s);
+    e.aborted = true;
+}
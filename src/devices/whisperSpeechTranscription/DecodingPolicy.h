@@ -0,0 +1,58 @@
+/*
+ * SPDX-FileCopyrightText: 2023-2023 Istituto Italiano di Tecnologia (IIT)
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef WHISPER_DECODINGPOLICY_H
+#define WHISPER_DECODINGPOLICY_H
+
+#include <mutex>
+
+#include "whisper.h"
+
+/**
+ * \brief Chooses the decoding strategy of each request so that it fits a latency budget.
+ * The time of an encoder pass (one per 30 s window) and the real-time factor of one decoding attempt are measured on
+ * the completed requests (moving averages, separately for greedy and beam search). For a request of a given duration, beam search is used
+ * only if it is configured and predicted to fit the budget, and the number of temperature fallbacks is limited to
+ * the ones that still fit. The budget is further enforced by aborting the inference at the deadline: an aborted run
+ * only tells that the strategy costs more than the time it ran, which is kept as a lower bound of its cost until the
+ * next completed run, and beam search is not used again until it has been measured on a completed run.
+ */
+class DecodingPolicy
+{
+public:
+    struct Config
+    {
+        double budget_s = 0;            // 0 disables the policy
+        double margin = 0.8;            // fraction of the budget the prediction must fit in
+    };
+
+    void setConfig(const Config& cfg);
+    Config getConfig() const;
+    bool isEnabled() const;
+
+    // Adapts the strategy and temperature_inc of params, which hold the configured ones, to audio of duration_s.
+    void apply(double duration_s, whisper_full_params& params) const;
+    // Figures of a completed inference.
+    void record(bool beam, double audio_s, double encode_ms, double decode_ms, int windows, int fallbacks);
+    // An inference aborted at the deadline after elapsed_ms.
+    void recordAborted(bool beam, double audio_s, double elapsed_ms);
+
+private:
+    struct Estimate
+    {
+        double encode_s = 0.5;          // per window
+        double decode_rtf = 0.05;       // of a single decoding attempt
+        double min_rtf = 0;             // of the whole inference, from the aborted runs since the last completed one
+        bool   measured = false;
+        bool   aborted = false;
+    };
+
+    mutable std::mutex m_mutex;
+    Config             m_cfg;
+    Estimate           m_greedy;
+    Estimate           m_beam;
+};
+
+#endif
@@ -0,0 +1,89 @@
+/*
+ * SPDX-FileCopyrightText: 2023-2023 Istituto Italiano di Tecnologia (IIT)
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef WHISPER_INFERENCESTATS_H
+#define WHISPER_INFERENCESTATS_H
+
+#include <chrono>
+
+/**
+ * \brief Why the inference of a request was skipped, returning an empty transcription.
+ */
+enum class SkipReason
+{
+    none = 0,
+    no_speech = 1,      // the VAD found no speech
+    no_keyword = 2      // the audio does not begin with a keyword
+};
+
+/**
+ * \brief Per-request performance figures.
+ * whisper.cpp does not expose the timings of a whisper_state, so encode/decode times are measured
+ * with the encoder_begin and logits_filter callbacks: encode_ms goes from the start of each encoder pass
+ * to the first sampled token (thus it includes the prompt pass), decode_ms is the remaining inference time.
+ */
+struct InferenceStats
+{
+    double audio_s = 0;             // duration of the audio received by the device
+    double conversion_ms = 0;       // front-end (conversion, downmix, resampling) and VAD
+    double keyword_ms = 0;          // wake-word pre-filter
+    double language_ms = 0;         // language detection, 0 if the language was known or pinned
+    double encode_ms = 0;
+    double decode_ms = 0;
+    double postprocess_ms = 0;      // segment assembly and text filters
+    double total_ms = 0;
+    int    windows = 0;             // number of encoder passes
+    int    segments = 0;
+    int    tokens = 0;
+    int    fallbacks = 0;           // decoding attempts repeated at a higher temperature
+    bool   cache_hit = false;       // the transcription was found in the TranscriptionCache
+    bool   aborted = false;         // the inference was stopped at the deadline, the transcription is partial
+    SkipReason skipped = SkipReason::none;
+
+    double realTimeFactor() const { return audio_s > 0 ? total_ms / 1000.0 / audio_s : 0; }
+    double samplesPerSecond(int rate) const { return total_ms > 0 ? audio_s * rate * 1000.0 / total_ms : 0; }
+    double tokensPerSecond() const { return (encode_ms + decode_ms) > 0 ? tokens * 1000.0 / (encode_ms + decode_ms) : 0; }
+};
+
+/**
+ * \brief Helper measuring the encoder passes of a whisper_full_with_state() call through its callbacks.
+ * A decoding attempt starts when the logits of an empty sequence are computed: attempts beyond the first of
+ * each window are temperature fallbacks.
+ */
+struct StageTimer
+{
+    using clock = std::chrono::steady_clock;
+
+    clock::time_point encodeStart;
+    bool              encoding = false;
+    double            encode_ms = 0;
+    int               windows = 0;
+    int               attempts = 0;
+    bool              newAttempt = true;
+
+    void reset() { encoding = false; encode_ms = 0; windows = 0; attempts = 0; newAttempt = true; }
+    void onEncoderBegin() { encodeStart = clock::now(); encoding = true; windows++; newAttempt = true; }
+    void onLogits(int n_tokens)
+    {
+        if (encoding)
+        {
+            encode_ms += std::chrono::duration<double, std::milli>(clock::now() - encodeStart).count();
+            encoding = false;
+        }
+        // all the decoders of an attempt start together with an empty sequence
+        if (n_tokens == 0 && newAttempt)
+        {
+            attempts++;
+            newAttempt = false;
+        }
+        else if (n_tokens > 0)
+        {
+            newAttempt = true;
+        }
+    }
+    int fallbacks() const { return attempts > windows ? attempts - windows : 0; }
+};
+
+#endif
@@ -0,0 +1,133 @@
+/*
+ * SPDX-FileCopyrightText: 2023-2023 Istituto Italiano di Tecnologia (IIT)
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "KeywordSpotter.h"
+
+#include <algorithm>
+
+#include "CommandRecognizer.h"
+
+namespace {
+// whisper_full() silently ignores inputs shorter than one second
+constexpr size_t min_window_samples = WHISPER_SAMPLE_RATE + WHISPER_SAMPLE_RATE / 10;
+// the encoder produces one frame every 20 ms
+constexpr size_t samples_per_frame = WHISPER_SAMPLE_RATE / 50;
+
+size_t editDistance(const std::string& a, const std::string& b)
+{
+    std::vector<size_t> row(b.size() + 1);
+    for (size_t j = 0; j <= b.size(); j++) { row[j] = j; }
+    for (size_t i = 1; i <= a.size(); i++)
+    {
+        size_t diag = row[0];
+        row[0] = i;
+        for (size_t j = 1; j <= b.size(); j++)
+        {
+            size_t up = row[j];
+            row[j] = std::min({ row[j] + 1, row[j - 1] + 1, diag + (a[i - 1] == b[j - 1] ? 0 : 1) });
+            diag = up;
+        }
+    }
+    return row[b.size()];
+}
+
+std::vector<std::string> words(const std::string& text)
+{
+    std::vector<std::string> out;
+    size_t pos = 0;
+    while (pos < text.size())
+    {
+        size_t end = text.find(' ', pos);
+        if (end == std::string::npos) { end = text.size(); }
+        out.push_back(text.substr(pos, end - pos));
+        pos = end + 1;
+    }
+    return out;
+}
+}
+
+void KeywordSpotter::setConfig(const Config& cfg)
+{
+    m_cfg = cfg;
+    m_normalized.clear();
+    for (const auto& k : m_cfg.keywords)
+    {
+        m_normalized.push_back(CommandRecognizer::normalize(k));
+    }
+}
+
+double KeywordSpotter::similarity(const std::string& keyword, const std::string& text)
+{
+    const std::vector<std::string> text_words = words(text);
+    const size_t n = std::max<size_t>(1, words(keyword).size());
+    double best = 0;
+    for (size_t i = 0; i < text_words.size(); i++)
+    {
+        std::string candidate = text_words[i];
+        for (size_t k = 1; k < n && i + k < text_words.size(); k++)
+        {
+            candidate += ' ' + text_words[i + k];
+        }
+        const size_t len = std::max(keyword.size(), candidate.size());
+        if (len > 0)
+        {
+            best = std::max(best, 1.0 - double(editDistance(keyword, candidate)) / double(len));
+        }
+    }
+    return best;
+}
+
+bool KeywordSpotter::spot(whisper_context* ctx, whisper_state* state, const std::vector<float>& pcm, const whisper_full_params& base,
+                          std::vector<float>& window, Result& result) const
+{
+    result = Result();
+    const size_t n = std::min(pcm.size(), m_cfg.window_ms * (WHISPER_SAMPLE_RATE / 1000));
+    window.assign(pcm.begin(), pcm.begin() + n);
+    if (window.size() < min_window_samples)
+    {
+        window.resize(min_window_samples, 0.0f);
+    }
+
+    whisper_full_params params = base;
+    params.strategy = WHISPER_SAMPLING_GREEDY;
+    params.greedy.best_of = 1;
+    params.temperature_inc = 0.0f;
+    params.no_context = true;
+    params.single_segment = true;
+    params.no_timestamps = true;
+    params.token_timestamps = false;
+    params.max_tokens = m_cfg.max_tokens;
+    params.audio_ctx = std::min(whisper_n_audio_ctx(ctx), int((window.size() + samples_per_frame - 1) / samples_per_frame));
+    params.prompt_tokens = nullptr;
+    params.prompt_n_tokens = 0;
+    params.initial_prompt = nullptr;
+    params.grammar_rules = nullptr;
+    params.n_grammar_rules = 0;
+    params.print_progress = false;
+    params.print_realtime = false;
+    params.encoder_begin_callback = nullptr;
+    params.logits_filter_callback = nullptr;
+    params.abort_callback = nullptr;
+    if (whisper_full_with_state(ctx, state, params, window.data(), int(window.size())) != 0)
+    {
+        return false;
+    }
+    for (int i = 0; i < whisper_full_n_segments_from_state(state); i++)
+    {
+        result.heard += whisper_full_get_segment_text_from_state(state, i);
+    }
+
+    const std::string heard = CommandRecognizer::normalize(result.heard);
+    for (size_t k = 0; k < m_normalized.size(); k++)
+    {
+        double s = similarity(m_normalized[k], heard);
+        if (s > result.similarity)
+        {
+            result.similarity = s;
+            result.index = s >= m_cfg.min_similarity ? int(k) : -1;
+        }
+    }
+    return true;
+}
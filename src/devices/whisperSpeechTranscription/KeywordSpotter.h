@@ -0,0 +1,55 @@
+/*
+ * SPDX-FileCopyrightText: 2023-2023 Istituto Italiano di Tecnologia (IIT)
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef WHISPER_KEYWORDSPOTTER_H
+#define WHISPER_KEYWORDSPOTTER_H
+
+#include <string>
+#include <vector>
+
+#include "whisper.h"
+
+/**
+ * \brief Wake-word pre-filter: only the utterances beginning with one of the keywords are transcribed.
+ * The first `window_ms` of the audio are transcribed with the encoder context shrunk to the window (the cost of
+ * the encoder is proportional to it) and at most `max_tokens` decoded tokens. The text is then compared, word
+ * window by word window, with each keyword: the similarity is 1 - edit distance / length of the normalized text,
+ * so that small misrecognitions ("hey robbie" for "hey robot") are tolerated.
+ */
+class KeywordSpotter
+{
+public:
+    struct Config
+    {
+        std::vector<std::string> keywords;      // empty disables the spotter
+        size_t                   window_ms = 1500;
+        double                   min_similarity = 0.7;
+        int                      max_tokens = 8;
+    };
+
+    struct Result
+    {
+        int         index = -1;                 // keyword found, -1 if none
+        double      similarity = 0;             // of the best keyword
+        std::string heard;                      // text of the window
+    };
+
+    void setConfig(const Config& cfg);
+    const Config& getConfig() const { return m_cfg; }
+    bool isEnabled() const { return !m_cfg.keywords.empty(); }
+
+    // Transcribes the beginning of pcm with the state and matches it with the keywords. window is a scratch buffer.
+    bool spot(whisper_context* ctx, whisper_state* state, const std::vector<float>& pcm, const whisper_full_params& base,
+              std::vector<float>& window, Result& result) const;
+
+    // Best similarity between keyword and the windows of as many consecutive words of text.
+    static double similarity(const std::string& keyword, const std::string& text);
+
+private:
+    Config                   m_cfg;
+    std::vector<std::string> m_normalized;
+};
+
+#endif
@@ -0,0 +1,98 @@
+/*
+ * SPDX-FileCopyrightText: 2023-2023 Istituto Italiano di Tecnologia (IIT)
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "LanguagePinner.h"
+
+#include <cstring>
+
+void LanguagePinner::setConfig(const Config& cfg)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_cfg = cfg;
+    if (m_cfg.min_probability <= 0)
+    {
+        m_stats.language = nullptr;
+    }
+}
+
+LanguagePinner::Config LanguagePinner::getConfig() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_cfg;
+}
+
+bool LanguagePinner::isEnabled() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_cfg.min_probability > 0;
+}
+
+bool LanguagePinner::expiredLocked() const
+{
+    return m_cfg.timeout_s > 0 && std::chrono::duration<double>(clock::now() - m_last).count() > m_cfg.timeout_s;
+}
+
+const char* LanguagePinner::pinned()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_stats.language && expiredLocked())
+    {
+        //new session
+        m_stats.language = nullptr;
+    }
+    if (m_stats.language)
+    {
+        m_stats.pinned_requests++;
+        m_last = clock::now();
+    }
+    return m_stats.language;
+}
+
+void LanguagePinner::pin(const char* language, double probability)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stats.detections++;
+    if (m_cfg.min_probability <= 0 || !language || probability < m_cfg.min_probability)
+    {
+        return;
+    }
+    m_stats.language = language;
+    m_stats.probability = probability;
+    m_last = clock::now();
+}
+
+void LanguagePinner::confirm(const char* language, double score)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_stats.language || !language || std::strcmp(language, m_stats.language) != 0)
+    {
+        return;
+    }
+    if (score < m_cfg.recheck_score)
+    {
+        m_stats.language = nullptr;
+        m_stats.rechecks++;
+        return;
+    }
+    m_last = clock::now();
+}
+
+void LanguagePinner::reset()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stats.language = nullptr;
+    m_stats.probability = 0;
+}
+
+LanguagePinner::Stats LanguagePinner::stats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Stats st = m_stats;
+    if (st.language && expiredLocked())
+    {
+        st.language = nullptr;
+    }
+    return st;
+}
@@ -0,0 +1,63 @@
+/*
+ * SPDX-FileCopyrightText: 2023-2023 Istituto Italiano di Tecnologia (IIT)
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef WHISPER_LANGUAGEPINNER_H
+#define WHISPER_LANGUAGEPINNER_H
+
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+
+/**
+ * \brief Language detected once per session and then pinned, when the language is 'auto'.
+ * whisper detects the language of every request with an extra encoder pass; instead the language of the first
+ * request of a session is detected, and if its probability is at least `min_probability` the following requests
+ * are decoded with it. The pin is dropped, and the language detected again, when a request decoded with it has a
+ * score below `recheck_score` (e.g. another speaker, another language) or when no request arrives for `timeout_s`.
+ */
+class LanguagePinner
+{
+public:
+    struct Config
+    {
+        double min_probability = 0;     // 0 disables the pinning
+        double recheck_score = 0.5;
+        double timeout_s = 300.0;       // 0 = never expires
+    };
+
+    struct Stats
+    {
+        const char* language = nullptr; // pinned, nullptr if none
+        double      probability = 0;    // of the pinned language when it was detected
+        size_t      detections = 0;
+        size_t      pinned_requests = 0;
+        size_t      rechecks = 0;       // pins dropped because of a low score
+    };
+
+    void setConfig(const Config& cfg);
+    Config getConfig() const;
+    bool isEnabled() const;
+
+    // Language pinned for the session, nullptr if none or expired.
+    const char* pinned();
+    // Pins language (a static string of whisper_lang_str) if probability is high enough.
+    void pin(const char* language, double probability);
+    // Outcome of a request decoded with language: a low score drops the pin.
+    void confirm(const char* language, double score);
+    void reset();
+    Stats stats() const;
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    bool expiredLocked() const;
+
+    Config             m_cfg;
+    mutable std::mutex m_mutex;
+    Stats              m_stats;
+    clock::time_point  m_last;
+};
+
+#endif
@@ -0,0 +1,101 @@
+/*
+ * SPDX-FileCopyrightText: 2023-2023 Istituto Italiano di Tecnologia (IIT)
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "LongFormSplitter.h"
+
+#include <algorithm>
+#include <cctype>
+#include <limits>
+#include <string>
+
+#include "whisper.h"
+
+namespace {
+constexpr size_t samples_per_ms = WHISPER_SAMPLE_RATE / 1000;
+
+// lowercase letters and digits only, to compare the text of two segments
+std::string comparable(const std::string& text)
+{
+    std::string out;
+    for (char ch : text)
+    {
+        auto c = static_cast<unsigned char>(ch);
+        if (std::isalnum(c))
+        {
+            out += char(std::tolower(c));
+        }
+    }
+    return out;
+}
+}
+
+void LongFormSplitter::split(const float* pcm, size_t n, std::vector<Chunk>& chunks) const
+{
+    chunks.clear();
+    const size_t frame = std::max<size_t>(1, m_cfg.frame_ms * samples_per_ms);
+    const size_t overlap = size_t(std::max(0.0, m_cfg.overlap_s) * WHISPER_SAMPLE_RATE);
+    const size_t max_len = size_t(std::max(0.0, m_cfg.chunk_s) * WHISPER_SAMPLE_RATE);
+    //length owned by a chunk, so that with the overlaps it is not longer than max_len
+    const size_t step = std::max(frame * 2, max_len > 2 * overlap ? max_len - 2 * overlap : 0);
+    const size_t search = std::min(step / 2, size_t(std::max(0.0, m_cfg.search_s) * WHISPER_SAMPLE_RATE));
+
+    size_t pos = 0;
+    while (pos < n)
+    {
+        size_t cut = n;
+        if (n - pos > step)
+        {
+            //cut in the middle of the quietest frame before the nominal end
+            const size_t nominal = pos + step;
+            cut = nominal;
+            float min_energy = std::numeric_limits<float>::max();
+            for (size_t f = nominal - search; f + frame <= nominal; f += frame)
+            {
+                float energy = 0;
+                for (size_t i = f; i < f + frame; i++)
+                {
+                    energy += pcm[i] * pcm[i];
+                }
+                if (energy < min_energy)
+                {
+                    min_energy = energy;
+                    cut = f + frame / 2;
+                }
+            }
+        }
+        Chunk chunk;
+        chunk.keep_begin = pos;
+        chunk.keep_end = cut;
+        chunk.begin = pos > overlap ? pos - overlap : 0;
+        chunk.end = std::min(n, cut + overlap);
+        chunks.push_back(chunk);
+        pos = cut;
+    }
+}
+
+void LongFormSplitter::stitch(const std::vector<Chunk>& chunks, const std::vector<std::vector<SegmentResult>>& segments, std::vector<SegmentResult>& out)
+{
+    out.clear();
+    for (size_t c = 0; c < chunks.size() && c < segments.size(); c++)
+    {
+        const Chunk& chunk = chunks[c];
+        const bool last = c + 1 == chunks.size();
+        const double overlap_s = double(chunk.keep_begin - chunk.begin) / WHISPER_SAMPLE_RATE;
+        for (const auto& seg : segments[c])
+        {
+            const double mid = (seg.t0 + seg.t1) / 2 * WHISPER_SAMPLE_RATE;
+            if ((c > 0 && mid < double(chunk.keep_begin)) || (!last && mid >= double(chunk.keep_end)))
+            {
+                continue;
+            }
+            //the same words can still be transcribed by both chunks, with slightly different timestamps
+            if (!out.empty() && seg.t0 <= out.back().t1 + overlap_s && comparable(seg.text) == comparable(out.back().text))
+            {
+                continue;
+            }
+            out.push_back(seg);
+        }
+    }
+}
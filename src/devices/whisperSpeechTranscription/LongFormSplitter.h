@@ -0,0 +1,53 @@
+/*
+ * SPDX-FileCopyrightText: 2023-2023 Istituto Italiano di Tecnologia (IIT)
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef WHISPER_LONGFORMSPLITTER_H
+#define WHISPER_LONGFORMSPLITTER_H
+
+#include <cstddef>
+#include <vector>
+
+#include "TranscriptionResult.h"
+
+/**
+ * \brief Splits long recordings (mono F32 PCM at WHISPER_SAMPLE_RATE) into chunks that can be transcribed
+ * independently, and stitches their segments back together.
+ * Each cut is placed on the quietest frame of the last `search_s` seconds before the nominal end of the chunk, so
+ * that words are not split. Every chunk is extended by `overlap_s` on both sides; after the transcription a segment
+ * is kept only by the chunk whose own (non overlapping) range contains its midpoint, which removes the duplicates.
+ */
+class LongFormSplitter
+{
+public:
+    struct Config
+    {
+        double chunk_s = 30.0;          // maximum length of a chunk, overlaps included
+        double overlap_s = 1.0;
+        double search_s = 5.0;
+        size_t frame_ms = 20;
+    };
+
+    struct Chunk
+    {
+        size_t begin = 0;               // samples sent to whisper
+        size_t end = 0;
+        size_t keep_begin = 0;          // samples owned by the chunk
+        size_t keep_end = 0;
+    };
+
+    void setConfig(const Config& cfg) { m_cfg = cfg; }
+    const Config& getConfig() const { return m_cfg; }
+
+    void split(const float* pcm, size_t n, std::vector<Chunk>& chunks) const;
+
+    // segments[c] are the segments of chunks[c], with times relative to the beginning of the recording.
+    // out receives the segments owned by each chunk, in order.
+    static void stitch(const std::vector<Chunk>& chunks, const std::vector<std::vector<SegmentResult>>& segments, std::vector<SegmentResult>& out);
+
+private:
+    Config m_cfg;
+};
+
+#endif
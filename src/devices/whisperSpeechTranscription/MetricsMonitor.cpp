@@ -0,0 +1,172 @@
+/*
+ * SPDX-FileCopyrightText: 2023-2023 Istituto Italiano di Tecnologia (IIT)
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "MetricsMonitor.h"
+
+#include <yarp/os/LogComponent.h>
+#include <yarp/os/LogStream.h>
+
+#include "whisper.h"
+
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+namespace {
+YARP_LOG_COMPONENT(WHISPER_METRICS, "yarp.device.WhisperSpeechTranscription.metrics")
+
+void addPair(yarp::os::Bottle& b, const std::string& key, double value)
+{
+    yarp::os::Bottle& pair = b.addList();
+    pair.addString(key);
+    pair.addFloat64(value);
+}
+
+// nearest-rank percentile, values is reordered
+double percentile(std::vector<double>& values, double p)
+{
+    if (values.empty())
+    {
+        return 0;
+    }
+    size_t k = std::min(values.size() - 1, size_t(p * double(values.size())));
+    std::nth_element(values.begin(), values.begin() + k, values.end());
+    return values[k];
+}
+}
+
+MetricsMonitor::~MetricsMonitor()
+{
+    closePort();
+}
+
+void MetricsMonitor::setWindow(size_t n)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    //keep the most recent requests, oldest first
+    std::vector<InferenceStats> history;
+    m_window = std::max<size_t>(1, n);
+    history.reserve(m_window);
+    const size_t kept = std::min(m_window, m_history.size());
+    for (size_t i = kept; i > 0; i--)
+    {
+        history.push_back(m_history[(m_last + m_history.size() + 1 - i) % m_history.size()]);
+    }
+    m_history.swap(history);
+    m_last = m_history.empty() ? 0 : m_history.size() - 1;
+}
+
+bool MetricsMonitor::openPort(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_port.open(name))
+    {
+        yCError(WHISPER_METRICS) << "Unable to open the metrics port" << name;
+        return false;
+    }
+    m_portOpen = true;
+    return true;
+}
+
+void MetricsMonitor::closePort()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_portOpen)
+    {
+        m_port.interrupt();
+        m_port.close();
+        m_portOpen = false;
+    }
+}
+
+void MetricsMonitor::record(const InferenceStats& stats)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_history.size() < m_window)
+    {
+        m_history.reserve(m_window);
+        m_history.push_back(stats);
+        m_last = m_history.size() - 1;
+    }
+    else
+    {
+        m_last = (m_last + 1) % m_history.size();
+        m_history[m_last] = stats;
+    }
+    m_count++;
+
+    if (m_portOpen)
+    {
+        yarp::os::Bottle& b = m_port.prepare();
+        b.clear();
+        addStats(b, stats);
+        addPercentilesLocked(b);
+        m_port.write();
+    }
+}
+
+InferenceStats MetricsMonitor::last() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_history.empty() ? InferenceStats() : m_history[m_last];
+}
+
+void MetricsMonitor::addStats(yarp::os::Bottle& b, const InferenceStats& stats)
+{
+    addPair(b, "audio_s", stats.audio_s);
+    addPair(b, "conversion_ms", stats.conversion_ms);
+    addPair(b, "keyword_ms", stats.keyword_ms);
+    addPair(b, "language_ms", stats.language_ms);
+    addPair(b, "encode_ms", stats.encode_ms);
+    addPair(b, "decode_ms", stats.decode_ms);
+    addPair(b, "postprocess_ms", stats.postprocess_ms);
+    addPair(b, "total_ms", stats.total_ms);
+    addPair(b, "rtf", stats.realTimeFactor());
+    addPair(b, "samples_per_s", stats.samplesPerSecond(WHISPER_SAMPLE_RATE));
+    addPair(b, "windows", stats.windows);
+    addPair(b, "segments", stats.segments);
+    addPair(b, "tokens", stats.tokens);
+    addPair(b, "tokens_per_s", stats.tokensPerSecond());
+    addPair(b, "fallbacks", stats.fallbacks);
+    addPair(b, "cache_hit", stats.cache_hit ? 1 : 0);
+    addPair(b, "aborted", stats.aborted ? 1 : 0);
+    addPair(b, "skipped", int(stats.skipped));
+}
+
+void MetricsMonitor::addPercentiles(yarp::os::Bottle& b) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    addPercentilesLocked(b);
+}
+
+void MetricsMonitor::addPercentilesLocked(yarp::os::Bottle& b) const
+{
+    addPair(b, "requests", double(m_count));
+    addPair(b, "window", double(m_history.size()));
+
+    std::vector<double> values;
+    values.reserve(m_history.size());
+    auto addRolling = [&](const std::string& key, const std::function<double(const InferenceStats&)>& get) {
+        values.clear();
+        for (const auto& s : m_history)
+        {
+            values.push_back(get(s));
+        }
+        addPair(b, key + "_p50", percentile(values, 0.50));
+        addPair(b, key + "_p90", percentile(values, 0.90));
+        addPair(b, key + "_p99", percentile(values, 0.99));
+    };
+    addRolling("total_ms", [](const InferenceStats& s) { return s.total_ms; });
+    addRolling("encode_ms", [](const InferenceStats& s) { return s.encode_ms; });
+    addRolling("decode_ms", [](const InferenceStats& s) { return s.decode_ms; });
+    addRolling("rtf", [](const InferenceStats& s) { return s.realTimeFactor(); });
+
+    double fallbacks = 0;
+    for (const auto& s : m_history)
+    {
+        fallbacks += s.fallbacks;
+    }
+    addPair(b, "fallbacks_per_request", m_history.empty() ? 0 : fallbacks / double(m_history.size()));
+}
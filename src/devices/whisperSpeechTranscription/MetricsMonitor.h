@@ -0,0 +1,58 @@
+/*
+ * SPDX-FileCopyrightText: 2023-2023 Istituto Italiano di Tecnologia (IIT)
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef WHISPER_METRICSMONITOR_H
+#define WHISPER_METRICSMONITOR_H
+
+#include <yarp/os/Bottle.h>
+#include <yarp/os/BufferedPort.h>
+
+#include <cstdint>
+#include <vector>
+#include <mutex>
+#include <string>
+
+#include "InferenceStats.h"
+
+/**
+ * \brief Keeps the figures of the last requests and computes rolling percentiles over them.
+ * If the port is open, every recorded request is published as a Bottle of (key value) pairs: the figures of
+ * the request followed by the p50/p90/p99 of the latency and real-time factor over the window.
+ */
+class MetricsMonitor
+{
+public:
+    MetricsMonitor() = default;
+    ~MetricsMonitor();
+    MetricsMonitor(const MetricsMonitor&) = delete;
+    MetricsMonitor& operator=(const MetricsMonitor&) = delete;
+
+    // Number of requests over which the percentiles are computed.
+    void setWindow(size_t n);
+
+    bool openPort(const std::string& name);
+    void closePort();
+
+    // Stores the figures of a completed request and publishes them.
+    void record(const InferenceStats& stats);
+    InferenceStats last() const;
+
+    // Append (key value) pairs to b.
+    static void addStats(yarp::os::Bottle& b, const InferenceStats& stats);
+    void addPercentiles(yarp::os::Bottle& b) const;
+
+private:
+    void addPercentilesLocked(yarp::os::Bottle& b) const;
+
+    mutable std::mutex                       m_mutex;
+    size_t                                   m_window = 100;
+    std::vector<InferenceStats>              m_history;      // ring buffer of up to m_window requests, allocated once
+    size_t                                   m_last = 0;     // position of the last request in m_history
+    uint64_t                                 m_count = 0;
+    yarp::os::BufferedPort<yarp::os::Bottle> m_port;
+    bool                                     m_portOpen = false;
+};
+
+#endif
@@ -0,0 +1,214 @@
+/*
+ * SPDX-FileCopyrightText: 2023-2023 Istituto Italiano di Tecnologia (IIT)
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "ModelRegistry.h"
+
+#include <yarp/os/LogComponent.h>
+#include <yarp/os/LogStream.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+
+#if defined(_WIN32)
+#  ifndef NOMINMAX
+#    define NOMINMAX
+#  endif
+#  include <windows.h>
+#else
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+namespace {
+YARP_LOG_COMPONENT(WHISPER_MODELS, "yarp.device.WhisperSpeechTranscription.models")
+
+// Read-only mapping of a whole file.
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile() { unmap(); }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool map(const std::string& path)
+    {
+#if defined(_WIN32)
+        m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (m_file == INVALID_HANDLE_VALUE)
+        {
+            return false;
+        }
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(m_file, &size) || size.QuadPart == 0)
+        {
+            unmap();
+            return false;
+        }
+        m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (m_mapping == nullptr)
+        {
+            unmap();
+            return false;
+        }
+        m_data = static_cast<const uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+        m_size = size_t(size.QuadPart);
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0)
+        {
+            ::close(fd);
+            return false;
+        }
+        void* addr = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (addr == MAP_FAILED)
+        {
+            return false;
+        }
+#  ifdef MADV_SEQUENTIAL
+        madvise(addr, size_t(st.st_size), MADV_SEQUENTIAL);
+#  endif
+        m_data = static_cast<const uint8_t*>(addr);
+        m_size = size_t(st.st_size);
+#endif
+        return m_data != nullptr;
+    }
+
+    void unmap()
+    {
+#if defined(_WIN32)
+        if (m_data) { UnmapViewOfFile(m_data); }
+        if (m_mapping) { CloseHandle(m_mapping); }
+        if (m_file != INVALID_HANDLE_VALUE) { CloseHandle(m_file); }
+        m_mapping = nullptr;
+        m_file = INVALID_HANDLE_VALUE;
+#else
+        if (m_data) { munmap(const_cast<uint8_t*>(m_data), m_size); }
+#endif
+        m_data = nullptr;
+        m_size = 0;
+    }
+
+    const uint8_t* data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+private:
+    const uint8_t* m_data = nullptr;
+    size_t         m_size = 0;
+#if defined(_WIN32)
+    HANDLE         m_file = INVALID_HANDLE_VALUE;
+    HANDLE         m_mapping = nullptr;
+#endif
+};
+
+// State of the whisper_model_loader reading from a MappedFile.
+struct MappedReader
+{
+    MappedFile file;
+    size_t     pos = 0;
+};
+
+std::string modelKey(const std::string& path, const whisper_context_params& params)
+{
+    std::string key = path;
+    key += params.use_gpu ? "|gpu" + std::to_string(params.gpu_device) : "|cpu";
+    key += params.flash_attn ? "|fa" : "";
+    return key;
+}
+}
+
+ModelRegistry& ModelRegistry::instance()
+{
+    static ModelRegistry registry;
+    return registry;
+}
+
+size_t ModelRegistry::size()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return size_t(std::count_if(m_models.begin(), m_models.end(), [](const auto& m) { return !m.second.expired(); }));
+}
+
+ModelRegistry::ModelPtr ModelRegistry::acquire(const std::string& path, const whisper_context_params& params, bool use_mmap)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto it = m_models.begin(); it != m_models.end();)
+    {
+        it = it->second.expired() ? m_models.erase(it) : std::next(it);
+    }
+
+    const std::string key = modelKey(path, params);
+    auto it = m_models.find(key);
+    if (it != m_models.end())
+    {
+        if (ModelPtr model = it->second.lock())
+        {
+            yCInfo(WHISPER_MODELS) << "Sharing the already loaded model" << path;
+            return model;
+        }
+    }
+
+    whisper_context* ctx = load(path, params, use_mmap);
+    if (ctx == nullptr)
+    {
+        return nullptr;
+    }
+    ModelPtr model(ctx, [](whisper_context* c) { whisper_free(c); });
+    m_models[key] = model;
+    return model;
+}
+
+whisper_context* ModelRegistry::load(const std::string& path, const whisper_context_params& params, bool use_mmap)
+{
+    auto t_start = std::chrono::steady_clock::now();
+    whisper_context* ctx = nullptr;
+    MappedReader reader;
+    if (use_mmap && reader.file.map(path))
+    {
+        whisper_model_loader loader;
+        loader.context = &reader;
+        loader.read = [](void* ctx, void* output, size_t read_size) {
+            auto* r = static_cast<MappedReader*>(ctx);
+            size_t n = std::min(read_size, r->file.size() - r->pos);
+            std::memcpy(output, r->file.data() + r->pos, n);
+            r->pos += n;
+            return n;
+        };
+        loader.eof = [](void* ctx) {
+            auto* r = static_cast<MappedReader*>(ctx);
+            return r->pos >= r->file.size();
+        };
+        //the weights have been copied into the backend buffers, the mapping is no longer needed
+        loader.close = [](void* ctx) {
+            static_cast<MappedReader*>(ctx)->file.unmap();
+        };
+        ctx = whisper_init_with_params_no_state(&loader, params);
+    }
+    else
+    {
+        if (use_mmap)
+        {
+            yCWarning(WHISPER_MODELS) << "Unable to map" << path << "- falling back to buffered reads";
+        }
+        ctx = whisper_init_from_file_with_params_no_state(path.c_str(), params);
+    }
+
+    if (ctx != nullptr)
+    {
+        yCInfo(WHISPER_MODELS) << "Model" << path << "loaded in"
+                               << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t_start).count() << "ms";
+    }
+    return ctx;
+}
@@ -0,0 +1,44 @@
+/*
+ * SPDX-FileCopyrightText: 2023-2023 Istituto Italiano di Tecnologia (IIT)
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef WHISPER_MODELREGISTRY_H
+#define WHISPER_MODELREGISTRY_H
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "whisper.h"
+
+/**
+ * \brief Process-wide registry of the loaded whisper models.
+ * The device instances opening the same model file share a single whisper_context (weights only, every
+ * instance allocates its own states). The context is freed when the last instance releases it.
+ * Models are read through a memory mapping of the file instead of buffered stream reads.
+ */
+class ModelRegistry
+{
+public:
+    using ModelPtr = std::shared_ptr<whisper_context>;
+
+    static ModelRegistry& instance();
+
+    // Returns the context of the model at path, loading it if no other instance is using it.
+    ModelPtr acquire(const std::string& path, const whisper_context_params& params, bool use_mmap = true);
+
+    // Number of models currently loaded.
+    size_t size();
+
+private:
+    ModelRegistry() = default;
+
+    static whisper_context* load(const std::string& path, const whisper_context_params& params, bool use_mmap);
+
+    std::mutex                                            m_mutex;
+    std::map<std::string, std::weak_ptr<whisper_context>> m_models;
+};
+
+#endif
@@ -0,0 +1,106 @@
+/*
+ * SPDX-FileCopyrightText: 2023-2023 Istituto Italiano di Tecnologia (IIT)
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "ModelRouter.h"
+
+#include <yarp/os/LogComponent.h>
+#include <yarp/os/LogStream.h>
+
+namespace {
+YARP_LOG_COMPONENT(WHISPER_ROUTER, "yarp.device.WhisperSpeechTranscription.router")
+}
+
+std::shared_ptr<ModelInstance> ModelInstance::create(const std::string& path, size_t n_states, const AudioFrontEnd& frontEnd, bool use_mmap, bool use_gpu)
+{
+    auto instance = std::make_shared<ModelInstance>();
+    instance->path = path;
+    whisper_context_params params = whisper_context_default_params();
+    params.use_gpu = params.use_gpu && use_gpu;
+    instance->model = ModelRegistry::instance().acquire(path, params, use_mmap);
+    if (!instance->model)
+    {
+        yCError(WHISPER_ROUTER) << "Unable to load the model" << path;
+        return nullptr;
+    }
+    if (!instance->pool.init(instance->model.get(), n_states, frontEnd))
+    {
+        return nullptr;
+    }
+    instance->multilingual = whisper_is_multilingual(instance->model.get()) != 0;
+    return instance;
+}
+
+bool ModelRouter::parseRoute(const std::string& str, Route& route)
+{
+    if      (str == "main")         { route = Route::main; }
+    else if (str == "short")        { route = Route::short_utterance; }
+    else if (str == "multilingual") { route = Route::multilingual; }
+    else { return false; }
+    return true;
+}
+
+std::string ModelRouter::routeName(Route route)
+{
+    switch (route)
+    {
+    case Route::main:            return "main";
+    case Route::short_utterance: return "short";
+    case Route::multilingual:    return "multilingual";
+    default:                     return "";
+    }
+}
+
+void ModelRouter::set(Route route, InstancePtr instance)
+{
+    //the previous instance is released here, or by the last request still using it
+    InstancePtr previous;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        previous = std::move(m_routes[size_t(route)]);
+        m_routes[size_t(route)] = std::move(instance);
+    }
+    if (previous)
+    {
+        yCInfo(WHISPER_ROUTER) << "Route" << routeName(route) << ": model" << previous->path << "replaced";
+    }
+}
+
+ModelRouter::InstancePtr ModelRouter::get(Route route) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_routes[size_t(route)];
+}
+
+void ModelRouter::clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto& r : m_routes)
+    {
+        r.reset();
+    }
+}
+
+bool ModelRouter::supports(const InstancePtr& instance, const std::string& language)
+{
+    return instance && (instance->multilingual || language == "en");
+}
+
+ModelRouter::InstancePtr ModelRouter::select(double duration_s, const std::string& language) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const InstancePtr& main = m_routes[size_t(Route::main)];
+    const InstancePtr& short_utterance = m_routes[size_t(Route::short_utterance)];
+    const InstancePtr& multilingual = m_routes[size_t(Route::multilingual)];
+
+    if (duration_s <= m_shortMax && supports(short_utterance, language))
+    {
+        return short_utterance;
+    }
+    if (!supports(main, language) && supports(multilingual, language))
+    {
+        return multilingual;
+    }
+    return main;
+}
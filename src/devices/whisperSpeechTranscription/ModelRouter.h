@@ -0,0 +1,74 @@
+/*
+ * SPDX-FileCopyrightText: 2023-2023 Istituto Italiano di Tecnologia (IIT)
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef WHISPER_MODELROUTER_H
+#define WHISPER_MODELROUTER_H
+
+#include <array>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "AudioFrontEnd.h"
+#include "ModelRegistry.h"
+#include "WhisperStatePool.h"
+
+/**
+ * \brief A loaded model together with the whisper states serving its requests.
+ * Requests hold a reference to the instance, so an instance replaced by ModelRouter::set() stays alive until the
+ * requests running on it are completed.
+ */
+struct ModelInstance
+{
+    std::string             path;
+    ModelRegistry::ModelPtr model;
+    WhisperStatePool        pool;       // declared after the model: the states are freed first
+    bool                    multilingual = false;
+
+    // Loads the model (or shares it through the ModelRegistry) and allocates n_states states.
+    static std::shared_ptr<ModelInstance> create(const std::string& path, size_t n_states, const AudioFrontEnd& frontEnd, bool use_mmap, bool use_gpu);
+};
+
+/**
+ * \brief Chooses the model serving each request.
+ * - `main` serves every request not matched by the other routes;
+ * - `short` serves the utterances not longer than short_max_s, e.g. commands with a tiny model;
+ * - `multilingual` serves the languages not supported by the main model.
+ * A route is used only if its model supports the requested language.
+ */
+class ModelRouter
+{
+public:
+    using InstancePtr = std::shared_ptr<ModelInstance>;
+
+    enum class Route
+    {
+        main = 0,
+        short_utterance,
+        multilingual,
+        count
+    };
+
+    static bool parseRoute(const std::string& str, Route& route);
+    static std::string routeName(Route route);
+
+    void setShortMax(double seconds) { m_shortMax = seconds; }
+
+    // Replaces the model of the route, nullptr removes it.
+    void set(Route route, InstancePtr instance);
+    InstancePtr get(Route route) const;
+    void clear();
+
+    InstancePtr select(double duration_s, const std::string& language) const;
+
+private:
+    static bool supports(const InstancePtr& instance, const std::string& language);
+
+    mutable std::mutex                                  m_mutex;
+    std::array<InstancePtr, size_t(Route::count)>       m_routes;
+    double                                              m_shortMax = 3.0;
+};
+
+#endif
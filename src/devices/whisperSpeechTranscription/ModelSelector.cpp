@@ -0,0 +1,250 @@
+/*
+ * SPDX-FileCopyrightText: 2023-2023 Istituto Italiano di Tecnologia (IIT)
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "ModelSelector.h"
+
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+
+#if defined(_WIN32)
+#  include <windows.h>
+#  if defined(_M_X64) || defined(_M_IX86)
+#    include <intrin.h>
+#    include <immintrin.h>
+#  endif
+#else
+#  include <unistd.h>
+#endif
+
+#include "whisper.h"
+
+namespace {
+constexpr uint32_t ggml_file_magic = 0x67676d6c;   // "ggml"
+constexpr int32_t ggml_qnt_version_factor = 1000;
+constexpr size_t mb = 1024 * 1024;
+
+// ggml_ftype of the header of the model file, in order of decreasing accuracy
+struct WeightType
+{
+    int32_t     ftype;
+    const char* name;
+    int         accuracy;
+};
+const WeightType weight_types[] = {
+    {0, "f32", 100}, {1, "f16", 100}, {7, "q8_0", 90}, {14, "q6_k", 85}, {9, "q5_1", 80}, {13, "q5_k", 80},
+    {8, "q5_0", 75}, {12, "q4_k", 70}, {3, "q4_1", 65}, {2, "q4_0", 60}, {11, "q3_k", 50}, {10, "q2_k", 40},
+};
+
+// hparams of the model file, after the magic
+struct ModelHeader
+{
+    int32_t n_vocab;
+    int32_t n_audio_ctx;
+    int32_t n_audio_state;
+    int32_t n_audio_head;
+    int32_t n_audio_layer;
+    int32_t n_text_ctx;
+    int32_t n_text_state;
+    int32_t n_text_head;
+    int32_t n_text_layer;
+    int32_t n_mels;
+    int32_t ftype;
+};
+
+// Self-attention cache (sized for the decoders of beam search), cross-attention cache and compute buffers, the
+// latter dominated by the encoder activations.
+size_t stateBytes(const ModelHeader& h)
+{
+    const size_t f16 = 2;
+    const size_t kv_self = size_t(h.n_text_layer) * 3 * h.n_text_ctx * h.n_text_state * 2 * f16;
+    const size_t kv_cross = size_t(h.n_text_layer) * h.n_audio_ctx * h.n_text_state * 2 * f16;
+    const size_t compute = size_t(h.n_audio_ctx) * h.n_audio_state * 48 * sizeof(float);
+    return kv_self + kv_cross + compute;
+}
+
+// True if the linked ggml reports feature as enabled, recent versions list only the enabled ones
+bool builtWith(const std::string& system_info, const std::string& feature)
+{
+    return (" " + system_info).find(" " + feature + " = 1") != std::string::npos;
+}
+}
+
+std::string ModelSelector::CpuFeatures::toString() const
+{
+    std::ostringstream str;
+    str << "AVX2 = " << avx2 << " | AVX512 = " << avx512 << " | NEON = " << neon << " | F16C = " << f16c;
+    return str.str();
+}
+
+ModelSelector::CpuFeatures ModelSelector::detectCpu()
+{
+    CpuFeatures cpu;
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_cpu_init();
+    cpu.avx2 = __builtin_cpu_supports("avx2");
+    cpu.avx512 = __builtin_cpu_supports("avx512f");
+    cpu.f16c = __builtin_cpu_supports("f16c");
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    int info[4];
+    __cpuid(info, 1);
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+    const bool ymm = (xcr0 & 0x6) == 0x6;
+    const bool zmm = (xcr0 & 0xe6) == 0xe6;
+    cpu.f16c = ymm && (info[2] & (1 << 29)) != 0;
+    __cpuidex(info, 7, 0);
+    cpu.avx2 = ymm && (info[1] & (1 << 5)) != 0;
+    cpu.avx512 = zmm && (info[1] & (1 << 16)) != 0;
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+    cpu.neon = true;
+    cpu.f16c = true;
+#endif
+    const std::string system_info = whisper_print_system_info();
+    cpu.avx2 = cpu.avx2 && builtWith(system_info, "AVX2");
+    cpu.avx512 = cpu.avx512 && builtWith(system_info, "AVX512");
+    cpu.neon = cpu.neon && builtWith(system_info, "NEON");
+    //on ARM the half precision conversions are NEON instructions
+    cpu.f16c = cpu.f16c && (builtWith(system_info, "F16C") || cpu.neon);
+    return cpu;
+}
+
+size_t ModelSelector::availableMemory()
+{
+#if defined(_WIN32)
+    MEMORYSTATUSEX status;
+    status.dwLength = sizeof(status);
+    return GlobalMemoryStatusEx(&status) ? size_t(status.ullAvailPhys) : 0;
+#else
+    //MemAvailable includes the page cache that can be reclaimed, unlike the free pages
+    std::ifstream meminfo("/proc/meminfo");
+    std::string key;
+    size_t kb = 0;
+    while (meminfo >> key >> kb)
+    {
+        if (key == "MemAvailable:")
+        {
+            return kb * 1024;
+        }
+        meminfo.ignore(256, '\n');
+    }
+#  if defined(_SC_AVPHYS_PAGES)
+    long pages = sysconf(_SC_AVPHYS_PAGES);
+    long page_size = sysconf(_SC_PAGESIZE);
+    if (pages > 0 && page_size > 0)
+    {
+        return size_t(pages) * size_t(page_size);
+    }
+#  endif
+    return 0;
+#endif
+}
+
+bool ModelSelector::readVariant(const std::string& path, Variant& variant)
+{
+    variant = Variant();
+    variant.path = path;
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file)
+    {
+        return false;
+    }
+    variant.file_bytes = size_t(file.tellg());
+    file.seekg(0);
+
+    uint32_t magic = 0;
+    ModelHeader header;
+    if (!file.read(reinterpret_cast<char*>(&magic), sizeof(magic)) || magic != ggml_file_magic ||
+        !file.read(reinterpret_cast<char*>(&header), sizeof(header)))
+    {
+        return false;
+    }
+    const int32_t ftype = header.ftype % ggml_qnt_version_factor;
+    for (const auto& t : weight_types)
+    {
+        if (t.ftype == ftype)
+        {
+            variant.type = t.name;
+            variant.accuracy = t.accuracy;
+            variant.state_bytes = stateBytes(header);
+            return true;
+        }
+    }
+    return false;
+}
+
+int ModelSelector::accuracyOf(const std::string& type)
+{
+    for (const auto& t : weight_types)
+    {
+        if (type == t.name)
+        {
+            return t.accuracy;
+        }
+    }
+    return -1;
+}
+
+int ModelSelector::select(const std::vector<Variant>& variants, const CpuFeatures& cpu, const Config& cfg, size_t available, std::string& reason)
+{
+    const int floor = cfg.min_accuracy.empty() ? 0 : accuracyOf(cfg.min_accuracy);
+    size_t limit = cfg.max_memory_bytes > 0 ? cfg.max_memory_bytes : available / 10 * 9;
+    if (limit == 0)
+    {
+        limit = SIZE_MAX;
+    }
+
+    int best = -1;
+    int smallest = -1;
+    for (int i = 0; i < int(variants.size()); i++)
+    {
+        const Variant& v = variants[i];
+        if (v.type.empty() || v.accuracy < floor)
+        {
+            continue;
+        }
+        const size_t memory = v.memory(cfg.n_states);
+        if (smallest < 0 || memory < variants[smallest].memory(cfg.n_states))
+        {
+            smallest = i;
+        }
+        if (memory > limit)
+        {
+            continue;
+        }
+        if (best < 0)
+        {
+            best = i;
+            continue;
+        }
+        const Variant& b = variants[best];
+        const bool better = cpu.fastQuantized()
+            ? (memory < b.memory(cfg.n_states) || (memory == b.memory(cfg.n_states) && v.accuracy > b.accuracy))
+            : (v.accuracy > b.accuracy || (v.accuracy == b.accuracy && memory < b.memory(cfg.n_states)));
+        if (better)
+        {
+            best = i;
+        }
+    }
+
+    std::ostringstream str;
+    auto limitStr = [limit]() { return limit == SIZE_MAX ? std::string("unknown") : std::to_string(limit / mb) + " MB"; };
+    if (smallest < 0)
+    {
+        str << "no variant is at least as accurate as " << (cfg.min_accuracy.empty() ? "any known type" : cfg.min_accuracy);
+        reason = str.str();
+        return -1;
+    }
+    if (best < 0)
+    {
+        str << "no variant fits in " << limitStr() << ", using the smallest one (" << variants[smallest].memory(cfg.n_states) / mb << " MB)";
+        reason = str.str();
+        return smallest;
+    }
+    str << variants[best].type << ", " << variants[best].memory(cfg.n_states) / mb << " MB of " << limitStr() << ", "
+        << (cpu.fastQuantized() ? "smallest variant (SIMD quantized kernels available)" : "most accurate variant (no SIMD quantized kernels)");
+    reason = str.str();
+    return best;
+}
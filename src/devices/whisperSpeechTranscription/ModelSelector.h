@@ -0,0 +1,66 @@
+/*
+ * SPDX-FileCopyrightText: 2023-2023 Istituto Italiano di Tecnologia (IIT)
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef WHISPER_MODELSELECTOR_H
+#define WHISPER_MODELSELECTOR_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/**
+ * \brief Chooses among the variants of a model (e.g. f16, q8_0, q5_1 files of the same model) the one that best
+ * fits the host.
+ * The weight type and the size of each variant are read from the header of its file. Variants less accurate than
+ * the floor, or whose weights plus whisper states exceed the memory limit, are discarded. Then, if the CPU has
+ * SIMD integer dot products (AVX2, AVX-512, NEON) that the linked ggml was built with, the smallest variant is
+ * chosen, since quantized weights are faster there; otherwise quantized kernels run scalar and the most accurate
+ * variant is chosen.
+ */
+class ModelSelector
+{
+public:
+    struct Variant
+    {
+        std::string path;
+        std::string type;               // f32, f16, q8_0, ... empty if the file could not be read
+        int         accuracy = 0;       // rank of the weight type, higher is more accurate
+        size_t      file_bytes = 0;
+        size_t      state_bytes = 0;    // estimated memory of a whisper state
+        size_t      memory(size_t n_states) const { return file_bytes + n_states * state_bytes; }
+    };
+
+    struct CpuFeatures
+    {
+        bool avx2 = false;
+        bool avx512 = false;
+        bool neon = false;
+        bool f16c = false;
+
+        bool fastQuantized() const { return avx2 || avx512 || neon; }
+        std::string toString() const;
+    };
+
+    struct Config
+    {
+        std::string min_accuracy;       // weight type, e.g. q8_0. Empty = any
+        size_t      max_memory_bytes = 0;   // 0 = memory available on the host
+        size_t      n_states = 1;
+    };
+
+    // Features supported by this CPU and enabled in the linked ggml (whisper_print_system_info()).
+    static CpuFeatures detectCpu();
+    // Memory available to the process, 0 if unknown.
+    static size_t availableMemory();
+    // Reads the header of the model file at path.
+    static bool readVariant(const std::string& path, Variant& variant);
+    // Accuracy rank of a weight type, -1 if unknown.
+    static int accuracyOf(const std::string& type);
+
+    // Returns the index of the chosen variant, -1 if none is usable. reason describes the choice.
+    static int select(const std::vector<Variant>& variants, const CpuFeatures& cpu, const Config& cfg, size_t available, std::string& reason);
+};
+
+#endif
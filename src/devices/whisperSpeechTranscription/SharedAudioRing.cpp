@@ -0,0 +1,230 @@
+/*
+ * SPDX-FileCopyrightText: 2023-2023 Istituto Italiano di Tecnologia (IIT)
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "SharedAudioRing.h"
+
+#include <yarp/os/LogComponent.h>
+#include <yarp/os/LogStream.h>
+
+#include <cstring>
+
+#if defined(_WIN32)
+#  include <windows.h>
+#else
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+namespace {
+YARP_LOG_COMPONENT(WHISPER_SHM, "yarp.device.WhisperSpeechTranscription.shm")
+
+static_assert(sizeof(SharedAudioRing::Header) <= SharedAudioRing::header_bytes, "the header does not fit in its space");
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "the ring requires lock-free 64 bit atomics");
+
+#if defined(_WIN32)
+std::string mappingName(const std::string& name)
+{
+    return "Local\\" + (name.size() > 0 && name[0] == '/' ? name.substr(1) : name);
+}
+#endif
+}
+
+bool SharedAudioRing::map(size_t bytes, bool writable)
+{
+#if defined(_WIN32)
+    if (m_owner)
+    {
+        m_handle = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+                                      DWORD(uint64_t(bytes) >> 32), DWORD(bytes & 0xffffffff), mappingName(m_name).c_str());
+    }
+    else
+    {
+        m_handle = OpenFileMappingA(FILE_MAP_READ, FALSE, mappingName(m_name).c_str());
+    }
+    if (m_handle == nullptr)
+    {
+        return false;
+    }
+    //the consumer maps the whole segment created by the producer, whose size is the one of the view (page rounded)
+    void* addr = MapViewOfFile(m_handle, writable ? FILE_MAP_ALL_ACCESS : FILE_MAP_READ, 0, 0, m_owner ? bytes : 0);
+    if (addr == nullptr)
+    {
+        CloseHandle(m_handle);
+        m_handle = nullptr;
+        return false;
+    }
+    if (!m_owner)
+    {
+        MEMORY_BASIC_INFORMATION info;
+        if (VirtualQuery(addr, &info, sizeof(info)) == 0 || info.RegionSize < bytes)
+        {
+            UnmapViewOfFile(addr);
+            CloseHandle(m_handle);
+            m_handle = nullptr;
+            return false;
+        }
+        bytes = info.RegionSize;
+    }
+#else
+    int fd = m_owner ? shm_open(m_name.c_str(), O_CREAT | O_RDWR, 0600) : shm_open(m_name.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+    {
+        return false;
+    }
+    if (m_owner && ftruncate(fd, off_t(bytes)) != 0)
+    {
+        ::close(fd);
+        return false;
+    }
+    if (!m_owner)
+    {
+        //the consumer maps the whole segment created by the producer
+        struct stat st;
+        if (fstat(fd, &st) != 0 || size_t(st.st_size) < bytes)
+        {
+            ::close(fd);
+            return false;
+        }
+        bytes = size_t(st.st_size);
+    }
+    void* addr = mmap(nullptr, bytes, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED)
+    {
+        return false;
+    }
+#endif
+    m_bytes = bytes;
+    m_header = static_cast<Header*>(addr);
+    m_data = reinterpret_cast<int16_t*>(static_cast<unsigned char*>(addr) + header_bytes);
+    return true;
+}
+
+bool SharedAudioRing::create(const std::string& name, size_t sample_rate, size_t channels, size_t capacity)
+{
+    close();
+    if (channels == 0 || capacity == 0 || sample_rate == 0)
+    {
+        return false;
+    }
+    m_name = name;
+    m_owner = true;
+    if (!map(header_bytes + channels * capacity * sizeof(int16_t), true))
+    {
+        yCError(WHISPER_SHM) << "Unable to create the shared memory segment" << name;
+        m_owner = false;
+        return false;
+    }
+    //the header is valid only once magic is written
+    m_header->version = header_version;
+    m_header->sample_rate = uint32_t(sample_rate);
+    m_header->channels = uint32_t(channels);
+    m_header->capacity = capacity;
+    m_header->write_pos.store(0, std::memory_order_relaxed);
+    m_header->alive.store(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    m_header->magic = header_magic;
+    return true;
+}
+
+bool SharedAudioRing::attach(const std::string& name)
+{
+    close();
+    m_name = name;
+    m_owner = false;
+    if (!map(header_bytes, false))
+    {
+        return false;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (m_header->magic != header_magic || m_header->version != header_version ||
+        m_header->channels == 0 || m_header->capacity == 0 ||
+        m_bytes < header_bytes + m_header->channels * m_header->capacity * sizeof(int16_t))
+    {
+        yCError(WHISPER_SHM) << "The shared memory segment" << name << "is not an audio ring";
+        close();
+        return false;
+    }
+    m_rows.resize(m_header->channels);
+    m_readPos = m_header->write_pos.load(std::memory_order_acquire);
+    yCInfo(WHISPER_SHM) << "Reading audio from the shared memory segment" << name << ":"
+                        << m_header->sample_rate << "Hz," << m_header->channels << "channels";
+    return true;
+}
+
+void SharedAudioRing::close()
+{
+    if (!m_header)
+    {
+        return;
+    }
+    if (m_owner)
+    {
+        m_header->alive.store(0, std::memory_order_release);
+    }
+#if defined(_WIN32)
+    UnmapViewOfFile(m_header);
+    CloseHandle(m_handle);
+    m_handle = nullptr;
+#else
+    munmap(m_header, m_bytes);
+    if (m_owner)
+    {
+        shm_unlink(m_name.c_str());
+    }
+#endif
+    m_header = nullptr;
+    m_data = nullptr;
+    m_bytes = 0;
+    m_rows.clear();
+    m_owner = false;
+}
+
+bool SharedAudioRing::isAlive() const
+{
+    return m_header && m_header->alive.load(std::memory_order_acquire) != 0;
+}
+
+void SharedAudioRing::write(const int16_t* const* rows, size_t n)
+{
+    if (!m_header || !m_owner)
+    {
+        return;
+    }
+    const size_t cap = size_t(m_header->capacity);
+    const size_t skip = n > cap ? n - cap : 0;
+    n -= skip;
+    const uint64_t pos = m_header->write_pos.load(std::memory_order_relaxed) + skip;
+    const size_t offset = size_t(pos % cap);
+    const size_t first = std::min(n, cap - offset);
+    for (size_t c = 0; c < m_header->channels; c++)
+    {
+        int16_t* dst = m_data + c * cap;
+        std::memcpy(dst + offset, rows[c] + skip, first * sizeof(int16_t));
+        std::memcpy(dst, rows[c] + skip + first, (n - first) * sizeof(int16_t));
+    }
+    m_header->write_pos.store(pos + n, std::memory_order_release);
+}
+
+bool SharedAudioRing::write(const yarp::sig::Sound& sound)
+{
+    const size_t samples = sound.getSamples();
+    const size_t channels = sound.getChannels();
+    const size_t row_bytes = channels > 0 ? sound.getRawDataSize() / channels : 0;
+    if (!m_header || channels != m_header->channels || sound.getBytesPerSample() != 2 || row_bytes < samples * 2)
+    {
+        return false;
+    }
+    //the raw buffer of the Sound is planar, one row per channel
+    std::vector<const int16_t*> rows(channels);
+    for (size_t c = 0; c < channels; c++)
+    {
+        rows[c] = reinterpret_cast<const int16_t*>(sound.getRawData() + c * row_bytes);
+    }
+    write(rows.data(), samples);
+    return true;
+}
@@ -0,0 +1,125 @@
+/*
+ * SPDX-FileCopyrightText: 2023-2023 Istituto Italiano di Tecnologia (IIT)
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef WHISPER_SHAREDAUDIORING_H
+#define WHISPER_SHAREDAUDIORING_H
+
+#include <yarp/sig/Sound.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * \brief Single-producer ring buffer of int16 PCM in a named shared-memory segment, through which an audio
+ * source running on the same host feeds the device without serializing Sounds through ports.
+ * The segment starts with a Header, followed by one row of `capacity` samples per channel (planar, like the raw
+ * buffer of a yarp::sig::Sound). The producer copies the samples and then advances `write_pos`; each consumer
+ * keeps its own read position and converts the samples directly from the segment. A consumer slower than the
+ * producer loses the overwritten samples, which read() reports.
+ */
+class SharedAudioRing
+{
+public:
+    static constexpr uint32_t header_magic = 0x52415357;   // "WSAR"
+    static constexpr uint32_t header_version = 1;
+
+    struct Header
+    {
+        uint32_t              magic;
+        uint32_t              version;
+        uint32_t              sample_rate;
+        uint32_t              channels;
+        uint64_t              capacity;       // samples per channel
+        std::atomic<uint64_t> write_pos;      // samples per channel written since the creation of the segment
+        std::atomic<uint32_t> alive;          // cleared by the producer when it closes the segment
+    };
+    static constexpr size_t header_bytes = 64;
+
+    SharedAudioRing() = default;
+    SharedAudioRing(const SharedAudioRing&) = delete;
+    SharedAudioRing& operator=(const SharedAudioRing&) = delete;
+    ~SharedAudioRing() { close(); }
+
+    // Producer: creates the segment (name as for shm_open, e.g. /whisper_audio).
+    bool create(const std::string& name, size_t sample_rate, size_t channels, size_t capacity);
+    // Consumer: maps an existing segment. Reading starts from the samples written after this call.
+    bool attach(const std::string& name);
+    void close();
+
+    bool   isOpen() const { return m_header != nullptr; }
+    // Consumer: false once the producer has closed the segment.
+    bool   isAlive() const;
+    size_t sampleRate() const { return m_header ? m_header->sample_rate : 0; }
+    size_t channels() const { return m_header ? m_header->channels : 0; }
+
+    // Producer: appends n samples per channel, rows[c] pointing to the samples of channel c.
+    void write(const int16_t* const* rows, size_t n);
+    // Producer: appends a Sound with the same number of channels as the segment.
+    bool write(const yarp::sig::Sound& sound);
+
+    // Consumer: calls fn(rows, n) on the unread samples, in at most two contiguous spans of the segment.
+    // Returns the number of samples per channel that were overwritten before they could be read.
+    template <typename Fn>
+    size_t read(Fn&& fn);
+
+private:
+    bool map(size_t bytes, bool writable);
+    const int16_t* row(size_t channel) const { return m_data + channel * m_header->capacity; }
+
+    std::string                 m_name;
+    bool                        m_owner = false;
+    Header*                     m_header = nullptr;
+    int16_t*                    m_data = nullptr;
+    size_t                      m_bytes = 0;
+    uint64_t                    m_readPos = 0;
+    std::vector<const int16_t*> m_rows;
+#if defined(_WIN32)
+    void*                       m_handle = nullptr;
+#endif
+};
+
+template <typename Fn>
+size_t SharedAudioRing::read(Fn&& fn)
+{
+    if (!m_header)
+    {
+        return 0;
+    }
+    const uint64_t cap = m_header->capacity;
+    const uint64_t end = m_header->write_pos.load(std::memory_order_acquire);
+    size_t lost = 0;
+    if (end - m_readPos > cap)
+    {
+        //the oldest samples are being overwritten, half of the ring is skipped to get ahead of the producer
+        const uint64_t next = end - cap / 2;
+        lost = size_t(next - m_readPos);
+        m_readPos = next;
+    }
+    const uint64_t begin = m_readPos;
+    while (m_readPos < end)
+    {
+        const size_t offset = size_t(m_readPos % cap);
+        const size_t n = size_t(std::min<uint64_t>(end - m_readPos, cap - offset));
+        for (size_t c = 0; c < m_rows.size(); c++)
+        {
+            m_rows[c] = row(c) + offset;
+        }
+        fn(m_rows.data(), n);
+        m_readPos += n;
+    }
+    //samples overwritten while they were being read
+    const uint64_t after = m_header->write_pos.load(std::memory_order_acquire);
+    if (after - begin > cap)
+    {
+        lost += size_t(std::min<uint64_t>(after - begin - cap, end - begin));
+    }
+    return lost;
+}
+
+#endif
@@ -0,0 +1,310 @@
+/*
+ * SPDX-FileCopyrightText: 2023-2023 Istituto Italiano di Tecnologia (IIT)
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "StreamingTranscriber.h"
+
+#include <yarp/os/LogComponent.h>
+#include <yarp/os/LogStream.h>
+#include <yarp/os/Time.h>
+
+#include <algorithm>
+
+#include "whisper.h"
+
+namespace {
+YARP_LOG_COMPONENT(WHISPER_STREAM, "yarp.device.WhisperSpeechTranscription.stream")
+constexpr double polling_period_s = 0.01;
+constexpr size_t samples_per_ms = WHISPER_SAMPLE_RATE / 1000;
+constexpr double shm_retry_period_s = 1.0;
+}
+
+// ------------------------------------------------------------------------------------------------
+// AudioRingBuffer
+// ------------------------------------------------------------------------------------------------
+void AudioRingBuffer::setCapacity(size_t samples)
+{
+    m_data.assign(samples, 0.0f);
+    clear();
+}
+
+size_t AudioRingBuffer::push(const float* samples, size_t n)
+{
+    const size_t cap = m_data.size();
+    if (cap == 0)
+    {
+        return n;
+    }
+
+    size_t dropped = 0;
+    if (n > cap)
+    {
+        dropped += n - cap;
+        samples += n - cap;
+        n = cap;
+    }
+    if (m_size + n > cap)
+    {
+        size_t overflow = m_size + n - cap;
+        m_head = (m_head + overflow) % cap;
+        m_size -= overflow;
+        dropped += overflow;
+    }
+
+    size_t tail = (m_head + m_size) % cap;
+    size_t first = std::min(n, cap - tail);
+    std::copy(samples, samples + first, m_data.begin() + tail);
+    std::copy(samples + first, samples + n, m_data.begin());
+    m_size += n;
+    return dropped;
+}
+
+size_t AudioRingBuffer::pop(std::vector<float>& dst, size_t n)
+{
+    const size_t cap = m_data.size();
+    n = std::min(n, m_size);
+    size_t first = std::min(n, cap - m_head);
+    dst.insert(dst.end(), m_data.begin() + m_head, m_data.begin() + m_head + first);
+    dst.insert(dst.end(), m_data.begin(), m_data.begin() + (n - first));
+    m_head = cap > 0 ? (m_head + n) % cap : 0;
+    m_size -= n;
+    return n;
+}
+
+size_t AudioRingBuffer::discard(size_t n)
+{
+    const size_t cap = m_data.size();
+    n = std::min(n, m_size);
+    m_head = cap > 0 ? (m_head + n) % cap : 0;
+    m_size -= n;
+    return n;
+}
+
+// ------------------------------------------------------------------------------------------------
+// StreamingTranscriber
+// ------------------------------------------------------------------------------------------------
+StreamingTranscriber::StreamingTranscriber(InferenceFn inference, const AudioFrontEnd& frontEnd) :
+        PeriodicThread(polling_period_s),
+        m_inference(std::move(inference)),
+        m_frontEnd(frontEnd)
+{
+}
+
+StreamingTranscriber::~StreamingTranscriber()
+{
+    stop();
+    closePorts();
+}
+
+bool StreamingTranscriber::configure(const Config& cfg)
+{
+    if (cfg.step_ms == 0 || cfg.length_ms == 0)
+    {
+        yCError(WHISPER_STREAM) << "step_ms and length_ms must be greater than zero";
+        return false;
+    }
+
+    m_cfg = cfg;
+    m_cfg.keep_ms = std::min(m_cfg.keep_ms, m_cfg.step_ms);
+    m_cfg.length_ms = std::max(m_cfg.length_ms, m_cfg.step_ms);
+    m_cfg.buffer_ms = std::max(m_cfg.buffer_ms, m_cfg.length_ms);
+
+    m_stepSamples = m_cfg.step_ms * samples_per_ms;
+    m_lengthSamples = m_cfg.length_ms * samples_per_ms;
+    m_keepSamples = m_cfg.keep_ms * samples_per_ms;
+    m_newLineIterations = std::max<size_t>(1, m_cfg.length_ms / m_cfg.step_ms - 1);
+    m_iteration = 0;
+
+    std::lock_guard<std::mutex> lock(m_inputMutex);
+    m_ring.setCapacity(m_cfg.buffer_ms * samples_per_ms);
+    m_frontEnd.resetStream();
+    m_pcmOld.clear();
+
+    yCInfo(WHISPER_STREAM, "Streaming mode: step %zu ms, length %zu ms, keep %zu ms, new line every %zu steps",
+           m_cfg.step_ms, m_cfg.length_ms, m_cfg.keep_ms, m_newLineIterations);
+    return true;
+}
+
+bool StreamingTranscriber::openPorts(const std::string& prefix)
+{
+    if (!m_audioPort.open(prefix + "/stream/audio:i") ||
+        !m_textPort.open(prefix + "/stream/text:o"))
+    {
+        yCError(WHISPER_STREAM) << "Unable to open the streaming ports with prefix" << prefix;
+        m_audioPort.close();
+        m_textPort.close();
+        return false;
+    }
+    m_audioPort.useCallback(*this);
+    m_portsOpen = true;
+    return true;
+}
+
+void StreamingTranscriber::closePorts()
+{
+    if (m_portsOpen)
+    {
+        m_audioPort.interrupt();
+        m_audioPort.close();
+        m_textPort.interrupt();
+        m_textPort.close();
+        m_portsOpen = false;
+    }
+}
+
+bool StreamingTranscriber::push(const yarp::sig::Sound& sound)
+{
+    std::lock_guard<std::mutex> lock(m_inputMutex);
+    if (!m_frontEnd.processStream(sound, m_chunk))
+    {
+        yCError(WHISPER_STREAM) << "Unable to convert the received audio chunk";
+        return false;
+    }
+    size_t dropped = m_ring.push(m_chunk.data(), m_chunk.size());
+    if (dropped > 0)
+    {
+        yCWarning(WHISPER_STREAM) << "Inference is not keeping up with the audio stream, dropped" << dropped << "samples";
+    }
+    return true;
+}
+
+void StreamingTranscriber::setSharedInput(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(m_inputMutex);
+    m_shm.close();
+    m_shmName = name;
+    m_shmRetryTime = 0;
+}
+
+void StreamingTranscriber::pollSharedInput()
+{
+    std::lock_guard<std::mutex> lock(m_inputMutex);
+    if (m_shmName.empty())
+    {
+        return;
+    }
+    if (m_shm.isOpen() && !m_shm.isAlive())
+    {
+        yCWarning(WHISPER_STREAM) << "The producer closed the shared memory segment" << m_shmName;
+        m_shm.close();
+    }
+    if (!m_shm.isOpen())
+    {
+        //the producer can be started after the device, or restarted
+        const double now = yarp::os::Time::now();
+        if (now < m_shmRetryTime || !m_shm.attach(m_shmName))
+        {
+            m_shmRetryTime = std::max(m_shmRetryTime, now + shm_retry_period_s);
+            return;
+        }
+        m_frontEnd.resetStream();
+    }
+
+    bool ok = true;
+    size_t overwritten = 0;
+    size_t lost = m_shm.read([this, &ok, &overwritten](const int16_t* const* rows, size_t n) {
+        ok = ok && m_frontEnd.processStream(rows, m_shm.channels(), n, m_shm.sampleRate(), m_chunk);
+        if (ok)
+        {
+            overwritten += m_ring.push(m_chunk.data(), m_chunk.size());
+        }
+    });
+    if (!ok)
+    {
+        yCError(WHISPER_STREAM) << "Unable to convert the audio of the shared memory segment" << m_shmName;
+        m_shm.close();
+        m_shmRetryTime = yarp::os::Time::now() + shm_retry_period_s;
+    }
+    if (lost > 0)
+    {
+        yCWarning(WHISPER_STREAM) << "The shared memory producer overran the reader, lost" << lost << "samples";
+    }
+    if (overwritten > 0)
+    {
+        yCWarning(WHISPER_STREAM) << "Inference is not keeping up with the audio stream, dropped" << overwritten << "samples";
+    }
+}
+
+void StreamingTranscriber::onRead(yarp::sig::Sound& sound)
+{
+    push(sound);
+}
+
+void StreamingTranscriber::getHypothesis(std::string& text, double& score) const
+{
+    std::lock_guard<std::mutex> lock(m_resultMutex);
+    text = m_lastText;
+    score = m_lastScore;
+}
+
+void StreamingTranscriber::publish(bool final, const std::string& text, double score)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_resultMutex);
+        m_lastText = text;
+        m_lastScore = score;
+    }
+    if (m_portsOpen)
+    {
+        yarp::os::Bottle& b = m_textPort.prepare();
+        b.clear();
+        b.addString(final ? "final" : "partial");
+        b.addString(text);
+        b.addFloat64(score);
+        m_textPort.write();
+    }
+}
+
+void StreamingTranscriber::run()
+{
+    pollSharedInput();
+    size_t skipped = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_inputMutex);
+        if (m_ring.size() < m_stepSamples)
+        {
+            return;
+        }
+        //at most one window: the audio that piled up while the inference was running is stale
+        if (m_ring.size() > m_lengthSamples)
+        {
+            skipped = m_ring.discard(m_ring.size() - m_lengthSamples);
+        }
+        m_pcmNew.clear();
+        m_ring.pop(m_pcmNew, m_lengthSamples);
+    }
+    if (skipped > 0)
+    {
+        //the previous window does not precede the new audio any more
+        m_pcmOld.clear();
+        yCWarning(WHISPER_STREAM, "Inference is not keeping up with the audio stream, skipped %zu samples", skipped);
+    }
+
+    // new audio plus the tail of the previous window, up to length + keep
+    const size_t n_new = m_pcmNew.size();
+    const size_t n_budget = m_keepSamples + m_lengthSamples;
+    const size_t n_take = std::min(m_pcmOld.size(), n_budget > n_new ? n_budget - n_new : 0);
+    m_window.assign(m_pcmOld.end() - n_take, m_pcmOld.end());
+    m_window.insert(m_window.end(), m_pcmNew.begin(), m_pcmNew.end());
+
+    std::string text;
+    double score = 0;
+    if (!m_inference(m_window, text, score))
+    {
+        yCError(WHISPER_STREAM) << "Failed to process the streaming window";
+        return;
+    }
+
+    m_pcmOld = m_window;
+    m_iteration++;
+    bool final = (m_iteration % m_newLineIterations) == 0;
+    publish(final, text, score);
+
+    if (final)
+    {
+        // keep a small part of the audio for the next window, to mitigate words split at the boundary
+        const size_t n_keep = std::min(m_keepSamples, m_window.size());
+        m_pcmOld.assign(m_window.end() - n_keep, m_window.end());
+    }
+}
@@ -0,0 +1,129 @@
+/*
+ * SPDX-FileCopyrightText: 2023-2023 Istituto Italiano di Tecnologia (IIT)
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef WHISPER_STREAMINGTRANSCRIBER_H
+#define WHISPER_STREAMINGTRANSCRIBER_H
+
+#include <yarp/os/Bottle.h>
+#include <yarp/os/BufferedPort.h>
+#include <yarp/os/PeriodicThread.h>
+#include <yarp/os/TypedReaderCallback.h>
+#include <yarp/sig/Sound.h>
+
+#include "AudioFrontEnd.h"
+#include "SharedAudioRing.h"
+
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * \brief Fixed-capacity FIFO of F32 PCM samples. When full, the oldest samples are overwritten.
+ */
+class AudioRingBuffer
+{
+public:
+    void   setCapacity(size_t samples);
+    size_t capacity() const { return m_data.size(); }
+    size_t size() const { return m_size; }
+    void   clear() { m_head = 0; m_size = 0; }
+
+    // Returns the number of old samples that were dropped to make room for the new ones.
+    size_t push(const float* samples, size_t n);
+    // Moves up to n samples at the end of dst. Returns the number of moved samples.
+    size_t pop(std::vector<float>& dst, size_t n);
+    // Drops up to n of the oldest samples. Returns the number of dropped samples.
+    size_t discard(size_t n);
+
+private:
+    std::vector<float> m_data;
+    size_t             m_head = 0;
+    size_t             m_size = 0;
+};
+
+/**
+ * \brief Sliding-window streaming transcription, following the scheme of the whisper.cpp `stream` example.
+ * Incoming audio chunks are accumulated in a ring buffer. Every `step_ms` of new audio, whisper is run on the
+ * new audio plus the tail of the previous window (up to `length_ms`) and a partial hypothesis is published.
+ * Every `length_ms / step_ms` iterations the hypothesis is finalized and only the last `keep_ms` of audio are carried over.
+ * When the inference falls behind, only the most recent `length_ms` of the pending audio are transcribed: the older
+ * samples are dropped, so that the latency does not keep growing.
+ * Hypotheses are published on `<name>/stream/text:o` as a Bottle: (partial|final) "text" score.
+ * Audio chunks can be received either through transcribe() or directly on the port `<name>/stream/audio:i`.
+ * With setSharedInput(), the audio is also read from a SharedAudioRing written by a producer on the same host:
+ * its samples are converted to float straight from the shared memory, without Sounds or ports.
+ */
+class StreamingTranscriber :
+        public yarp::os::PeriodicThread,
+        public yarp::os::TypedReaderCallback<yarp::sig::Sound>
+{
+public:
+    using InferenceFn = std::function<bool(const std::vector<float>& pcm, std::string& text, double& score)>;
+
+    struct Config
+    {
+        size_t step_ms = 3000;
+        size_t length_ms = 10000;
+        size_t keep_ms = 200;
+        size_t buffer_ms = 30000;   // capacity of the ring buffer of pending audio
+    };
+
+    StreamingTranscriber(InferenceFn inference, const AudioFrontEnd& frontEnd);
+    ~StreamingTranscriber() override;
+
+    bool configure(const Config& cfg);
+    bool openPorts(const std::string& prefix);
+    // Reads the audio from the shared-memory ring with this name, attaching to it as soon as it is created.
+    void setSharedInput(const std::string& name);
+    void closePorts();
+
+    // Appends a chunk of audio to the stream. Thread safe.
+    bool push(const yarp::sig::Sound& sound);
+    // Returns the most recent hypothesis.
+    void getHypothesis(std::string& text, double& score) const;
+
+    //TypedReaderCallback
+    using yarp::os::TypedReaderCallback<yarp::sig::Sound>::onRead;
+    void onRead(yarp::sig::Sound& sound) override;
+
+    //PeriodicThread
+    void run() override;
+
+private:
+    void publish(bool final, const std::string& text, double score);
+    // Moves the samples written in the shared-memory ring to m_ring.
+    void pollSharedInput();
+
+    InferenceFn                           m_inference;
+    Config                                m_cfg;
+    size_t                                m_stepSamples = 0;
+    size_t                                m_lengthSamples = 0;
+    size_t                                m_keepSamples = 0;
+    size_t                                m_newLineIterations = 1;
+    size_t                                m_iteration = 0;
+
+    mutable std::mutex                    m_inputMutex;     // protects m_frontEnd, m_ring and m_chunk
+    AudioFrontEnd                         m_frontEnd;
+    AudioRingBuffer                       m_ring;
+    std::vector<float>                    m_chunk;
+    std::string                           m_shmName;
+    SharedAudioRing                       m_shm;
+    double                                m_shmRetryTime = 0;
+
+    std::vector<float>                    m_pcmNew;
+    std::vector<float>                    m_pcmOld;
+    std::vector<float>                    m_window;
+
+    mutable std::mutex                    m_resultMutex;
+    std::string                           m_lastText;
+    double                                m_lastScore = 0;
+
+    bool                                  m_portsOpen = false;
+    yarp::os::BufferedPort<yarp::sig::Sound> m_audioPort;
+    yarp::os::BufferedPort<yarp::os::Bottle> m_textPort;
+};
+
+#endif
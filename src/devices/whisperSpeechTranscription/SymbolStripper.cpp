@@ -0,0 +1,51 @@
+/*
+ * SPDX-FileCopyrightText: 2023-2023 Istituto Italiano di Tecnologia (IIT)
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "SymbolStripper.h"
+
+namespace {
+struct Annotation
+{
+    char open;
+    char close;
+};
+constexpr Annotation annotations[] = { { '[', ']' }, { '(', ')' }, { '*', '*' } };
+constexpr size_t n_annotations = sizeof(annotations) / sizeof(annotations[0]);
+}
+
+void SymbolStripper::strip(std::string& text)
+{
+    //once the search for a closing symbol fails, there is none further in the text
+    bool unclosed[n_annotations] = {};
+    size_t out = 0;
+    size_t i = 0;
+    while (i < text.size())
+    {
+        size_t skip_to = std::string::npos;
+        for (size_t a = 0; a < n_annotations; a++)
+        {
+            if (text[i] == annotations[a].open && !unclosed[a])
+            {
+                size_t close = text.find(annotations[a].close, i + 1);
+                if (close == std::string::npos)
+                {
+                    unclosed[a] = true;
+                }
+                else
+                {
+                    skip_to = close + 1;
+                }
+                break;
+            }
+        }
+        if (skip_to != std::string::npos)
+        {
+            i = skip_to;
+            continue;
+        }
+        text[out++] = text[i++];
+    }
+    text.resize(out);
+}
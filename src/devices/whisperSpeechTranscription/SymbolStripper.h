@@ -0,0 +1,22 @@
+/*
+ * SPDX-FileCopyrightText: 2023-2023 Istituto Italiano di Tecnologia (IIT)
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef WHISPER_SYMBOLSTRIPPER_H
+#define WHISPER_SYMBOLSTRIPPER_H
+
+#include <string>
+
+/**
+ * \brief Removes the non-speech annotations produced by whisper, e.g. `[BLANK_AUDIO]`, `(music)` or `*laughs*`.
+ * The text is edited in place in a single pass, so no memory is allocated. An opening symbol without its closing
+ * one is kept as it is.
+ */
+class SymbolStripper
+{
+public:
+    static void strip(std::string& text);
+};
+
+#endif
@@ -0,0 +1,605 @@
+/*
+ * SPDX-FileCopyrightText: 2023-2023 Istituto Italiano di Tecnologia (IIT)
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "TextPipeline.h"
+#include "SymbolStripper.h"
+
+#include <array>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+bool isSpace(char c)
+{
+    return std::isspace(static_cast<unsigned char>(c)) != 0;
+}
+
+bool isWordChar(char ch)
+{
+    auto c = static_cast<unsigned char>(ch);
+    return std::isalnum(c) || c >= 0x80 || c == '\'';
+}
+
+char lower(char c)
+{
+    return char(std::tolower(static_cast<unsigned char>(c)));
+}
+
+// Compares two pieces of text ignoring case, spaces and punctuation
+bool sameWords(const char* a, size_t na, const char* b, size_t nb)
+{
+    size_t i = 0;
+    size_t j = 0;
+    while (true)
+    {
+        while (i < na && !isWordChar(a[i])) { i++; }
+        while (j < nb && !isWordChar(b[j])) { j++; }
+        if (i == na || j == nb)
+        {
+            return i == na && j == nb;
+        }
+        if (lower(a[i]) != lower(b[j]))
+        {
+            return false;
+        }
+        i++;
+        j++;
+    }
+}
+
+// whisper begins the text with a space, which the filters rewriting the spacing keep like the others do.
+// Returns where the words are written: after a single space if text begins with one.
+size_t leadingSpace(std::string& text)
+{
+    if (text.empty() || !isSpace(text[0]))
+    {
+        return 0;
+    }
+    text[0] = ' ';
+    return 1;
+}
+
+// Finds the next word of text from i, returning false at the end of the text
+bool nextWord(const std::string& text, size_t& i, size_t& begin, size_t& end)
+{
+    while (i < text.size() && isSpace(text[i])) { i++; }
+    if (i == text.size())
+    {
+        return false;
+    }
+    begin = i;
+    while (i < text.size() && !isSpace(text[i])) { i++; }
+    end = i;
+    return true;
+}
+
+class SymbolsFilter : public TextFilter
+{
+public:
+    const char* name() const override { return "symbols"; }
+    void apply(std::string& text, double) const override { SymbolStripper::strip(text); }
+};
+
+// whisper transcribes silence and noise as these phrases, learned from the credits of subtitled videos
+const char* const silence_phrases[] = {
+    "thank you", "thank you very much", "thanks for watching", "thank you for watching", "you", "bye",
+    "please subscribe", "subtitles by the amara org community",
+};
+
+class HallucinationFilter : public TextFilter
+{
+public:
+    HallucinationFilter(int max_repeats, double max_score) : m_maxRepeats(max_repeats), m_maxScore(max_score) {}
+    const char* name() const override { return "hallucinations"; }
+
+    void apply(std::string& text, double score) const override
+    {
+        if (m_maxRepeats > 0)
+        {
+            collapseLoops(text);
+        }
+        if (score < m_maxScore)
+        {
+            for (const char* phrase : silence_phrases)
+            {
+                if (sameWords(text.data(), text.size(), phrase, std::strlen(phrase)))
+                {
+                    text.clear();
+                    return;
+                }
+            }
+        }
+    }
+
+private:
+    static constexpr size_t max_ngram = 8;
+    static constexpr size_t ring_size = 64;
+
+    struct Span
+    {
+        size_t begin = 0;
+        size_t end = 0;
+    };
+
+    // Keeps the first copy of an n-gram repeated more than m_maxRepeats times in a row, and drops its following
+    // copies. The words are rewritten with single spaces; the last words written are kept in a ring.
+    void collapseLoops(std::string& text) const
+    {
+        std::array<Span, ring_size> words;
+        size_t n_words = 0;
+        auto same = [&](size_t a, size_t b) {
+            const Span& x = words[a % ring_size];
+            const Span& y = words[b % ring_size];
+            return sameWords(text.data() + x.begin, x.end - x.begin, text.data() + y.begin, y.end - y.begin);
+        };
+        const size_t copies = size_t(m_maxRepeats) + 1;
+        size_t loop_n = 0;          // words of the looping n-gram, 0 if none
+        size_t loop_first = 0;      // first word of its copy that is kept
+        size_t loop_pos = 0;        // words of the next copy matched so far
+        size_t loop_end = 0;        // end of the kept copy in the output
+
+        const size_t start = leadingSpace(text);
+        size_t out = start;
+        size_t i = 0;
+        size_t begin = 0;
+        size_t end = 0;
+        while (nextWord(text, i, begin, end))
+        {
+            if (out > start)
+            {
+                text[out++] = ' ';
+            }
+            Span& w = words[n_words % ring_size];
+            w.begin = out;
+            for (size_t k = begin; k < end; k++)
+            {
+                text[out++] = text[k];
+            }
+            w.end = out;
+            n_words++;
+
+            if (loop_n > 0)
+            {
+                if (same(n_words - 1, loop_first + loop_pos))
+                {
+                    if (++loop_pos == loop_n)
+                    {
+                        //another copy: dropped
+                        out = loop_end;
+                        n_words -= loop_n;
+                        loop_pos = 0;
+                    }
+                    continue;
+                }
+                loop_n = 0;
+            }
+
+            for (size_t n = 1; n <= max_ngram && n * copies <= ring_size && n * copies <= n_words; n++)
+            {
+                bool loop = true;
+                for (size_t c = 1; c < copies && loop; c++)
+                {
+                    for (size_t k = 0; k < n && loop; k++)
+                    {
+                        loop = same(n_words - 1 - k, n_words - 1 - k - c * n);
+                    }
+                }
+                if (loop)
+                {
+                    loop_first = n_words - copies * n;
+                    n_words = loop_first + n;
+                    loop_end = words[(n_words - 1) % ring_size].end;
+                    out = loop_end;
+                    loop_n = n;
+                    loop_pos = 0;
+                    break;
+                }
+            }
+        }
+        text.resize(out > start ? out : 0);
+    }
+
+    int    m_maxRepeats;
+    double m_maxScore;
+};
+
+class PunctuationFilter : public TextFilter
+{
+public:
+    const char* name() const override { return "punctuation"; }
+
+    void apply(std::string& text, double) const override
+    {
+        //a space is added after the punctuation glued to the next word: the text is first shifted right by the
+        //spaces to add, so that the output still never overtakes the input
+        const bool lead = !text.empty() && isSpace(text[0]);
+        size_t glued = 0;
+        for (size_t i = 0; i + 1 < text.size(); i++)
+        {
+            glued += isPunctuation(text[i]) && std::isalpha(static_cast<unsigned char>(text[i + 1])) ? 1 : 0;
+        }
+        if (glued > 0)
+        {
+            text.insert(0, glued, ' ');
+        }
+        const size_t start = lead ? leadingSpace(text) : 0;
+
+        size_t out = start;
+        bool space = false;
+        bool sentence_start = true;
+        for (size_t i = start; i < text.size(); i++)
+        {
+            char c = text[i];
+            if (isSpace(c))
+            {
+                space = out > start;
+                continue;
+            }
+            if (isPunctuation(c))
+            {
+                //no space before punctuation, one after it
+                text[out++] = c;
+                sentence_start = sentence_start || c == '.' || c == '!' || c == '?';
+                space = i + 1 < text.size() && std::isalpha(static_cast<unsigned char>(text[i + 1]));
+                continue;
+            }
+            if (space)
+            {
+                text[out++] = ' ';
+                space = false;
+            }
+            if (std::isalnum(static_cast<unsigned char>(c)))
+            {
+                if (sentence_start)
+                {
+                    c = char(std::toupper(static_cast<unsigned char>(c)));
+                }
+                sentence_start = false;
+            }
+            text[out++] = c;
+        }
+        text.resize(out > start ? out : 0);
+    }
+
+private:
+    static bool isPunctuation(char c) { return c != '\0' && std::strchr(",.;:!?", c) != nullptr; }
+};
+
+class LowercaseFilter : public TextFilter
+{
+public:
+    const char* name() const override { return "lowercase"; }
+
+    void apply(std::string& text, double) const override
+    {
+        const size_t start = leadingSpace(text);
+        size_t out = start;
+        bool space = false;
+        for (size_t i = start; i < text.size(); i++)
+        {
+            const char c = text[i];
+            if (!isWordChar(c))
+            {
+                space = out > start;
+                continue;
+            }
+            if (space)
+            {
+                text[out++] = ' ';
+                space = false;
+            }
+            text[out++] = lower(c);
+        }
+        text.resize(out > start ? out : 0);
+    }
+};
+
+class NumbersFilter : public TextFilter
+{
+public:
+    const char* name() const override { return "numbers"; }
+
+    void apply(std::string& text, double) const override
+    {
+        size_t out = 0;
+        size_t i = 0;
+        while (i < text.size())
+        {
+            if (isSpace(text[i]))
+            {
+                text[out++] = text[i++];
+                continue;
+            }
+            //longest run of number words starting at i
+            Parser parser;
+            size_t n_words = 0;
+            size_t run_end = 0;         // end of the last word of the number
+            size_t core_end = 0;        // same, without its trailing punctuation
+            uint64_t value = 0;
+            size_t j = i;
+            size_t begin = 0;
+            size_t end = 0;
+            bool single_one = false;
+            while (nextWord(text, j, begin, end))
+            {
+                size_t core = end;
+                while (core > begin && !std::isalnum(static_cast<unsigned char>(text[core - 1]))) { core--; }
+                if (!parser.feedWord(text.data() + begin, core - begin))
+                {
+                    break;
+                }
+                if (parser.last != Kind::conj)
+                {
+                    n_words++;
+                    run_end = end;
+                    core_end = core;
+                    value = parser.value();
+                    single_one = n_words == 1 && value == 1;
+                }
+                if (core != end)
+                {
+                    //punctuation ends the number
+                    break;
+                }
+            }
+            //a lone "one" is usually a pronoun
+            char digits[24];
+            int n_digits = n_words > 0 && !single_one ? std::snprintf(digits, sizeof(digits), "%llu", static_cast<unsigned long long>(value)) : 0;
+            if (n_digits > 0 && out + size_t(n_digits) <= core_end)
+            {
+                for (int k = 0; k < n_digits; k++)
+                {
+                    text[out++] = digits[k];
+                }
+                for (size_t k = core_end; k < run_end; k++)
+                {
+                    text[out++] = text[k];
+                }
+                i = run_end;
+                continue;
+            }
+            while (i < text.size() && !isSpace(text[i]))
+            {
+                text[out++] = text[i++];
+            }
+        }
+        text.resize(out);
+    }
+
+private:
+    enum class Kind { unit, teen, tens, hundred, scale, conj };
+
+    struct NumberWord
+    {
+        const char* word;
+        Kind        kind;
+        uint64_t    value;
+    };
+
+    static const NumberWord* find(const char* s, size_t n)
+    {
+        static const NumberWord number_words[] = {
+            {"zero", Kind::unit, 0}, {"one", Kind::unit, 1}, {"two", Kind::unit, 2}, {"three", Kind::unit, 3},
+            {"four", Kind::unit, 4}, {"five", Kind::unit, 5}, {"six", Kind::unit, 6}, {"seven", Kind::unit, 7},
+            {"eight", Kind::unit, 8}, {"nine", Kind::unit, 9}, {"ten", Kind::teen, 10}, {"eleven", Kind::teen, 11},
+            {"twelve", Kind::teen, 12}, {"thirteen", Kind::teen, 13}, {"fourteen", Kind::teen, 14},
+            {"fifteen", Kind::teen, 15}, {"sixteen", Kind::teen, 16}, {"seventeen", Kind::teen, 17},
+            {"eighteen", Kind::teen, 18}, {"nineteen", Kind::teen, 19}, {"twenty", Kind::tens, 20},
+            {"thirty", Kind::tens, 30}, {"forty", Kind::tens, 40}, {"fifty", Kind::tens, 50},
+            {"sixty", Kind::tens, 60}, {"seventy", Kind::tens, 70}, {"eighty", Kind::tens, 80},
+            {"ninety", Kind::tens, 90}, {"hundred", Kind::hundred, 100}, {"thousand", Kind::scale, 1000},
+            {"million", Kind::scale, 1000000}, {"and", Kind::conj, 0},
+        };
+        for (const auto& w : number_words)
+        {
+            if (std::strlen(w.word) != n)
+            {
+                continue;
+            }
+            size_t k = 0;
+            while (k < n && lower(s[k]) == w.word[k]) { k++; }
+            if (k == n)
+            {
+                return &w;
+            }
+        }
+        return nullptr;
+    }
+
+    // English number words, e.g. "two thousand and twenty-five"
+    struct Parser
+    {
+        bool     started = false;
+        bool     zero = false;
+        bool     group_hundred = false;     // "hundred" already used since the last scale word
+        Kind     last = Kind::unit;
+        uint64_t total = 0;
+        uint64_t current = 0;
+        uint64_t last_scale = UINT64_MAX;
+
+        uint64_t value() const { return total + current; }
+
+        bool allowed(const NumberWord& w) const
+        {
+            if (zero)
+            {
+                return false;
+            }
+            if (!started)
+            {
+                return w.kind == Kind::unit || w.kind == Kind::teen || w.kind == Kind::tens;
+            }
+            if (w.kind == Kind::unit && w.value == 0)
+            {
+                return false;
+            }
+            switch (last)
+            {
+            case Kind::unit:
+            case Kind::teen:
+                return (w.kind == Kind::hundred && !group_hundred) || (w.kind == Kind::scale && w.value < last_scale);
+            case Kind::tens:
+                return w.kind == Kind::unit || (w.kind == Kind::scale && w.value < last_scale);
+            case Kind::hundred:
+            case Kind::scale:
+                return w.kind == Kind::unit || w.kind == Kind::teen || w.kind == Kind::tens || w.kind == Kind::conj ||
+                       (last == Kind::hundred && w.kind == Kind::scale && w.value < last_scale);
+            case Kind::conj:
+                return w.kind == Kind::unit || w.kind == Kind::teen || w.kind == Kind::tens;
+            }
+            return false;
+        }
+
+        bool feed(const NumberWord& w)
+        {
+            if (!allowed(w))
+            {
+                return false;
+            }
+            zero = !started && w.kind == Kind::unit && w.value == 0;
+            started = true;
+            last = w.kind;
+            switch (w.kind)
+            {
+            case Kind::hundred:
+                current *= 100;
+                group_hundred = true;
+                break;
+            case Kind::scale:
+                total += current * w.value;
+                current = 0;
+                last_scale = w.value;
+                group_hundred = false;
+                break;
+            case Kind::conj:
+                break;
+            default:
+                current += w.value;
+            }
+            return true;
+        }
+
+        // A word, or two number words joined by a hyphen. The parser is unchanged if it is not accepted.
+        bool feedWord(const char* s, size_t n)
+        {
+            const char* hyphen = static_cast<const char*>(std::memchr(s, '-', n));
+            if (!hyphen)
+            {
+                const NumberWord* w = find(s, n);
+                return w && feed(*w);
+            }
+            const NumberWord* first = find(s, size_t(hyphen - s));
+            const NumberWord* second = find(hyphen + 1, n - size_t(hyphen - s) - 1);
+            if (!first || !second || first->kind != Kind::tens || second->kind != Kind::unit)
+            {
+                return false;
+            }
+            Parser next = *this;
+            if (!next.feed(*first) || !next.feed(*second))
+            {
+                return false;
+            }
+            *this = next;
+            return true;
+        }
+    };
+};
+
+const char* const default_profanity[] = {
+    "fuck", "fucking", "fucked", "fucker", "motherfucker", "shit", "shitty", "bullshit", "bitch", "bastard",
+    "asshole", "damn", "dick", "cunt", "piss", "pissed", "crap", "bollocks", "wanker",
+};
+
+class ProfanityFilter : public TextFilter
+{
+public:
+    explicit ProfanityFilter(const std::vector<std::string>& words)
+    {
+        if (words.empty())
+        {
+            m_words.assign(std::begin(default_profanity), std::end(default_profanity));
+        }
+        else
+        {
+            m_words = words;
+        }
+    }
+    const char* name() const override { return "profanity"; }
+
+    void apply(std::string& text, double) const override
+    {
+        size_t i = 0;
+        size_t begin = 0;
+        size_t end = 0;
+        while (nextWord(text, i, begin, end))
+        {
+            for (const auto& word : m_words)
+            {
+                if (sameWords(text.data() + begin, end - begin, word.data(), word.size()))
+                {
+                    //the first letter is kept, so that the sentence stays readable
+                    bool first = true;
+                    for (size_t k = begin; k < end; k++)
+                    {
+                        if (std::isalnum(static_cast<unsigned char>(text[k])))
+                        {
+                            text[k] = first ? text[k] : '*';
+                            first = false;
+                        }
+                    }
+                    break;
+                }
+            }
+        }
+    }
+
+private:
+    std::vector<std::string> m_words;
+};
+}
+
+const char* TextPipeline::available()
+{
+    return "symbols hallucinations punctuation lowercase numbers profanity";
+}
+
+std::unique_ptr<TextFilter> TextPipeline::create(const std::string& name, const Config& cfg)
+{
+    if (name == "symbols") { return std::make_unique<SymbolsFilter>(); }
+    if (name == "hallucinations") { return std::make_unique<HallucinationFilter>(cfg.max_repeats, cfg.hallucination_score); }
+    if (name == "punctuation") { return std::make_unique<PunctuationFilter>(); }
+    if (name == "lowercase") { return std::make_unique<LowercaseFilter>(); }
+    if (name == "numbers") { return std::make_unique<NumbersFilter>(); }
+    if (name == "profanity") { return std::make_unique<ProfanityFilter>(cfg.profanity); }
+    return nullptr;
+}
+
+bool TextPipeline::configure(const Config& cfg, std::string& error)
+{
+    std::vector<std::unique_ptr<TextFilter>> filters;
+    for (const auto& name : cfg.filters)
+    {
+        auto filter = create(name, cfg);
+        if (!filter)
+        {
+            error = "unknown text filter '" + name + "', available: " + available();
+            return false;
+        }
+        filters.push_back(std::move(filter));
+    }
+    m_cfg = cfg;
+    m_filters = std::move(filters);
+    return true;
+}
+
+void TextPipeline::apply(std::string& text, double score) const
+{
+    for (const auto& filter : m_filters)
+    {
+        filter->apply(text, score);
+    }
+}
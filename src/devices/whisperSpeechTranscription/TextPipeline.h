@@ -0,0 +1,68 @@
+/*
+ * SPDX-FileCopyrightText: 2023-2023 Istituto Italiano di Tecnologia (IIT)
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef WHISPER_TEXTPIPELINE_H
+#define WHISPER_TEXTPIPELINE_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * \brief A post-processing step of the transcription.
+ * Filters edit the text in place in a single pass: the output never gets longer than the part of the input
+ * already read, so it is written over it and no memory is allocated (but when `punctuation` adds the missing spaces
+ * after punctuation marks). The leading space of the whisper text is kept. apply() can be called concurrently.
+ */
+class TextFilter
+{
+public:
+    virtual ~TextFilter() = default;
+    virtual const char* name() const = 0;
+    // score is the confidence of the transcription.
+    virtual void apply(std::string& text, double score) const = 0;
+};
+
+/**
+ * \brief Chain of TextFilter applied to every transcription, in the configured order.
+ * Available filters:
+ * - `symbols`: removes the non-speech annotations, e.g. `[BLANK_AUDIO]` (SymbolStripper)
+ * - `hallucinations`: keeps once a sequence of up to 8 words repeated more than `max_repeats` times in a row, and
+ *   drops a transcription made only of a phrase typical of silence or noise ("Thank you.", "Thanks for watching!")
+ *   when its score is below `hallucination_score`
+ * - `punctuation`: single spaces, no space before punctuation and one after it, capital letter at the beginning of
+ *   each sentence
+ * - `lowercase`: lower case without punctuation, e.g. for matching commands
+ * - `numbers`: English number words to digits ("twenty one" -> "21", "two thousand and five" -> "2005")
+ * - `profanity`: masks the profane words but their first letter ("d***")
+ */
+class TextPipeline
+{
+public:
+    struct Config
+    {
+        std::vector<std::string> filters = { "symbols" };
+        int                      max_repeats = 3;
+        double                   hallucination_score = 0.6;
+        std::vector<std::string> profanity;     // empty = built-in English list
+    };
+
+    // Builds the chain, false if a filter is unknown (error is set).
+    bool configure(const Config& cfg, std::string& error);
+    const Config& getConfig() const { return m_cfg; }
+    bool isEmpty() const { return m_filters.empty(); }
+
+    void apply(std::string& text, double score) const;
+
+    // Names of the available filters, separated by spaces.
+    static const char* available();
+    static std::unique_ptr<TextFilter> create(const std::string& name, const Config& cfg);
+
+private:
+    Config                                   m_cfg;
+    std::vector<std::unique_ptr<TextFilter>> m_filters;
+};
+
+#endif
@@ -0,0 +1,177 @@
+/*
+ * SPDX-FileCopyrightText: 2023-2023 Istituto Italiano di Tecnologia (IIT)
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "TranscriptionCache.h"
+
+#include <yarp/os/Bottle.h>
+#include <yarp/os/LogComponent.h>
+#include <yarp/os/LogStream.h>
+
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+namespace {
+YARP_LOG_COMPONENT(WHISPER_CACHE, "yarp.device.WhisperSpeechTranscription.cache")
+
+constexpr uint64_t mix_mul = 0x9E3779B97F4A7C15ull;
+
+uint64_t mix(uint64_t h, uint64_t w)
+{
+    h = (h ^ w) * mix_mul;
+    return h ^ (h >> 29);
+}
+}
+
+void TranscriptionCache::setCapacity(size_t entries)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_capacity = entries;
+    while (m_lru.size() > m_capacity)
+    {
+        m_index.erase(m_lru.back().key);
+        m_lru.pop_back();
+    }
+}
+
+uint64_t TranscriptionCache::hash(const void* data, size_t size, uint64_t seed)
+{
+    //one multiply per 8 bytes: the cost is negligible compared to the inference
+    const auto* bytes = static_cast<const unsigned char*>(data);
+    uint64_t h = mix(seed, size);
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        uint64_t w;
+        std::memcpy(&w, bytes + i, 8);
+        h = mix(h, w);
+    }
+    uint64_t tail = 0;
+    std::memcpy(&tail, bytes + i, size - i);
+    return mix(h, tail);
+}
+
+bool TranscriptionCache::lookup(uint64_t key, std::string& text, double& score)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_index.find(key);
+    if (it == m_index.end())
+    {
+        m_misses++;
+        return false;
+    }
+    m_lru.splice(m_lru.begin(), m_lru, it->second);
+    text = it->second->text;
+    score = it->second->score;
+    m_hits++;
+    return true;
+}
+
+void TranscriptionCache::store(uint64_t key, const std::string& text, double score)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    insertLocked(key, text, score);
+}
+
+void TranscriptionCache::insertLocked(uint64_t key, const std::string& text, double score)
+{
+    if (m_capacity == 0)
+    {
+        return;
+    }
+    auto it = m_index.find(key);
+    if (it != m_index.end())
+    {
+        it->second->text = text;
+        it->second->score = score;
+        m_lru.splice(m_lru.begin(), m_lru, it->second);
+        return;
+    }
+    m_lru.push_front(Entry{key, text, score});
+    m_index[key] = m_lru.begin();
+    if (m_lru.size() > m_capacity)
+    {
+        m_index.erase(m_lru.back().key);
+        m_lru.pop_back();
+    }
+}
+
+void TranscriptionCache::clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_lru.clear();
+    m_index.clear();
+}
+
+TranscriptionCache::Stats TranscriptionCache::getStats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Stats st;
+    st.size = m_lru.size();
+    st.capacity = m_capacity;
+    st.hits = m_hits;
+    st.misses = m_misses;
+    return st;
+}
+
+bool TranscriptionCache::load(const std::string& path)
+{
+    std::ifstream in(path);
+    if (!in.is_open())
+    {
+        yCInfo(WHISPER_CACHE) << "No cache file" << path << "- starting with an empty cache";
+        return false;
+    }
+
+    std::vector<std::string> lines;
+    std::string line;
+    while (std::getline(in, line))
+    {
+        lines.push_back(line);
+    }
+
+    //the file is written from the most to the least recently used entry
+    std::lock_guard<std::mutex> lock(m_mutex);
+    size_t loaded = 0;
+    for (auto it = lines.rbegin(); it != lines.rend(); ++it)
+    {
+        yarp::os::Bottle b;
+        b.fromString(*it);
+        if (b.size() != 3)
+        {
+            continue;
+        }
+        uint64_t key = 0;
+        std::istringstream(b.get(0).asString()) >> std::hex >> key;
+        insertLocked(key, b.get(2).asString(), b.get(1).asFloat64());
+        loaded++;
+    }
+    yCInfo(WHISPER_CACHE) << "Loaded" << loaded << "cached transcriptions from" << path;
+    return true;
+}
+
+bool TranscriptionCache::save(const std::string& path) const
+{
+    std::ofstream out(path, std::ios::trunc);
+    if (!out.is_open())
+    {
+        yCError(WHISPER_CACHE) << "Unable to write the cache file" << path;
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const auto& e : m_lru)
+    {
+        std::ostringstream key;
+        key << std::hex << e.key;
+        yarp::os::Bottle b;
+        b.addString(key.str());
+        b.addFloat64(e.score);
+        b.addString(e.text);
+        out << b.toString() << '\n';
+    }
+    yCInfo(WHISPER_CACHE) << "Saved" << m_lru.size() << "cached transcriptions to" << path;
+    return bool(out);
+}
@@ -0,0 +1,67 @@
+/*
+ * SPDX-FileCopyrightText: 2023-2023 Istituto Italiano di Tecnologia (IIT)
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef WHISPER_TRANSCRIPTIONCACHE_H
+#define WHISPER_TRANSCRIPTIONCACHE_H
+
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * \brief LRU cache of the transcriptions, keyed on the hash of the (resampled, mono) PCM sent to whisper and on a
+ * seed describing the model, the language and the decoding parameters.
+ * The hash is exact: it matches replays of the same recording, not new recordings of the same phrase.
+ * The cache can be saved to and restored from a text file, one Bottle per entry.
+ */
+class TranscriptionCache
+{
+public:
+    struct Stats
+    {
+        size_t   size = 0;
+        size_t   capacity = 0;
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+    };
+
+    // 0 disables the cache.
+    void setCapacity(size_t entries);
+    bool isEnabled() const { return m_capacity > 0; }
+
+    static uint64_t hash(const void* data, size_t size, uint64_t seed = 0);
+    static uint64_t hash(const std::string& str, uint64_t seed = 0) { return hash(str.data(), str.size(), seed); }
+    static uint64_t key(const std::vector<float>& pcm, uint64_t seed) { return hash(pcm.data(), pcm.size() * sizeof(float), seed); }
+
+    bool lookup(uint64_t key, std::string& text, double& score);
+    void store(uint64_t key, const std::string& text, double score);
+    void clear();
+    Stats getStats() const;
+
+    bool load(const std::string& path);
+    bool save(const std::string& path) const;
+
+private:
+    struct Entry
+    {
+        uint64_t    key;
+        std::string text;
+        double      score;
+    };
+
+    void insertLocked(uint64_t key, const std::string& text, double score);
+
+    mutable std::mutex                                        m_mutex;
+    size_t                                                    m_capacity = 0;
+    std::list<Entry>                                          m_lru;      // most recently used first
+    std::unordered_map<uint64_t, std::list<Entry>::iterator>  m_index;
+    uint64_t                                                  m_hits = 0;
+    uint64_t                                                  m_misses = 0;
+};
+
+#endif
@@ -0,0 +1,208 @@
+/*
+ * SPDX-FileCopyrightText: 2023-2023 Istituto Italiano di Tecnologia (IIT)
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "TranscriptionQueue.h"
+
+#include <yarp/os/LogComponent.h>
+#include <yarp/os/LogStream.h>
+
+#include <algorithm>
+
+namespace {
+YARP_LOG_COMPONENT(WHISPER_QUEUE, "yarp.device.WhisperSpeechTranscription.queue")
+
+double secondsSince(std::chrono::steady_clock::time_point t)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t).count();
+}
+}
+
+TranscriptionQueue::~TranscriptionQueue()
+{
+    stop();
+}
+
+bool TranscriptionQueue::parsePolicy(const std::string& str, Policy& policy)
+{
+    if      (str == "reject")      { policy = Policy::reject; }
+    else if (str == "drop_oldest") { policy = Policy::drop_oldest; }
+    else { return false; }
+    return true;
+}
+
+bool TranscriptionQueue::start(const Config& cfg, ProcessFn process)
+{
+    stop();
+    if (cfg.depth == 0 || cfg.workers == 0 || !process)
+    {
+        return false;
+    }
+
+    m_cfg = cfg;
+    m_process = std::move(process);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = false;
+        m_stats = Stats();
+    }
+    for (size_t i = 0; i < m_cfg.workers; i++)
+    {
+        m_workers.emplace_back(&TranscriptionQueue::workerLoop, this);
+    }
+    yCInfo(WHISPER_QUEUE) << "Request queue started: depth" << m_cfg.depth << "workers" << m_cfg.workers;
+    return true;
+}
+
+void TranscriptionQueue::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_cv.notify_all();
+    for (auto& w : m_workers)
+    {
+        w.join();
+    }
+    m_workers.clear();
+
+    // the callers of the jobs still in the queue must not wait forever
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto* job : m_queue)
+    {
+        resolve(*job, TranscriptionJob::Status::failed);
+    }
+    m_queue.clear();
+}
+
+void TranscriptionQueue::resolve(TranscriptionJob& job, TranscriptionJob::Status status)
+{
+    job.status = status;
+    job.resolved.set_value();
+}
+
+bool TranscriptionQueue::isBatchable(const TranscriptionJob& job) const
+{
+    return job.duration_s <= m_cfg.batch_max_utterance_s;
+}
+
+void TranscriptionQueue::submitAndWait(TranscriptionJob& job)
+{
+    std::future<void> done = job.resolved.get_future();
+    job.enqueued = std::chrono::steady_clock::now();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_stopping || m_workers.empty())
+        {
+            resolve(job, TranscriptionJob::Status::failed);
+            return;
+        }
+        if (m_queue.size() >= m_cfg.depth)
+        {
+            if (m_cfg.policy == Policy::reject)
+            {
+                m_stats.rejected++;
+                resolve(job, TranscriptionJob::Status::rejected);
+                return;
+            }
+            m_stats.dropped++;
+            resolve(*m_queue.front(), TranscriptionJob::Status::dropped);
+            m_queue.pop_front();
+        }
+        m_queue.push_back(&job);
+        m_stats.accepted++;
+        m_stats.depth = m_queue.size();
+        m_stats.max_depth = std::max(m_stats.max_depth, m_stats.depth);
+    }
+    // a worker collecting a batch may be waiting for this job as well
+    m_cv.notify_all();
+    done.wait();
+}
+
+TranscriptionQueue::Stats TranscriptionQueue::getStats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+void TranscriptionQueue::workerLoop()
+{
+    std::vector<TranscriptionJob*> batch;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto expired = [this](const TranscriptionJob* job) {
+        return m_cfg.max_wait_s > 0 && secondsSince(job->enqueued) > m_cfg.max_wait_s;
+    };
+
+    while (true)
+    {
+        m_cv.wait(lock, [this] { return m_stopping || !m_queue.empty(); });
+        if (m_stopping)
+        {
+            break;
+        }
+
+        batch.clear();
+        TranscriptionJob* first = m_queue.front();
+        m_queue.pop_front();
+        if (expired(first))
+        {
+            m_stats.expired++;
+            resolve(*first, TranscriptionJob::Status::expired);
+            m_stats.depth = m_queue.size();
+            continue;
+        }
+        batch.push_back(first);
+
+        // collect the short utterances arriving within the batching window
+        if (m_cfg.batch_window_s > 0 && isBatchable(*first))
+        {
+            double total_s = first->duration_s;
+            auto deadline = first->enqueued + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                                  std::chrono::duration<double>(m_cfg.batch_window_s));
+            while (true)
+            {
+                while (!m_queue.empty() &&
+                       isBatchable(*m_queue.front()) &&
+                       total_s + m_queue.front()->duration_s <= m_cfg.batch_max_total_s)
+                {
+                    total_s += m_queue.front()->duration_s;
+                    batch.push_back(m_queue.front());
+                    m_queue.pop_front();
+                }
+                // stop at the first job that cannot join the batch, or when the window is over
+                if (m_stopping || !m_queue.empty() ||
+                    std::chrono::steady_clock::now() >= deadline ||
+                    m_cv.wait_until(lock, deadline) == std::cv_status::timeout)
+                {
+                    break;
+                }
+            }
+        }
+
+        m_stats.depth = m_queue.size();
+        for (auto* job : batch)
+        {
+            double wait = secondsSince(job->enqueued);
+            m_stats.last_wait_s = wait;
+            m_stats.max_wait_s = std::max(m_stats.max_wait_s, wait);
+            m_stats.avg_wait_s += (wait - m_stats.avg_wait_s) / double(m_stats.processed + 1);
+            m_stats.processed++;
+        }
+        if (batch.size() > 1)
+        {
+            m_stats.batches++;
+            m_stats.batched_jobs += batch.size();
+        }
+
+        lock.unlock();
+        m_process(batch);
+        lock.lock();
+
+        for (auto* job : batch)
+        {
+            resolve(*job, job->status == TranscriptionJob::Status::pending ? TranscriptionJob::Status::failed : job->status);
+        }
+    }
+}
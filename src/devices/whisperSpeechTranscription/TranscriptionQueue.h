@@ -0,0 +1,127 @@
+/*
+ * SPDX-FileCopyrightText: 2023-2023 Istituto Italiano di Tecnologia (IIT)
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef WHISPER_TRANSCRIPTIONQUEUE_H
+#define WHISPER_TRANSCRIPTIONQUEUE_H
+
+#include <yarp/sig/Sound.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * \brief A transcription request waiting in the TranscriptionQueue.
+ * The submitting thread blocks until the job is resolved, so the job can safely refer to the caller's Sound.
+ */
+struct TranscriptionJob
+{
+    enum class Status
+    {
+        pending,
+        done,
+        failed,
+        rejected,       // the queue was full
+        dropped,        // removed from the queue to make room for a newer request
+        expired         // waited in the queue longer than max_wait
+    };
+
+    const yarp::sig::Sound*               sound = nullptr;
+    double                                duration_s = 0;
+    std::chrono::steady_clock::time_point enqueued;
+
+    Status                                status = Status::pending;
+    std::string                           text;
+    double                                score = 0;
+
+    std::promise<void>                    resolved;
+};
+
+/**
+ * \brief Bounded job queue served by a set of worker threads.
+ * When the queue is full, new requests are either rejected or the oldest waiting request is dropped.
+ * Requests waiting longer than `max_wait_s` are expired instead of being processed.
+ * If `batch_window_s` is greater than zero, utterances shorter than `batch_max_utterance_s` that arrive within
+ * the window are handed together to the process function, which transcribes them in a single inference pass.
+ */
+class TranscriptionQueue
+{
+public:
+    enum class Policy
+    {
+        reject,
+        drop_oldest
+    };
+
+    struct Config
+    {
+        size_t depth = 8;
+        Policy policy = Policy::reject;
+        size_t workers = 1;
+        double max_wait_s = 0;              // 0 = no limit
+        double batch_window_s = 0;          // 0 = batching disabled
+        double batch_max_utterance_s = 3.0;
+        double batch_max_total_s = 20.0;    // must fit in one whisper window (30s) with the gaps between utterances
+    };
+
+    struct Stats
+    {
+        size_t   depth = 0;
+        size_t   max_depth = 0;
+        uint64_t accepted = 0;
+        uint64_t processed = 0;         // jobs handed to the process function
+        uint64_t rejected = 0;
+        uint64_t dropped = 0;
+        uint64_t expired = 0;
+        uint64_t batches = 0;
+        uint64_t batched_jobs = 0;
+        double   last_wait_s = 0;
+        double   avg_wait_s = 0;
+        double   max_wait_s = 0;
+    };
+
+    // Processes a batch of one or more jobs, setting their status and results.
+    using ProcessFn = std::function<void(std::vector<TranscriptionJob*>& batch)>;
+
+    TranscriptionQueue() = default;
+    ~TranscriptionQueue();
+    TranscriptionQueue(const TranscriptionQueue&) = delete;
+    TranscriptionQueue& operator=(const TranscriptionQueue&) = delete;
+
+    static bool parsePolicy(const std::string& str, Policy& policy);
+
+    bool start(const Config& cfg, ProcessFn process);
+    void stop();
+    bool isRunning() const { return !m_workers.empty(); }
+
+    // Enqueues the job and blocks until it is resolved.
+    void submitAndWait(TranscriptionJob& job);
+
+    Stats getStats() const;
+
+private:
+    void workerLoop();
+    bool isBatchable(const TranscriptionJob& job) const;
+    void resolve(TranscriptionJob& job, TranscriptionJob::Status status);
+
+    Config                         m_cfg;
+    ProcessFn                      m_process;
+    std::vector<std::thread>       m_workers;
+    bool                           m_stopping = false;
+
+    mutable std::mutex             m_mutex;
+    std::condition_variable        m_cv;
+    std::deque<TranscriptionJob*>  m_queue;
+    Stats                          m_stats;
+};
+
+#endif
@@ -0,0 +1,87 @@
+/*
+ * SPDX-FileCopyrightText: 2023-2023 Istituto Italiano di Tecnologia (IIT)
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef WHISPER_TRANSCRIPTIONRESULT_H
+#define WHISPER_TRANSCRIPTIONRESULT_H
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+/**
+ * \brief A word of a segment, made of one or more text tokens. Times are in seconds, -1 if not available.
+ */
+struct WordResult
+{
+    std::string text;
+    double      t0 = -1;
+    double      t1 = -1;
+    double      confidence = 0;     // mean probability of the tokens of the word
+};
+
+/**
+ * \brief A text token of a segment. Times are in seconds, -1 if not available.
+ */
+struct TokenResult
+{
+    int    id = 0;
+    float  p = 0;
+    double t0 = -1;
+    double t1 = -1;
+};
+
+/**
+ * \brief A segment of a transcription, with the figures used to compute its confidence.
+ */
+struct SegmentResult
+{
+    std::string             text;
+    double                  t0 = 0;
+    double                  t1 = 0;
+    double                  sum_logprob = 0;    // over the text tokens (special tokens excluded)
+    int                     n_tokens = 0;
+    double                  no_speech_prob = 0;
+    int                     speaker = -1;           // loudest channel (diarize), -1 if unknown
+    bool                    speaker_turn = false;   // tinydiarize: the speaker changes after this segment
+    std::vector<WordResult> words;
+    std::vector<TokenResult> tokens;
+
+    double avgLogprob() const { return n_tokens > 0 ? sum_logprob / n_tokens : 0; }
+    double confidence() const { return n_tokens > 0 ? std::exp(avgLogprob()) * (1.0 - no_speech_prob) : 0; }
+};
+
+/**
+ * \brief Aggregates segments into the score of a transcription: the geometric mean of the token probabilities,
+ * weighted by the probability that the audio contains speech.
+ */
+struct ConfidenceAccumulator
+{
+    double sum_logprob = 0;
+    double sum_no_speech = 0;       // weighted by the number of tokens of each segment
+    int    n_tokens = 0;
+
+    void add(const SegmentResult& seg)
+    {
+        sum_logprob += seg.sum_logprob;
+        sum_no_speech += seg.no_speech_prob * seg.n_tokens;
+        n_tokens += seg.n_tokens;
+    }
+    double score() const
+    {
+        return n_tokens > 0 ? std::exp(sum_logprob / n_tokens) * (1.0 - sum_no_speech / n_tokens) : 0;
+    }
+};
+
+/**
+ * \brief Detailed result of a request, returned by the rpc command `last_result`.
+ */
+struct TranscriptionResult
+{
+    std::string                text;
+    double                     score = 0;
+    std::vector<SegmentResult> segments;
+};
+
+#endif
@@ -0,0 +1,81 @@
+/*
+ * SPDX-FileCopyrightText: 2023-2023 Istituto Italiano di Tecnologia (IIT)
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "VoiceActivityDetector.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "whisper.h"
+
+namespace {
+constexpr size_t samples_per_ms = WHISPER_SAMPLE_RATE / 1000;
+}
+
+bool VoiceActivityDetector::detect(const float* pcm, size_t n, size_t& begin, size_t& end) const
+{
+    const size_t frame = std::max<size_t>(1, m_cfg.frame_ms * samples_per_ms);
+    const size_t n_frames = n / frame;
+    const size_t min_speech_frames = std::max<size_t>(1, m_cfg.min_speech_ms / std::max<size_t>(1, m_cfg.frame_ms));
+    // compare squared quantities, to avoid a sqrt and a log per frame
+    const float energy_thold = std::pow(10.0f, m_cfg.energy_thold_db / 10.0f);
+
+    size_t first = n_frames;
+    size_t last = 0;
+    size_t speech_frames = 0;
+    for (size_t f = 0; f < n_frames; f++)
+    {
+        const float* x = pcm + f * frame;
+        float energy = 0;
+        size_t crossings = 0;
+        for (size_t i = 0; i < frame; i++)
+        {
+            energy += x[i] * x[i];
+            crossings += (i > 0) && ((x[i] >= 0.0f) != (x[i - 1] >= 0.0f));
+        }
+        energy /= float(frame);
+        const float zcr = float(crossings) / float(frame);
+
+        if (energy > energy_thold && zcr < m_cfg.zcr_thold)
+        {
+            speech_frames++;
+            first = std::min(first, f);
+            last = f;
+        }
+    }
+
+    if (speech_frames < min_speech_frames)
+    {
+        return false;
+    }
+
+    const size_t padding = m_cfg.padding_ms * samples_per_ms;
+    begin = first * frame > padding ? first * frame - padding : 0;
+    end = std::min(n, (last + 1) * frame + padding);
+    return true;
+}
+
+bool VoiceActivityDetector::containsSpeech(const std::vector<float>& pcm) const
+{
+    size_t begin = 0;
+    size_t end = 0;
+    return detect(pcm.data(), pcm.size(), begin, end);
+}
+
+bool VoiceActivityDetector::trim(std::vector<float>& pcm) const
+{
+    size_t begin = 0;
+    size_t end = 0;
+    if (!detect(pcm.data(), pcm.size(), begin, end))
+    {
+        return false;
+    }
+    if (begin > 0)
+    {
+        std::copy(pcm.begin() + begin, pcm.begin() + end, pcm.begin());
+    }
+    pcm.resize(end - begin);
+    return true;
+}
@@ -0,0 +1,48 @@
+/*
+ * SPDX-FileCopyrightText: 2023-2023 Istituto Italiano di Tecnologia (IIT)
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef WHISPER_VOICEACTIVITYDETECTOR_H
+#define WHISPER_VOICEACTIVITYDETECTOR_H
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * \brief Frame-based voice activity detector working on mono F32 PCM at WHISPER_SAMPLE_RATE.
+ * A frame is classified as speech when its RMS energy is above `energy_thold_db` (dBFS) and its
+ * zero-crossing rate is below `zcr_thold` (broadband noise such as fans or hiss has a very high ZCR).
+ * The buffer contains speech if at least `min_speech_ms` of speech frames are found.
+ */
+class VoiceActivityDetector
+{
+public:
+    struct Config
+    {
+        size_t frame_ms = 20;
+        float  energy_thold_db = -45.0f;
+        float  zcr_thold = 0.35f;          // crossings per sample
+        size_t min_speech_ms = 100;
+        size_t padding_ms = 200;           // silence kept before and after the detected speech
+    };
+
+    void setConfig(const Config& cfg) { m_cfg = cfg; }
+    const Config& getConfig() const { return m_cfg; }
+
+    // Returns true if the buffer contains speech. In that case [begin, end) is the range of samples
+    // to be transcribed, i.e. the detected speech plus the configured padding.
+    bool detect(const float* pcm, size_t n, size_t& begin, size_t& end) const;
+
+    // Returns true if the buffer contains speech.
+    bool containsSpeech(const std::vector<float>& pcm) const;
+
+    // Detects speech in pcm and trims the leading and trailing silence in place.
+    // Returns false, leaving pcm untouched, if no speech was found.
+    bool trim(std::vector<float>& pcm) const;
+
+private:
+    Config m_cfg;
+};
+
+#endif
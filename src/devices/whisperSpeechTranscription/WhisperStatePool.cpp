@@ -0,0 +1,93 @@
+/*
+ * SPDX-FileCopyrightText: 2023-2023 Istituto Italiano di Tecnologia (IIT)
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "WhisperStatePool.h"
+
+#include <yarp/os/LogComponent.h>
+#include <yarp/os/LogStream.h>
+
+namespace {
+YARP_LOG_COMPONENT(WHISPER_POOL, "yarp.device.WhisperSpeechTranscription.pool")
+}
+
+WhisperStatePool::~WhisperStatePool()
+{
+    clear();
+}
+
+bool WhisperStatePool::init(whisper_context* ctx, size_t n, const AudioFrontEnd& frontEnd)
+{
+    clear();
+    if (ctx == nullptr || n == 0)
+    {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (size_t i = 0; i < n; i++)
+    {
+        auto slot = std::make_unique<WhisperSlot>();
+        slot->ctx = ctx;
+        slot->state = whisper_init_state(ctx);
+        if (slot->state == nullptr)
+        {
+            yCError(WHISPER_POOL) << "Failed to allocate whisper state" << i;
+            for (auto& s : m_slots) { whisper_free_state(s->state); }
+            m_slots.clear();
+            m_free.clear();
+            return false;
+        }
+        slot->frontEnd = frontEnd;
+        m_free.push_back(slot.get());
+        m_slots.push_back(std::move(slot));
+    }
+    yCInfo(WHISPER_POOL) << "Allocated" << n << "whisper states";
+    return true;
+}
+
+void WhisperStatePool::clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_free.size() != m_slots.size())
+    {
+        yCError(WHISPER_POOL) << "Releasing the pool while" << m_slots.size() - m_free.size() << "states are still in use";
+    }
+    for (auto& slot : m_slots)
+    {
+        whisper_free_state(slot->state);
+    }
+    m_slots.clear();
+    m_free.clear();
+}
+
+WhisperStatePool::Lease WhisperStatePool::acquire()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cv.wait(lock, [this] { return !m_free.empty(); });
+    WhisperSlot* slot = m_free.back();
+    m_free.pop_back();
+    return Lease(this, slot);
+}
+
+WhisperStatePool::Lease WhisperStatePool::tryAcquire()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_free.empty())
+    {
+        return Lease(this, nullptr);
+    }
+    WhisperSlot* slot = m_free.back();
+    m_free.pop_back();
+    return Lease(this, slot);
+}
+
+void WhisperStatePool::release(WhisperSlot* slot)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_free.push_back(slot);
+    }
+    m_cv.notify_one();
+}
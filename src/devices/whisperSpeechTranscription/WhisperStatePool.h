@@ -0,0 +1,92 @@
+/*
+ * SPDX-FileCopyrightText: 2023-2023 Istituto Italiano di Tecnologia (IIT)
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef WHISPER_STATEPOOL_H
+#define WHISPER_STATEPOOL_H
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "whisper.h"
+#include "AudioFrontEnd.h"
+#include "InferenceStats.h"
+#include "TranscriptionResult.h"
+
+/**
+ * \brief An inference slot: a whisper_state plus the scratch buffers needed by one request.
+ * A slot is used by one request at a time, so nothing inside it needs locking.
+ */
+struct WhisperSlot
+{
+    whisper_context*                ctx = nullptr;          // model of the pool, shared by all its slots
+    whisper_state*                  state = nullptr;
+    AudioFrontEnd                   frontEnd;
+    std::vector<float>              pcmf32;                 // mono-channel F32 PCM
+    std::vector<std::vector<float>> pcmf32s;                // stereo-channel F32 PCM
+    std::vector<float>              scratch;                // per-utterance buffer used when batching
+    std::vector<SegmentResult>      segments;               // segments of the last inference pass
+    std::string                     context;                // conversation history used as prompt
+    std::vector<whisper_token>      prompt;                 // tokens of the initial prompt and of the history
+    std::vector<float>              lang_probs;             // probabilities of the language detection
+    InferenceStats                  stats;                  // figures of the request being processed
+    bool                            details = false;        // words and tokens are collected for the request being processed
+    std::chrono::steady_clock::time_point deadline;         // the inference is aborted after it, if set
+    StageTimer                      timer;
+};
+
+/**
+ * \brief Fixed-size pool of whisper_state objects sharing the weights of a single whisper_context.
+ * acquire() blocks until a slot is free, tryAcquire() returns an empty Lease if none is; the slot is returned to the pool when the Lease goes out of scope.
+ */
+class WhisperStatePool
+{
+public:
+    class Lease
+    {
+    public:
+        Lease(WhisperStatePool* pool, WhisperSlot* slot) : m_pool(pool), m_slot(slot) {}
+        Lease(Lease&& other) noexcept : m_pool(other.m_pool), m_slot(other.m_slot) { other.m_slot = nullptr; }
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+        Lease& operator=(Lease&&) = delete;
+        ~Lease() { if (m_slot) { m_pool->release(m_slot); } }
+
+        explicit operator bool() const { return m_slot != nullptr; }
+        WhisperSlot& operator*() const { return *m_slot; }
+        WhisperSlot* operator->() const { return m_slot; }
+
+    private:
+        WhisperStatePool* m_pool;
+        WhisperSlot*      m_slot;
+    };
+
+    WhisperStatePool() = default;
+    ~WhisperStatePool();
+    WhisperStatePool(const WhisperStatePool&) = delete;
+    WhisperStatePool& operator=(const WhisperStatePool&) = delete;
+
+    // Allocates n states for ctx. Every slot gets a copy of frontEnd.
+    bool init(whisper_context* ctx, size_t n, const AudioFrontEnd& frontEnd);
+    // Frees all the states. No Lease must be alive.
+    void clear();
+
+    Lease  acquire();
+    Lease  tryAcquire();
+    size_t size() const { return m_slots.size(); }
+
+private:
+    void release(WhisperSlot* slot);
+
+    std::mutex                                m_mutex;
+    std::condition_variable                   m_cv;
+    std::vector<std::unique_ptr<WhisperSlot>> m_slots;
+    std::vector<WhisperSlot*>                 m_free;
+};
+
+#endif
@@ -0,0 +1,317 @@
+/*
+ * SPDX-FileCopyrightText: 2023-2023 Istituto Italiano di Tecnologia (IIT)
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/*
+ * Benchmark of the whisperSpeechTranscription device.
+ * For every combination of threads and beam size the device is opened (CPU only), then it is fed with the
+ * test audio looped/truncated to each requested duration, resampled to each requested rate and replicated
+ * on each requested number of channels. Timings are read back from the rpc port of the device (last_stats).
+ * The results are written as JSON. peak_rss_mb_cumulative is the peak memory of the whole process since its start,
+ * so it never decreases along the sweep: run a single configuration per process to measure the peak of each one.
+ * The processors parameter is not swept, it only affects the long-form mode.
+ *
+ * Usage:
+ *   whisperSpeechTranscription_benchmark --model ggml-tiny.en.bin [--audio audio_in.wav]
+ *       [--durations "(5 15 30)"] [--rates "(16000 48000)"] [--channels "(1 2)"]
+ *       [--threads "(1 4)"] [--beam_size "(1 5)"] [--repetitions 3] [--output bench.json]
+ * The plugin is searched in YARP_DATA_DIRS, e.g. <build>/share/yarp when running from the build tree.
+ */
+
+#include <yarp/dev/ISpeechTranscription.h>
+#include <yarp/dev/PolyDriver.h>
+#include <yarp/os/Bottle.h>
+#include <yarp/os/LogStream.h>
+#include <yarp/os/Network.h>
+#include <yarp/os/Port.h>
+#include <yarp/os/Property.h>
+#include <yarp/os/ResourceFinder.h>
+#include <yarp/sig/Sound.h>
+#include <yarp/sig/SoundFile.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#  include <windows.h>
+#  include <psapi.h>
+#else
+#  include <sys/resource.h>
+#endif
+
+using namespace yarp::os;
+using namespace yarp::dev;
+
+namespace {
+
+const std::string bench_prefix = "/whisperBenchmark";
+
+// Peak resident memory of the process since its start
+double peakRssMb()
+{
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+    {
+        return double(pmc.PeakWorkingSetSize) / (1024.0 * 1024.0);
+    }
+    return 0;
+#else
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#  if defined(__APPLE__)
+    return double(usage.ru_maxrss) / (1024.0 * 1024.0);   // bytes
+#  else
+    return double(usage.ru_maxrss) / 1024.0;              // kilobytes
+#  endif
+#endif
+}
+
+std::vector<int> readList(ResourceFinder& rf, const std::string& key, const std::vector<int>& fallback)
+{
+    if (!rf.check(key))
+    {
+        return fallback;
+    }
+    std::vector<int> values;
+    const Value& v = rf.find(key);
+    if (v.isList())
+    {
+        Bottle* b = v.asList();
+        for (size_t i = 0; i < b->size(); i++)
+        {
+            values.push_back(b->get(i).asInt32());
+        }
+    }
+    else
+    {
+        values.push_back(v.asInt32());
+    }
+    return values;
+}
+
+std::string jsonEscape(const std::string& str)
+{
+    std::string out;
+    for (char c : str)
+    {
+        if (c == '"' || c == '\\')
+        {
+            out += '\\';
+            out += c;
+        }
+        else if (c == '\n')
+        {
+            out += "\\n";
+        }
+        else
+        {
+            out += c;
+        }
+    }
+    return out;
+}
+
+// Loops/truncates the (mono) source to the requested duration, then resamples it linearly and replicates the channels.
+yarp::sig::Sound makeSound(const yarp::sig::Sound& src, double duration_s, int rate, int channels)
+{
+    const size_t src_samples = src.getSamples();
+    const double src_rate = src.getFrequency() > 0 ? src.getFrequency() : 16000;
+    const size_t n = size_t(duration_s * rate);
+
+    yarp::sig::Sound snd;
+    snd.resize(n, channels);
+    snd.setFrequency(rate);
+    for (size_t i = 0; i < n; i++)
+    {
+        double pos = std::fmod(double(i) * src_rate / rate, double(src_samples));
+        size_t i0 = size_t(pos);
+        size_t i1 = (i0 + 1) % src_samples;
+        double frac = pos - double(i0);
+        auto value = static_cast<yarp::sig::Sound::audio_sample>((1.0 - frac) * src.get(i0, 0) + frac * src.get(i1, 0));
+        for (int c = 0; c < channels; c++)
+        {
+            snd.set(value, i, c);
+        }
+    }
+    return snd;
+}
+
+std::map<std::string, double> lastStats(Port& rpc)
+{
+    std::map<std::string, double> stats;
+    Bottle cmd;
+    Bottle reply;
+    cmd.addString("last_stats");
+    if (!rpc.write(cmd, reply))
+    {
+        return stats;
+    }
+    for (size_t i = 0; i < reply.size(); i++)
+    {
+        Bottle* pair = reply.get(i).asList();
+        if (pair && pair->size() == 2)
+        {
+            stats[pair->get(0).asString()] = pair->get(1).asFloat64();
+        }
+    }
+    return stats;
+}
+
+double median(std::vector<double> v)
+{
+    if (v.empty())
+    {
+        return 0;
+    }
+    std::sort(v.begin(), v.end());
+    return v[v.size() / 2];
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    Network yarp;
+    Network::setLocalMode(true);
+
+    ResourceFinder rf;
+    rf.setDefaultContext("whisperTranscribe_demo");
+    rf.configure(argc, argv);
+
+    std::string model = rf.check("model") ? rf.findFile(rf.find("model").asString()) : rf.findFile("ggml-tiny.en.bin");
+    if (model.empty())
+    {
+        model = rf.findFile("ggml-base.en.bin");
+    }
+    std::string audio = rf.findFile(rf.check("audio") ? rf.find("audio").asString() : "audio_in.wav");
+    if (model.empty() || audio.empty())
+    {
+        yError() << "Unable to find the model or the audio file";
+        return 1;
+    }
+
+    yarp::sig::Sound source;
+    if (!yarp::sig::file::read(source, audio.c_str()) || source.getSamples() == 0)
+    {
+        yError() << "Unable to read" << audio;
+        return 1;
+    }
+
+    const std::vector<int> durations = readList(rf, "durations", {5, 15, 30});
+    const std::vector<int> rates = readList(rf, "rates", {16000, 48000});
+    const std::vector<int> channels = readList(rf, "channels", {1, 2});
+    const std::vector<int> threads = readList(rf, "threads", {1, int(std::max(1u, std::thread::hardware_concurrency() / 2))});
+    const std::vector<int> beams = readList(rf, "beam_size", {1, 5});
+    const int repetitions = rf.check("repetitions") ? std::max(1, rf.find("repetitions").asInt32()) : 3;
+
+    std::ostringstream json;
+    json << "{\n  \"model\": \"" << jsonEscape(model) << "\",\n"
+         << "  \"audio\": \"" << jsonEscape(audio) << "\",\n"
+         << "  \"hardware_concurrency\": " << std::thread::hardware_concurrency() << ",\n"
+         << "  \"repetitions\": " << repetitions << ",\n"
+         << "  \"results\": [";
+    bool first_result = true;
+
+    for (int n_threads : threads)
+    {
+        for (int beam : beams)
+        {
+            PolyDriver dd;
+            Property cfg;
+            cfg.put("device", "whisperSpeechTranscription");
+            cfg.put("model", model);
+            cfg.put("name", bench_prefix);
+            cfg.put("threads", n_threads);
+            cfg.put("beam_size", beam);
+            cfg.put("use_gpu", false);
+            if (!dd.open(cfg))
+            {
+                yError() << "Unable to open the device with threads" << n_threads << "beam_size" << beam;
+                return 1;
+            }
+            ISpeechTranscription* istr = nullptr;
+            dd.view(istr);
+
+            Port rpc;
+            rpc.open(bench_prefix + "/bench:rpc");
+            Network::connect(rpc.getName(), bench_prefix + "/rpc");
+
+            //first-touch costs are not part of the measurements
+            {
+                std::string text;
+                double score;
+                istr->transcribe(makeSound(source, 2.0, 16000, 1), text, score);
+            }
+
+            for (int duration : durations)
+            {
+                for (int rate : rates)
+                {
+                    for (int ch : channels)
+                    {
+                        yarp::sig::Sound snd = makeSound(source, duration, rate, ch);
+                        std::vector<double> wall;
+                        std::map<std::string, double> sum;
+                        for (int r = 0; r < repetitions; r++)
+                        {
+                            std::string text;
+                            double score;
+                            auto t0 = std::chrono::steady_clock::now();
+                            istr->transcribe(snd, text, score);
+                            wall.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count());
+                            for (const auto& kv : lastStats(rpc))
+                            {
+                                sum[kv.first] += kv.second / repetitions;
+                            }
+                        }
+
+                        double wall_ms = median(wall);
+                        json << (first_result ? "\n" : ",\n") << "    {"
+                             << "\"duration_s\": " << duration << ", "
+                             << "\"rate\": " << rate << ", "
+                             << "\"channels\": " << ch << ", "
+                             << "\"threads\": " << n_threads << ", "
+                             << "\"beam_size\": " << beam << ", "
+                             << "\"wall_ms\": " << wall_ms << ", "
+                             << "\"conversion_ms\": " << sum["conversion_ms"] << ", "
+                             << "\"encode_ms\": " << sum["encode_ms"] << ", "
+                             << "\"decode_ms\": " << sum["decode_ms"] << ", "
+                             << "\"postprocess_ms\": " << sum["postprocess_ms"] << ", "
+                             << "\"rtf\": " << wall_ms / 1000.0 / duration << ", "
+                             << "\"tokens\": " << sum["tokens"] << ", "
+                             << "\"tokens_per_s\": " << sum["tokens_per_s"] << ", "
+                             << "\"peak_rss_mb_cumulative\": " << peakRssMb() << "}";
+                        first_result = false;
+                        yInfo() << "threads" << n_threads << "beam" << beam << "duration" << duration
+                                << "rate" << rate << "channels" << ch << "->" << wall_ms << "ms";
+                    }
+                }
+            }
+
+            rpc.close();
+            dd.close();
+        }
+    }
+    json << "\n  ]\n}\n";
+
+    if (rf.check("output"))
+    {
+        std::ofstream out(rf.find("output").asString());
+        out << json.str();
+    }
+    else
+    {
+        std::cout << json.str();
+    }
+    return 0;
+}
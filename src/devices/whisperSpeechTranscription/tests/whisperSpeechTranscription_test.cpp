@@ -4,9 +4,14 @@
  */
 
 #include <yarp/dev/ISpeechTranscription.h>
+#include <yarp/os/Bottle.h>
+#include <yarp/os/BufferedPort.h>
 #include <yarp/os/Network.h>
+#include <yarp/os/Port.h>
 #include <yarp/os/LogStream.h>
 #include <yarp/os/ResourceFinder.h>
+#include <yarp/os/Time.h>
+#include <yarp/os/Vocab.h>
 #include <yarp/dev/PolyDriver.h>
 #include <yarp/dev/WrapperSingle.h>
 
@@ -16,9 +21,104 @@
 #include <catch2/catch_amalgamated.hpp>
 #include <harness.h>
 
+#include "../DecodingPolicy.h"
+#include "../LanguagePinner.h"
+#include "../SharedAudioRing.h"
+#include "../StreamingTranscriber.h"
+#include "../TextPipeline.h"
+#include "../TranscriptionQueue.h"
+#include "../VoiceActivityDetector.h"
+#include "../whisperSpeechTranscription.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
 using namespace yarp::dev;
 using namespace yarp::os;
 
+// heap allocations made by the test thread while counting is enabled
+namespace {
+thread_local bool count_allocations = false;
+thread_local size_t allocations = 0;
+thread_local bool counting_paused = false;
+
+}
+
+void* operator new(std::size_t size)
+{
+    if (count_allocations) { allocations++; }
+    if (void* p = std::malloc(size == 0 ? 1 : size)) { return p; }
+    throw std::bad_alloc();
+}
+void* operator new[](std::size_t size) { return operator new(size); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+
+namespace {
+const char* const test_transcript = " And so my fellow Americans, ask not what your country can do for you, ask what you can do for your country.";
+
+// Recording of test_transcript
+yarp::sig::Sound testSound()
+{
+    yarp::os::ResourceFinder rf;
+    rf.setDefaultContext("whisperTranscribe_demo");
+    std::string path = rf.findFile("audio_in.wav");
+    CHECK(!path.empty());
+    yarp::sig::Sound snd;
+    yarp::sig::file::read(snd, path.c_str());
+    return snd;
+}
+
+std::string testModel()
+{
+    yarp::os::ResourceFinder rf;
+    rf.setDefaultContext("whisperTranscribe_demo");
+    std::string path = rf.findFile("ggml-base.en.bin");
+    CHECK(!path.empty());
+    return path;
+}
+
+// Opens the device with the parameters of cfg, on the test model unless cfg gives one
+bool openDevice(Property cfg, PolyDriver& dd, ISpeechTranscription*& istr)
+{
+    cfg.put("device", "whisperSpeechTranscription");
+    if (!cfg.check("model") && !cfg.check("model_variants"))
+    {
+        cfg.put("model", testModel());
+    }
+    return dd.open(cfg) && dd.view(istr);
+}
+
+// The allocations of whisper_full() are not counted
+class CountingWhisper : public WhisperSpeechTranscription
+{
+protected:
+    void onInference(bool running) override
+    {
+        if (running)
+        {
+            counting_paused = count_allocations;
+            count_allocations = false;
+        }
+        else
+        {
+            count_allocations = counting_paused;
+        }
+    }
+};
+}
+
 TEST_CASE("dev::whisperSpeechTranscription", "[yarp::dev]")
 {
     YARP_REQUIRE_PLUGIN("whisperSpeechTranscription", "device");
@@ -70,7 +170,35 @@ TEST_CASE("dev::whisperSpeechTranscription", "[yarp::dev]")
         double score;
         CHECK(istr->transcribe(snd,transcript, score));
         CHECK(transcript==" And so my fellow Americans, ask not what your country can do for you, ask what you can do for your country.");
-        CHECK(score > 0.99);
+        //the score is the mean token probability: high for this clear recording, but not 1
+        CHECK(score > 0.5);
+        CHECK(score <= 1.0);
+
+        //the same audio at 48kHz, stereo, must be resampled and downmixed by the device
+        {
+            yarp::sig::Sound snd48;
+            snd48.resize(snd.getSamples() * 3, 2);
+            snd48.setFrequency(snd.getFrequency() * 3);
+            for (size_t i = 0; i < snd48.getSamples(); i++)
+            {
+                snd48.set(snd.get(i / 3, 0), i, 0);
+                snd48.set(0, i, 1);
+            }
+            std::string transcript48;
+            double score48;
+            CHECK(istr->transcribe(snd48, transcript48, score48));
+            CHECK(transcript48 == transcript);
+        }
+
+        //a negative channel is refused when the device is opened
+        {
+            PolyDriver ddchannel;
+            ISpeechTranscription* ichannel = nullptr;
+            Property pdev_cfg;
+            pdev_cfg.put("downmix", "select");
+            pdev_cfg.put("downmix_channel", -1);
+            CHECK(!openDevice(pdev_cfg, ddchannel, ichannel));
+        }
 
         //"Close all polydrivers and check"
         {
@@ -79,5 +207,1228 @@ TEST_CASE("dev::whisperSpeechTranscription", "[yarp::dev]")
         }
     }
 
+    SECTION("Checking whisperSpeechTranscription voice activity detection")
+    {
+        yarp::dev::ISpeechTranscription* istr=nullptr;
+        PolyDriver ddvad;
+
+        {
+            Property pdev_cfg;
+            pdev_cfg.put("vad", "true");
+            REQUIRE(openDevice(pdev_cfg, ddvad, istr));
+        }
+
+        //two seconds of silence must not reach the model
+        yarp::sig::Sound silence;
+        silence.resize(32000, 1);
+        silence.setFrequency(16000);
+        std::string transcript = "dummy";
+        double score = 1.0;
+        CHECK(istr->transcribe(silence, transcript, score));
+        CHECK(transcript.empty());
+        CHECK(score == 0.0);
+
+        //two seconds of silence before and after the speech are trimmed, the speech is kept
+        yarp::sig::Sound snd = testSound();
+        REQUIRE(snd.getFrequency() == 16000);
+        yarp::sig::Sound padded = silence;
+        padded += snd;
+        padded += silence;
+        CHECK(istr->transcribe(padded, transcript, score));
+        CHECK(transcript == test_transcript);
+        CHECK(score > 0.0);
+
+        std::vector<float> pcm(padded.getSamples());
+        for (size_t i = 0; i < pcm.size(); i++)
+        {
+            pcm[i] = float(padded.get(i, 0)) / 32768.0f;
+        }
+        VoiceActivityDetector vad;
+        const size_t padding = vad.getConfig().padding_ms * 16;
+        REQUIRE(vad.trim(pcm));
+        CHECK(pcm.size() <= snd.getSamples() + 2 * padding);
+        CHECK(pcm.size() > snd.getSamples() - 16000);
+
+        CHECK(ddvad.close());
+    }
+
+    SECTION("Checking whisperSpeechTranscription concurrent requests")
+    {
+        yarp::dev::ISpeechTranscription* istr=nullptr;
+        PolyDriver ddpool;
+
+        yarp::sig::Sound snd = testSound();
+
+        {
+            Property pdev_cfg;
+            pdev_cfg.put("states", 2);
+            REQUIRE(openDevice(pdev_cfg, ddpool, istr));
+        }
+
+        //three requests on two states: all of them must complete with the same result
+        std::string transcripts[3];
+        double scores[3];
+        bool results[3];
+        std::vector<std::thread> clients;
+        for (size_t i = 0; i < 3; i++)
+        {
+            clients.emplace_back([&, i]() { results[i] = bool(istr->transcribe(snd, transcripts[i], scores[i])); });
+        }
+        for (auto& t : clients) { t.join(); }
+        for (size_t i = 0; i < 3; i++)
+        {
+            CHECK(results[i]);
+            CHECK(transcripts[i] == test_transcript);
+        }
+
+        CHECK(ddpool.close());
+    }
+
+    SECTION("Checking whisperSpeechTranscription shared model")
+    {
+        yarp::dev::ISpeechTranscription* istr1=nullptr;
+        yarp::dev::ISpeechTranscription* istr2=nullptr;
+        PolyDriver dd1;
+        PolyDriver dd2;
+
+        yarp::sig::Sound snd = testSound();
+
+        //two instances of the same model: the second one reuses the weights loaded by the first
+        {
+            Property pdev_cfg;
+            pdev_cfg.put("name", "/whisperShared1");
+            pdev_cfg.put("warmup", "true");
+            REQUIRE(openDevice(pdev_cfg, dd1, istr1));
+            pdev_cfg.put("name", "/whisperShared2");
+            REQUIRE(openDevice(pdev_cfg, dd2, istr2));
+        }
+
+        std::string transcript;
+        double score;
+        CHECK(istr2->transcribe(snd, transcript, score));
+        CHECK(transcript == test_transcript);
+
+        //the model must stay available to the second instance when the first one is closed
+        CHECK(dd1.close());
+        transcript.clear();
+        CHECK(istr2->transcribe(snd, transcript, score));
+        CHECK(transcript == test_transcript);
+        CHECK(dd2.close());
+    }
+
+    SECTION("Checking whisperSpeechTranscription model switching")
+    {
+        yarp::dev::ISpeechTranscription* istr=nullptr;
+        PolyDriver ddswitch;
+
+        yarp::sig::Sound snd = testSound();
+
+        {
+            Property pdev_cfg;
+            pdev_cfg.put("name", "/whisperSwitch");
+            REQUIRE(openDevice(pdev_cfg, ddswitch, istr));
+        }
+
+        CHECK(!istr->setLanguage("not_a_language"));
+
+        Port rpc;
+        REQUIRE(rpc.open("/whisperSwitch/test:rpc"));
+        REQUIRE(Network::connect("/whisperSwitch/test:rpc", "/whisperSwitch/rpc"));
+        {
+            Bottle cmd;
+            Bottle reply;
+            cmd.addString("load_model");
+            cmd.addString(testModel());
+            cmd.addString("short");
+            CHECK(rpc.write(cmd, reply));
+            CHECK(reply.get(0).asVocab32() == yarp::os::createVocab32('o', 'k'));
+        }
+        {
+            Bottle cmd;
+            Bottle reply;
+            cmd.addString("models");
+            CHECK(rpc.write(cmd, reply));
+            CHECK(reply.size() == 2);
+        }
+
+        //the audio is longer than short_max_ms: still served by the main model
+        std::string transcript;
+        double score;
+        CHECK(istr->transcribe(snd, transcript, score));
+        CHECK(transcript == test_transcript);
+
+        rpc.close();
+        CHECK(ddswitch.close());
+    }
+
+    SECTION("Checking whisperSpeechTranscription result cache")
+    {
+        yarp::dev::ISpeechTranscription* istr=nullptr;
+        PolyDriver ddcache;
+
+        yarp::sig::Sound snd = testSound();
+
+        {
+            Property pdev_cfg;
+            pdev_cfg.put("cache_size", 4);
+            REQUIRE(openDevice(pdev_cfg, ddcache, istr));
+        }
+
+        //the replayed audio is served by the cache, with the same result
+        std::string transcript1;
+        std::string transcript2;
+        double score1;
+        double score2;
+        CHECK(istr->transcribe(snd, transcript1, score1));
+        CHECK(istr->transcribe(snd, transcript2, score2));
+        CHECK(transcript1 == test_transcript);
+        CHECK(transcript2 == transcript1);
+        CHECK(score2 == score1);
+
+        CHECK(ddcache.close());
+    }
+
+    SECTION("Checking whisperSpeechTranscription command mode")
+    {
+        yarp::dev::ISpeechTranscription* istr=nullptr;
+        PolyDriver ddcommands;
+
+        yarp::sig::Sound snd = testSound();
+
+        const std::string command = "And so my fellow Americans, ask not what your country can do for you, ask what you can do for your country";
+        {
+            std::ofstream commands("whisper_test_commands.txt");
+            commands << "# test commands\n" << "go to the kitchen\n" << command << "\n" << "stop\n";
+        }
+
+        for (const char* mode : { "score", "grammar" })
+        {
+            Property pdev_cfg;
+            pdev_cfg.put("commands", "whisper_test_commands.txt");
+            pdev_cfg.put("command_mode", mode);
+            REQUIRE(openDevice(pdev_cfg, ddcommands, istr));
+
+            std::string transcript;
+            double score;
+            CHECK(istr->transcribe(snd, transcript, score));
+            CHECK(transcript == command);
+            CHECK(score > 0.5);
+            CHECK(score <= 1.0);
+
+            CHECK(ddcommands.close());
+        }
+
+        //the command is matched on the decoded text, the filters only rewrite the returned command
+        {
+            Property pdev_cfg;
+            pdev_cfg.put("commands", "whisper_test_commands.txt");
+            pdev_cfg.put("command_mode", "grammar");
+            pdev_cfg.fromString("(text_filters (lowercase))", false);
+            REQUIRE(openDevice(pdev_cfg, ddcommands, istr));
+
+            std::string transcript;
+            double score;
+            CHECK(istr->transcribe(snd, transcript, score));
+            CHECK(transcript == "and so my fellow americans ask not what your country can do for you ask what you can do for your country");
+
+            CHECK(ddcommands.close());
+        }
+
+        //speech that is none of the commands is not forced on the closest one
+        {
+            std::ofstream commands("whisper_test_commands.txt");
+            commands << "go to the kitchen\n" << "stop\n" << "turn left\n";
+        }
+        {
+            Property pdev_cfg;
+            pdev_cfg.put("commands", "whisper_test_commands.txt");
+            pdev_cfg.put("command_mode", "score");
+            REQUIRE(openDevice(pdev_cfg, ddcommands, istr));
+
+            std::string transcript = "x";
+            double score = 1;
+            CHECK(istr->transcribe(snd, transcript, score));
+            CHECK(transcript.empty());
+            CHECK(score == 0);
+
+            CHECK(ddcommands.close());
+        }
+        std::remove("whisper_test_commands.txt");
+    }
+
+    SECTION("Checking whisperSpeechTranscription long-form mode")
+    {
+        yarp::dev::ISpeechTranscription* istr=nullptr;
+        PolyDriver ddlong;
+
+        yarp::sig::Sound snd = testSound();
+
+        {
+            Property pdev_cfg;
+            pdev_cfg.put("long_form_ms", 5000);
+            pdev_cfg.put("chunk_ms", 7000);
+            pdev_cfg.put("chunk_overlap_ms", 500);
+            pdev_cfg.put("processors", 2);
+            REQUIRE(openDevice(pdev_cfg, ddlong, istr));
+        }
+
+        //the recording is transcribed in two chunks, cut at a pause: the words are neither lost nor repeated
+        std::string transcript;
+        double score;
+        CHECK(istr->transcribe(snd, transcript, score));
+        CHECK(transcript.find("fellow Americans") != std::string::npos);
+        CHECK(transcript.find("for your country") != std::string::npos);
+        CHECK(transcript.find("fellow Americans") == transcript.rfind("fellow Americans"));
+        CHECK(score > 0.5);
+        CHECK(score <= 1.0);
+
+        CHECK(ddlong.close());
+    }
+
+    SECTION("Checking whisperSpeechTranscription allocations")
+    {
+        //the device is built into the test, to count the allocations outside whisper_full()
+        CountingWhisper dev;
+        yarp::sig::Sound snd = testSound();
+
+        {
+            Property pdev_cfg;
+            pdev_cfg.put("model", testModel());
+            REQUIRE(dev.open(pdev_cfg));
+        }
+
+        //after the warm-up, a request converts the audio, reads the segments, builds the transcription and records
+        //its figures in the buffers of the device: only whisper_full() touches the heap
+        std::string transcript;
+        double score;
+        CHECK(dev.transcribe(snd, transcript, score));
+        CHECK(dev.transcribe(snd, transcript, score));
+        allocations = 0;
+        count_allocations = true;
+        bool ok = bool(dev.transcribe(snd, transcript, score));
+        count_allocations = false;
+        CHECK(ok);
+        CHECK(allocations == 0);
+        CHECK(transcript == test_transcript);
+
+        CHECK(dev.close());
+    }
+
+    SECTION("Checking whisperSpeechTranscription diarization")
+    {
+        yarp::dev::ISpeechTranscription* istr=nullptr;
+        PolyDriver dddiarize;
+
+        yarp::sig::Sound snd = testSound();
+
+        //stereo recording of a speaker close to the second microphone
+        yarp::sig::Sound stereo;
+        stereo.resize(snd.getSamples(), 2);
+        stereo.setFrequency(snd.getFrequency());
+        for (size_t i = 0; i < snd.getSamples(); i++)
+        {
+            stereo.set(snd.get(i, 0) / 8, i, 0);
+            stereo.set(snd.get(i, 0), i, 1);
+        }
+
+        {
+            Property pdev_cfg;
+            pdev_cfg.put("downmix", "beamform");
+            pdev_cfg.put("diarize", true);
+            pdev_cfg.put("speaker_labels", true);
+            REQUIRE(openDevice(pdev_cfg, dddiarize, istr));
+        }
+
+        std::string transcript;
+        double score;
+        CHECK(istr->transcribe(stereo, transcript, score));
+        CHECK(transcript.rfind(" Speaker 1:", 0) == 0);
+        CHECK(transcript.find("Speaker 0") == std::string::npos);
+        CHECK(transcript.find("ask not what your country can do for you") != std::string::npos);
+
+        CHECK(dddiarize.close());
+    }
+
+    SECTION("Checking whisperSpeechTranscription alignment output")
+    {
+        yarp::dev::ISpeechTranscription* istr=nullptr;
+        PolyDriver ddalign;
+
+        yarp::sig::Sound snd = testSound();
+
+        {
+            Property pdev_cfg;
+            pdev_cfg.put("name", "/whisperAlign");
+            REQUIRE(openDevice(pdev_cfg, ddalign, istr));
+        }
+
+        //the details are computed because a client is connected
+        BufferedPort<Bottle> alignment;
+        REQUIRE(alignment.open("/whisperAlign/test:i"));
+        REQUIRE(Network::connect("/whisperAlign/alignment:o", "/whisperAlign/test:i"));
+
+        std::string transcript;
+        double score;
+        CHECK(istr->transcribe(snd, transcript, score));
+        Bottle* b = alignment.read();
+        REQUIRE(b != nullptr);
+        CHECK(b->get(0).asString() == transcript);
+        Bottle* segments = b->get(2).asList();
+        REQUIRE(segments != nullptr);
+        REQUIRE(segments->size() > 0);
+        Bottle* seg = segments->get(0).asList();
+        REQUIRE(seg != nullptr);
+        CHECK(seg->get(0).asFloat64() >= 0.0);
+        CHECK(seg->get(1).asFloat64() > seg->get(0).asFloat64());
+        Bottle* words = seg->get(4).asList();
+        REQUIRE(words != nullptr);
+        REQUIRE(words->size() > 0);
+        CHECK(words->get(0).asList()->get(0).asString() == " And");
+        CHECK(words->get(0).asList()->get(1).asFloat64() >= 0.0);
+        CHECK(seg->get(5).isBlob());
+        CHECK(seg->get(5).asBlobLength() > 0);
+        CHECK(seg->get(5).asBlobLength() % 16 == 0);
+
+        alignment.close();
+        CHECK(ddalign.close());
+    }
+
+    SECTION("Checking whisperSpeechTranscription metrics")
+    {
+        yarp::dev::ISpeechTranscription* istr=nullptr;
+        PolyDriver ddmetrics;
+
+        yarp::sig::Sound snd = testSound();
+
+        const int window = 3;
+        {
+            Property pdev_cfg;
+            pdev_cfg.put("name", "/whisperMetrics");
+            pdev_cfg.put("metrics_port", true);
+            pdev_cfg.put("metrics_window", window);
+            REQUIRE(openDevice(pdev_cfg, ddmetrics, istr));
+        }
+
+        BufferedPort<Bottle> metrics;
+        metrics.setStrict();
+        REQUIRE(metrics.open("/whisperMetrics/test:i"));
+        REQUIRE(Network::connect("/whisperMetrics/metrics:o", "/whisperMetrics/test:i"));
+
+        //every request is published with its figures and the percentiles over the last ones
+        const int n_requests = 5;
+        std::vector<double> total_ms;
+        for (int i = 0; i < n_requests; i++)
+        {
+            std::string transcript;
+            double score;
+            CHECK(istr->transcribe(snd, transcript, score));
+            Bottle* b = metrics.read();
+            REQUIRE(b != nullptr);
+            CHECK(std::abs(b->find("audio_s").asFloat64() - double(snd.getSamples()) / snd.getFrequency()) < 0.01);
+            CHECK(b->find("encode_ms").asFloat64() > 0.0);
+            CHECK(b->find("decode_ms").asFloat64() > 0.0);
+            CHECK(b->find("total_ms").asFloat64() >= b->find("encode_ms").asFloat64());
+            CHECK(b->find("rtf").asFloat64() > 0.0);
+            CHECK(b->find("windows").asInt32() == 1);
+            CHECK(b->find("tokens").asInt32() > 0);
+            CHECK(b->find("cache_hit").asInt32() == 0);
+            CHECK(b->find("aborted").asInt32() == 0);
+            CHECK(b->find("requests").asInt32() == i + 1);
+            CHECK(b->find("window").asInt32() == std::min(i + 1, window));
+            CHECK(b->find("total_ms_p50").asFloat64() <= b->find("total_ms_p99").asFloat64());
+            total_ms.push_back(b->find("total_ms").asFloat64());
+        }
+
+        Port rpc;
+        REQUIRE(rpc.open("/whisperMetrics/test:rpc"));
+        REQUIRE(Network::connect("/whisperMetrics/test:rpc", "/whisperMetrics/rpc"));
+        Bottle cmd;
+        Bottle reply;
+        cmd.addString("metrics");
+        CHECK(rpc.write(cmd, reply));
+        CHECK(reply.find("requests").asInt32() == n_requests);
+        CHECK(reply.find("window").asInt32() == window);
+        //nearest-rank percentiles over the last requests only: of 3 values, p50 is the median, p90 and p99 the maximum
+        std::vector<double> last_ms(total_ms.end() - window, total_ms.end());
+        std::sort(last_ms.begin(), last_ms.end());
+        CHECK(reply.find("total_ms_p50").asFloat64() == last_ms[1]);
+        CHECK(reply.find("total_ms_p90").asFloat64() == last_ms[2]);
+        CHECK(reply.find("total_ms_p99").asFloat64() == last_ms[2]);
+        CHECK(reply.find("rtf_p50").asFloat64() > 0.0);
+        CHECK(reply.find("rtf_p50").asFloat64() <= reply.find("rtf_p99").asFloat64());
+        CHECK(reply.find("fallbacks_per_request").asFloat64() >= 0.0);
+
+        rpc.close();
+        metrics.close();
+        CHECK(ddmetrics.close());
+    }
+
+    SECTION("Checking whisperSpeechTranscription conversation context")
+    {
+        yarp::dev::ISpeechTranscription* istr=nullptr;
+        PolyDriver ddcontext;
+
+        yarp::sig::Sound snd = testSound();
+
+        {
+            Property pdev_cfg;
+            pdev_cfg.put("name", "/whisperContext");
+            pdev_cfg.put("context_tokens", 64);
+            REQUIRE(openDevice(pdev_cfg, ddcontext, istr));
+        }
+        Port rpc;
+        REQUIRE(rpc.open("/whisperContext/test:rpc"));
+        REQUIRE(Network::connect("/whisperContext/test:rpc", "/whisperContext/rpc"));
+        auto utterances = [&rpc]() {
+            Bottle cmd;
+            Bottle reply;
+            cmd.addString("context");
+            rpc.write(cmd, reply);
+            return reply.find("utterances").asInt32();
+        };
+
+        //the second request is decoded with the first transcription as prompt
+        std::string transcript;
+        double score;
+        CHECK(istr->transcribe(snd, transcript, score));
+        CHECK(utterances() == 1);
+        CHECK(istr->transcribe(snd, transcript, score));
+        CHECK(transcript.find("ask not what your country can do for you") != std::string::npos);
+        CHECK(utterances() == 2);
+
+        {
+            Bottle cmd;
+            Bottle reply;
+            cmd.addString("context_reset");
+            CHECK(rpc.write(cmd, reply));
+            CHECK(reply.get(0).asVocab32() == yarp::os::createVocab32('o','k'));
+        }
+        CHECK(utterances() == 0);
+
+        rpc.close();
+        CHECK(ddcontext.close());
+    }
+
+    SECTION("Checking whisperSpeechTranscription latency budget")
+    {
+        yarp::dev::ISpeechTranscription* istr=nullptr;
+        PolyDriver ddbudget;
+
+        yarp::sig::Sound snd = testSound();
+
+        {
+            Property pdev_cfg;
+            pdev_cfg.put("name", "/whisperBudget");
+            pdev_cfg.put("latency_budget_ms", 60000);
+            REQUIRE(openDevice(pdev_cfg, ddbudget, istr));
+        }
+
+        //a generous budget does not change the transcription, also once the speed has been measured
+        std::string transcript;
+        double score;
+        for (int i = 0; i < 2; i++)
+        {
+            CHECK(istr->transcribe(snd, transcript, score));
+            CHECK(transcript.find("ask not what your country can do for you") != std::string::npos);
+        }
+
+        Port rpc;
+        REQUIRE(rpc.open("/whisperBudget/test:rpc"));
+        REQUIRE(Network::connect("/whisperBudget/test:rpc", "/whisperBudget/rpc"));
+        //a budget too small for any strategy aborts the inference, the partial transcription is returned
+        {
+            Bottle cmd;
+            Bottle reply;
+            cmd.addString("latency_budget");
+            cmd.addInt32(1);
+            CHECK(rpc.write(cmd, reply));
+            CHECK(reply.find("latency_budget_ms").asInt32() == 1);
+        }
+        for (int i = 0; i < 2; i++)
+        {
+            CHECK(istr->transcribe(snd, transcript, score));
+            CHECK(transcript.find("ask what you can do for your country") == std::string::npos);
+        }
+        {
+            Bottle cmd;
+            Bottle reply;
+            cmd.addString("latency_budget");
+            cmd.addInt32(0);
+            CHECK(rpc.write(cmd, reply));
+            CHECK(reply.find("latency_budget_ms").asInt32() == 0);
+        }
+        CHECK(istr->transcribe(snd, transcript, score));
+        CHECK(transcript.find("ask not what your country can do for you") != std::string::npos);
+
+        rpc.close();
+        CHECK(ddbudget.close());
+    }
+
+    SECTION("Checking whisperSpeechTranscription model variants")
+    {
+        yarp::dev::ISpeechTranscription* istr=nullptr;
+        PolyDriver ddvariants;
+
+        yarp::sig::Sound snd = testSound();
+
+        //the variant that cannot be read is skipped
+        {
+            Property pdev_cfg;
+            pdev_cfg.put("name", "/whisperVariants");
+            pdev_cfg.fromString("(model_variants (\"" + testModel() + "\" missing-q5_1.bin)) (model_min_accuracy q5_1)", false);
+            REQUIRE(openDevice(pdev_cfg, ddvariants, istr));
+        }
+
+        std::string transcript;
+        double score;
+        CHECK(istr->transcribe(snd, transcript, score));
+        CHECK(transcript.find("ask not what your country can do for you") != std::string::npos);
+        CHECK(ddvariants.close());
+
+        //no variant meets the accuracy floor
+        {
+            PolyDriver ddfloor;
+            Property pdev_cfg;
+            pdev_cfg.put("name", "/whisperVariants");
+            pdev_cfg.fromString("(model_variants (missing-q5_1.bin)) (model_min_accuracy q8_0)", false);
+            CHECK_FALSE(openDevice(pdev_cfg, ddfloor, istr));
+        }
+    }
+
+    SECTION("Checking whisperSpeechTranscription streaming mode")
+    {
+        yarp::dev::ISpeechTranscription* istr=nullptr;
+        PolyDriver ddstream;
+
+        yarp::sig::Sound snd = testSound();
+
+        {
+            Property pdev_cfg;
+            pdev_cfg.put("name", "/whisperStream");
+            pdev_cfg.put("streaming", true);
+            pdev_cfg.put("step_ms", 3000);
+            pdev_cfg.put("length_ms", 10000);
+            REQUIRE(openDevice(pdev_cfg, ddstream, istr));
+        }
+        BufferedPort<Bottle> text;
+        text.setStrict();
+        REQUIRE(text.open("/whisperStream/test/text:i"));
+        REQUIRE(Network::connect("/whisperStream/stream/text:o", "/whisperStream/test/text:i"));
+
+        //chunks of 0.5 s at the pace of a microphone, then silence, so that a last step covers the end of the speech
+        const size_t chunk = snd.getFrequency() / 2;
+        yarp::sig::Sound audio = snd;
+        yarp::sig::Sound silence;
+        silence.resize(4 * snd.getFrequency(), snd.getChannels());
+        silence.setFrequency(snd.getFrequency());
+        audio += silence;
+        for (size_t begin = 0; begin < audio.getSamples(); begin += chunk)
+        {
+            const size_t end = std::min(audio.getSamples(), begin + chunk);
+            yarp::sig::Sound part = audio.subSound(begin, end);
+            std::string transcript;
+            double score;
+            CHECK(istr->transcribe(part, transcript, score));
+            yarp::os::Time::delay(0.5);
+        }
+
+        //partial hypotheses every step, finalized every length_ms / step_ms - 1 steps
+        bool partial = false;
+        bool final = false;
+        std::string transcript;
+        for (int i = 0; i < 100 && !(partial && final && transcript.find("country") != std::string::npos); i++)
+        {
+            while (Bottle* b = text.read(false))
+            {
+                partial = partial || b->get(0).asString() == "partial";
+                final = final || b->get(0).asString() == "final";
+                transcript += b->get(1).asString();
+            }
+            yarp::os::Time::delay(0.1);
+        }
+        CHECK(partial);
+        CHECK(final);
+        CHECK(transcript.find("country") != std::string::npos);
+
+        text.close();
+        CHECK(ddstream.close());
+    }
+
+    SECTION("Checking whisperSpeechTranscription shared-memory input")
+    {
+        yarp::dev::ISpeechTranscription* istr=nullptr;
+        PolyDriver ddshm;
+
+        yarp::sig::Sound snd = testSound();
+
+        //the test is the producer: the ring holds the speech and the trailing silence written below, so that
+        //none of it is overwritten before the device reads it
+        const size_t silence_samples = 4 * snd.getFrequency();
+        SharedAudioRing ring;
+        REQUIRE(ring.create("/whisper_test_audio", snd.getFrequency(), snd.getChannels(), snd.getSamples() + silence_samples));
+        {
+            Property pdev_cfg;
+            pdev_cfg.put("name", "/whisperShm");
+            pdev_cfg.put("shm_input", "/whisper_test_audio");
+            pdev_cfg.put("step_ms", 3000);
+            pdev_cfg.put("length_ms", 30000);
+            REQUIRE(openDevice(pdev_cfg, ddshm, istr));
+        }
+        BufferedPort<Bottle> text;
+        REQUIRE(text.open("/whisperShm/test/text:i"));
+        REQUIRE(Network::connect("/whisperShm/stream/text:o", "/whisperShm/test/text:i"));
+
+        //the device reads the samples written after it attached to the ring
+        //trailing silence, so that a last step covers the end of the speech
+        yarp::sig::Sound silence;
+        silence.resize(silence_samples, snd.getChannels());
+        silence.setFrequency(snd.getFrequency());
+        yarp::os::Time::delay(0.5);
+        CHECK(ring.write(snd));
+        CHECK(ring.write(silence));
+        bool found = false;
+        for (int i = 0; i < 600 && !found; i++)
+        {
+            Bottle* b = text.read(false);
+            found = b && b->get(1).asString().find("ask not what your country can do for you") != std::string::npos;
+            yarp::os::Time::delay(0.1);
+        }
+        CHECK(found);
+
+        text.close();
+        CHECK(ddshm.close());
+        ring.close();
+    }
+
+    SECTION("Checking whisperSpeechTranscription wake words")
+    {
+        yarp::sig::Sound snd = testSound();
+
+        //the recording begins with "And so my fellow Americans"
+        for (std::string keywords : { "(\"and so my fellow\")", "(\"hey robot\" \"ok robot\")" })
+        {
+            const bool addressed = keywords.find("fellow") != std::string::npos;
+            yarp::dev::ISpeechTranscription* istr=nullptr;
+            PolyDriver ddwake;
+            {
+                Property pdev_cfg;
+                pdev_cfg.put("name", "/whisperWake");
+                pdev_cfg.fromString("(keywords " + keywords + ")", false);
+                REQUIRE(openDevice(pdev_cfg, ddwake, istr));
+            }
+            Port rpc;
+            REQUIRE(rpc.open("/whisperWake/test:rpc"));
+            REQUIRE(Network::connect("/whisperWake/test:rpc", "/whisperWake/rpc"));
+
+            std::string transcript;
+            double score;
+            CHECK(istr->transcribe(snd, transcript, score));
+            CHECK((transcript.find("ask not what your country can do for you") != std::string::npos) == addressed);
+            {
+                Bottle cmd;
+                Bottle reply;
+                cmd.addString("last_stats");
+                CHECK(rpc.write(cmd, reply));
+                CHECK(reply.find("skipped").asInt32() == (addressed ? 0 : 2));
+                CHECK(reply.find("keyword_ms").asFloat64() > 0);
+            }
+
+            rpc.close();
+            CHECK(ddwake.close());
+        }
+    }
+
+    SECTION("Checking whisperSpeechTranscription language pinning")
+    {
+        yarp::sig::Sound snd = testSound();
+
+        yarp::dev::ISpeechTranscription* istr=nullptr;
+        PolyDriver ddlang;
+        {
+            Property pdev_cfg;
+            pdev_cfg.put("name", "/whisperLang");
+            pdev_cfg.put("detect-language", true);
+            pdev_cfg.put("language_pin_prob", 0.8);
+            REQUIRE(openDevice(pdev_cfg, ddlang, istr));
+        }
+        Port rpc;
+        REQUIRE(rpc.open("/whisperLang/test:rpc"));
+        REQUIRE(Network::connect("/whisperLang/test:rpc", "/whisperLang/rpc"));
+
+        //detect-language used to stop whisper after the detection, with an empty transcription
+        std::string language;
+        CHECK(istr->getLanguage(language));
+        CHECK(language == "auto");
+        std::string transcript;
+        double score;
+        CHECK(istr->transcribe(snd, transcript, score));
+        CHECK(transcript.find("ask not what your country can do for you") != std::string::npos);
+
+        {
+            //an English-only model has nothing to detect
+            Bottle cmd;
+            Bottle reply;
+            cmd.addString("language_pin");
+            CHECK(rpc.write(cmd, reply));
+            CHECK(reply.find("language").asString().empty());
+            CHECK(reply.find("detections").asFloat64() == 0);
+        }
+
+        CHECK(!istr->setLanguage("xx"));
+        CHECK(istr->setLanguage("en"));
+        CHECK(istr->getLanguage(language));
+        CHECK(language == "en");
+        CHECK(istr->transcribe(snd, transcript, score));
+        CHECK(transcript.find("ask not what your country can do for you") != std::string::npos);
+        {
+            Bottle cmd;
+            Bottle reply;
+            cmd.addString("language_reset");
+            CHECK(rpc.write(cmd, reply));
+            CHECK(reply.get(0).asVocab32() == yarp::os::createVocab32('o', 'k'));
+        }
+
+        rpc.close();
+        CHECK(ddlang.close());
+    }
+
+    SECTION("Checking whisperSpeechTranscription text filters")
+    {
+        yarp::sig::Sound snd = testSound();
+
+        yarp::dev::ISpeechTranscription* istr=nullptr;
+        PolyDriver ddtext;
+        {
+            Property pdev_cfg;
+            pdev_cfg.put("name", "/whisperText");
+            pdev_cfg.fromString("(text_filters (symbols hallucinations lowercase))", false);
+            REQUIRE(openDevice(pdev_cfg, ddtext, istr));
+        }
+        std::string transcript;
+        double score;
+        CHECK(istr->transcribe(snd, transcript, score));
+        CHECK(transcript.find(" and so my fellow americans ask not what your country can do for you") == 0);
+        CHECK(transcript.find_first_of(".,!?") == std::string::npos);
+        CHECK(ddtext.close());
+
+        {
+            Property pdev_cfg;
+            pdev_cfg.put("name", "/whisperText");
+            pdev_cfg.fromString("(text_filters (symbols unknown_filter))", false);
+            CHECK(!openDevice(pdev_cfg, ddtext, istr));
+        }
+    }
+
+    SECTION("Checking whisperSpeechTranscription request queue")
+    {
+        yarp::dev::ISpeechTranscription* istr=nullptr;
+        PolyDriver ddqueue;
+
+        yarp::sig::Sound snd = testSound();
+        {
+            Property pdev_cfg;
+            pdev_cfg.put("name", "/whisperQueue");
+            pdev_cfg.put("queue_depth", 4);
+            pdev_cfg.put("queue_max_wait_ms", 100);
+            pdev_cfg.put("batch_window_ms", 500);
+            pdev_cfg.put("batch_max_utterance_ms", 4000);
+            REQUIRE(openDevice(pdev_cfg, ddqueue, istr));
+        }
+        Port rpc;
+        REQUIRE(rpc.open("/whisperQueue/test:rpc"));
+        REQUIRE(Network::connect("/whisperQueue/test:rpc", "/whisperQueue/rpc"));
+        auto queueStat = [&rpc](const std::string& key) {
+            Bottle cmd;
+            Bottle reply;
+            cmd.addString("queue_stats");
+            rpc.write(cmd, reply);
+            return reply.find(key).asFloat64();
+        };
+
+        //the first and the last words of the recording, transcribed in one pass: each one gets its own text
+        auto cut = [&snd](double from_s, double to_s) {
+            const size_t begin = size_t(from_s * snd.getFrequency());
+            const size_t end = std::min(snd.getSamples(), size_t(to_s * snd.getFrequency()));
+            yarp::sig::Sound part;
+            part.resize(end - begin, 1);
+            part.setFrequency(snd.getFrequency());
+            for (size_t i = begin; i < end; i++)
+            {
+                part.set(snd.get(i, 0), i - begin, 0);
+            }
+            return part;
+        };
+        yarp::sig::Sound first = cut(0.0, 3.5);
+        yarp::sig::Sound last = cut(8.0, 11.0);
+        std::string texts[2];
+        double scores[2];
+        bool results[2];
+        {
+            std::thread t0([&]() { results[0] = bool(istr->transcribe(first, texts[0], scores[0])); });
+            std::thread t1([&]() { results[1] = bool(istr->transcribe(last, texts[1], scores[1])); });
+            t0.join();
+            t1.join();
+        }
+        CHECK(results[0]);
+        CHECK(results[1]);
+        CHECK(texts[0].find("fellow") != std::string::npos);
+        CHECK(texts[0].find("country") == std::string::npos);
+        CHECK(texts[1].find("your country") != std::string::npos);
+        CHECK(texts[1].find("fellow") == std::string::npos);
+        CHECK(queueStat("batches") == 1);
+        CHECK(queueStat("batched_jobs") == 2);
+
+        //the whole recording is not batched: the request behind it waits longer than queue_max_wait_ms
+        ReturnValue rets[2];
+        {
+            std::thread t0([&]() { rets[0] = istr->transcribe(snd, texts[0], scores[0]); });
+            yarp::os::Time::delay(0.05);
+            std::thread t1([&]() { rets[1] = istr->transcribe(snd, texts[1], scores[1]); });
+            t0.join();
+            t1.join();
+        }
+        CHECK(bool(rets[0]));
+        CHECK(texts[0] == test_transcript);
+        CHECK(rets[1] == ReturnValue::return_code::return_value_error_not_ready);
+        CHECK(queueStat("expired") == 1);
+
+        rpc.close();
+        CHECK(ddqueue.close());
+    }
+
     Network::setLocalMode(false);
 }
+
+TEST_CASE("dev::whisperSpeechTranscription::TranscriptionQueue", "[yarp::dev]")
+{
+    //the jobs are held by the process function until the test releases them
+    std::atomic<bool> hold{ true };
+    std::atomic<size_t> processed{ 0 };
+    std::atomic<size_t> largest_batch{ 0 };
+    auto process = [&](std::vector<TranscriptionJob*>& batch) {
+        while (hold) { std::this_thread::sleep_for(std::chrono::milliseconds(1)); }
+        largest_batch = std::max(largest_batch.load(), batch.size());
+        for (auto* job : batch)
+        {
+            job->text = "done";
+            job->status = TranscriptionJob::Status::done;
+            processed++;
+        }
+    };
+    auto waitFor = [](const std::function<bool()>& condition) {
+        for (int i = 0; i < 2000 && !condition(); i++) { std::this_thread::sleep_for(std::chrono::milliseconds(1)); }
+        return condition();
+    };
+
+    SECTION("Checking the policies of a full queue")
+    {
+        for (auto policy : { TranscriptionQueue::Policy::reject, TranscriptionQueue::Policy::drop_oldest })
+        {
+            hold = true;
+            TranscriptionQueue queue;
+            TranscriptionQueue::Config cfg;
+            cfg.depth = 1;
+            cfg.policy = policy;
+            REQUIRE(queue.start(cfg, process));
+
+            //a job is being processed and another one is waiting: the queue is full
+            TranscriptionJob running;
+            TranscriptionJob waiting;
+            TranscriptionJob last;
+            std::thread t0([&]() { queue.submitAndWait(running); });
+            REQUIRE(waitFor([&]() { return queue.getStats().processed == 1; }));
+            std::thread t1([&]() { queue.submitAndWait(waiting); });
+            REQUIRE(waitFor([&]() { return queue.getStats().depth == 1; }));
+            std::thread t2([&]() { queue.submitAndWait(last); });
+            if (policy == TranscriptionQueue::Policy::reject)
+            {
+                t2.join();
+                CHECK(last.status == TranscriptionJob::Status::rejected);
+                CHECK(queue.getStats().rejected == 1);
+            }
+            else
+            {
+                t1.join();
+                CHECK(waiting.status == TranscriptionJob::Status::dropped);
+                CHECK(queue.getStats().dropped == 1);
+            }
+            hold = false;
+            for (auto* t : { &t0, &t1, &t2 })
+            {
+                if (t->joinable()) { t->join(); }
+            }
+            CHECK(running.status == TranscriptionJob::Status::done);
+            CHECK((policy == TranscriptionQueue::Policy::reject ? waiting : last).status == TranscriptionJob::Status::done);
+            CHECK(queue.getStats().max_depth == 1);
+        }
+    }
+
+    SECTION("Checking the expiry of the waiting jobs")
+    {
+        TranscriptionQueue queue;
+        TranscriptionQueue::Config cfg;
+        cfg.depth = 2;
+        cfg.max_wait_s = 0.05;
+        REQUIRE(queue.start(cfg, process));
+
+        TranscriptionJob running;
+        TranscriptionJob waiting;
+        std::thread t0([&]() { queue.submitAndWait(running); });
+        REQUIRE(waitFor([&]() { return queue.getStats().processed == 1; }));
+        std::thread t1([&]() { queue.submitAndWait(waiting); });
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        hold = false;
+        t0.join();
+        t1.join();
+        CHECK(running.status == TranscriptionJob::Status::done);
+        CHECK(waiting.status == TranscriptionJob::Status::expired);
+        CHECK(queue.getStats().expired == 1);
+    }
+
+    SECTION("Checking the batching of short utterances")
+    {
+        hold = false;
+        TranscriptionQueue queue;
+        TranscriptionQueue::Config cfg;
+        cfg.depth = 4;
+        cfg.batch_window_s = 0.2;
+        REQUIRE(queue.start(cfg, process));
+
+        //two short jobs within the window and a long one, which is never batched
+        TranscriptionJob jobs[3];
+        jobs[0].duration_s = 1.0;
+        jobs[1].duration_s = 2.0;
+        jobs[2].duration_s = 10.0;
+        std::thread t0([&]() { queue.submitAndWait(jobs[0]); });
+        std::thread t1([&]() { queue.submitAndWait(jobs[1]); });
+        t0.join();
+        t1.join();
+        queue.submitAndWait(jobs[2]);
+        for (const auto& job : jobs)
+        {
+            CHECK(job.status == TranscriptionJob::Status::done);
+            CHECK(job.text == "done");
+        }
+        CHECK(largest_batch == 2);
+        CHECK(queue.getStats().batches == 1);
+        CHECK(queue.getStats().batched_jobs == 2);
+        CHECK(queue.getStats().processed == 3);
+    }
+}
+
+TEST_CASE("dev::whisperSpeechTranscription::DecodingPolicy", "[yarp::dev]")
+{
+    DecodingPolicy policy;
+    DecodingPolicy::Config cfg;
+    cfg.budget_s = 1.0;
+    cfg.margin = 1.0;
+    policy.setConfig(cfg);
+
+    //beam search of size 5 with fallbacks at 0, 0.2, ... 1
+    auto configured = []()
+    {
+        whisper_full_params params{};
+        params.strategy = WHISPER_SAMPLING_BEAM_SEARCH;
+        params.beam_search.beam_size = 5;
+        params.temperature = 0.0f;
+        params.temperature_inc = 0.2f;
+        return params;
+    };
+
+    //greedy measured at 0.1 s per window and 0.05 s per audio second: beam search is guessed to fit 2 s of audio
+    policy.record(false, 2.0, 100, 100, 1, 0);
+    whisper_full_params params = configured();
+    policy.apply(2.0, params);
+    CHECK(params.strategy == WHISPER_SAMPLING_BEAM_SEARCH);
+
+    //the guess was wrong: greedy until beam search is measured
+    policy.recordAborted(true, 2.0, 1000);
+    params = configured();
+    policy.apply(2.0, params);
+    CHECK(params.strategy == WHISPER_SAMPLING_GREEDY);
+    CHECK(params.temperature_inc > 0.0f);
+
+    //an aborted greedy run leaves no time for the fallbacks until a run completes
+    policy.recordAborted(false, 2.0, 1000);
+    params = configured();
+    policy.apply(2.0, params);
+    CHECK(params.strategy == WHISPER_SAMPLING_GREEDY);
+    CHECK(params.temperature_inc == 0.0f);
+
+    policy.record(false, 2.0, 100, 100, 1, 0);
+    params = configured();
+    policy.apply(2.0, params);
+    CHECK(params.temperature_inc > 0.0f);
+
+    //beam search measured on a completed run is used again when it fits
+    policy.record(true, 2.0, 100, 400, 1, 0);
+    params = configured();
+    policy.apply(2.0, params);
+    CHECK(params.strategy == WHISPER_SAMPLING_BEAM_SEARCH);
+}
+
+TEST_CASE("dev::whisperSpeechTranscription::LanguagePinner", "[yarp::dev]")
+{
+    LanguagePinner pinner;
+    LanguagePinner::Config cfg;
+
+    SECTION("Checking the pinning threshold")
+    {
+        //disabled by default: the detections are counted, nothing is pinned
+        pinner.pin("en", 0.99);
+        CHECK(pinner.pinned() == nullptr);
+        CHECK(pinner.stats().detections == 1);
+
+        cfg.min_probability = 0.8;
+        pinner.setConfig(cfg);
+        pinner.pin("it", 0.5);
+        CHECK(pinner.pinned() == nullptr);
+        pinner.pin("en", 0.9);
+        REQUIRE(pinner.pinned() != nullptr);
+        CHECK(std::string(pinner.pinned()) == "en");
+        const LanguagePinner::Stats st = pinner.stats();
+        CHECK(std::string(st.language) == "en");
+        CHECK(st.probability == 0.9);
+        CHECK(st.detections == 3);
+        CHECK(st.pinned_requests == 2);
+    }
+
+    SECTION("Checking the recheck on a low score")
+    {
+        cfg.min_probability = 0.8;
+        cfg.recheck_score = 0.5;
+        pinner.setConfig(cfg);
+        pinner.pin("en", 0.9);
+
+        //the outcome of another language does not concern the pin
+        pinner.confirm("it", 0.1);
+        CHECK(pinner.pinned() != nullptr);
+        pinner.confirm("en", 0.7);
+        CHECK(pinner.pinned() != nullptr);
+        CHECK(pinner.stats().rechecks == 0);
+
+        pinner.confirm("en", 0.3);
+        CHECK(pinner.pinned() == nullptr);
+        CHECK(pinner.stats().rechecks == 1);
+    }
+
+    SECTION("Checking the end of the session")
+    {
+        cfg.min_probability = 0.8;
+        cfg.timeout_s = 0.05;
+        pinner.setConfig(cfg);
+        pinner.pin("en", 0.9);
+        CHECK(pinner.pinned() != nullptr);
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        CHECK(pinner.stats().language == nullptr);
+        CHECK(pinner.pinned() == nullptr);
+
+        pinner.pin("en", 0.9);
+        CHECK(pinner.pinned() != nullptr);
+        pinner.reset();
+        CHECK(pinner.pinned() == nullptr);
+        CHECK(pinner.stats().probability == 0);
+    }
+}
+
+TEST_CASE("dev::whisperSpeechTranscription::TextPipeline", "[yarp::dev]")
+{
+    SECTION("Checking each text filter")
+    {
+        struct Case
+        {
+            const char* filter;
+            const char* input;
+            double      score;
+            const char* expected;
+        };
+        const Case cases[] = {
+            { "numbers", "twenty-one", 1.0, "21" },
+            { "numbers", "two thousand and five", 1.0, "2005" },
+            { "numbers", "one hundred twenty three", 1.0, "123" },
+            { "numbers", " I have twenty one apples.", 1.0, " I have 21 apples." },
+            { "numbers", "one more time", 1.0, "one more time" },
+            { "hallucinations", " I'm going to go. I'm going to go. I'm going to go. I'm going to go. I'm going to go. And then", 1.0, " I'm going to go. And then" },
+            { "hallucinations", " I'm going to go. I'm going to go. And then", 1.0, " I'm going to go. I'm going to go. And then" },
+            { "hallucinations", " Thank you.", 0.3, "" },
+            { "hallucinations", " Thank you.", 0.9, " Thank you." },
+            { "profanity", " Oh shit, that's FUCKING great.", 1.0, " Oh s***, that's F****** great." },
+            { "profanity", " Shitake mushrooms", 1.0, " Shitake mushrooms" },
+            { "symbols", " Hello (laughs) world *music*", 1.0, " Hello  world " },
+            { "punctuation", "hello  world .how are you", 1.0, "Hello world. How are you" },
+            { "punctuation", " It costs 3.5 dollars,ok?Yes.", 1.0, " It costs 3.5 dollars, ok? Yes." },
+            { "lowercase", " Hello, World!", 1.0, " hello world" },
+        };
+        const TextPipeline::Config cfg;
+        for (const Case& c : cases)
+        {
+            auto filter = TextPipeline::create(c.filter, cfg);
+            REQUIRE(filter != nullptr);
+            std::string text = c.input;
+            filter->apply(text, c.score);
+            INFO(c.filter << ": '" << c.input << "'");
+            CHECK(text == c.expected);
+        }
+    }
+
+    SECTION("Checking the chain of filters")
+    {
+        TextPipeline pipeline;
+        TextPipeline::Config cfg;
+        std::string error;
+        cfg.filters = { "symbols", "hallucinations", "numbers", "punctuation" };
+        REQUIRE(pipeline.configure(cfg, error));
+
+        std::string text = " I counted twenty-one  cars (coughs) .then I left";
+        pipeline.apply(text, 1.0);
+        CHECK(text == " I counted 21 cars. Then I left");
+        text = " [BLANK_AUDIO] Thank you.";
+        pipeline.apply(text, 0.3);
+        CHECK(text.empty());
+
+        //an unknown filter leaves the chain as it was
+        cfg.filters = { "symbols", "unknown" };
+        CHECK_FALSE(pipeline.configure(cfg, error));
+        CHECK(error.find("unknown") != std::string::npos);
+        CHECK(pipeline.getConfig().filters.size() == 4);
+        CHECK(TextPipeline::create("unknown", cfg) == nullptr);
+    }
+}
+
+TEST_CASE("dev::whisperSpeechTranscription::AudioRingBuffer", "[yarp::dev]")
+{
+    AudioRingBuffer ring;
+    ring.setCapacity(8);
+    const float samples[] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19 };
+    std::vector<float> out;
+
+    CHECK(ring.push(samples, 5) == 0);
+    CHECK(ring.size() == 5);
+    CHECK(ring.pop(out, 3) == 3);
+    CHECK((out == std::vector<float>{ 0, 1, 2 }));
+    CHECK(ring.size() == 2);
+
+    //the new samples wrap around the end of the buffer
+    CHECK(ring.push(samples + 5, 5) == 0);
+    CHECK(ring.size() == 7);
+    out.clear();
+    CHECK(ring.pop(out, 10) == 7);
+    CHECK((out == std::vector<float>{ 3, 4, 5, 6, 7, 8, 9 }));
+    CHECK(ring.size() == 0);
+
+    //when full, the oldest samples are dropped
+    CHECK(ring.push(samples, 6) == 0);
+    CHECK(ring.push(samples + 6, 4) == 2);
+    CHECK(ring.size() == 8);
+    CHECK(ring.discard(3) == 3);
+    out.clear();
+    CHECK(ring.pop(out, 8) == 5);
+    CHECK((out == std::vector<float>{ 5, 6, 7, 8, 9 }));
+
+    //a chunk larger than the buffer keeps its last samples
+    CHECK(ring.push(samples, 20) == 12);
+    out.clear();
+    CHECK(ring.pop(out, 8) == 8);
+    CHECK((out == std::vector<float>{ 12, 13, 14, 15, 16, 17, 18, 19 }));
+    CHECK(ring.discard(1) == 0);
+}
@@ -0,0 +1,503 @@
+/*
+ * SPDX-FileCopyrightText: 2023-2023 Istituto Italiano di Tecnologia (IIT)
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/*
+ * Offline batch transcription of WAV files with the whisperSpeechTranscription device.
+ * The input is a WAV file, a directory (searched recursively for .wav files) or a manifest, i.e. a text file with
+ * one path per line (relative to the manifest, '#' starts a comment). The files are transcribed by a pool of
+ * workers, each one with its own whisper state, and every result is appended to the output as one JSON line:
+ *   {"file": ..., "ok": true, "text": ..., "score": ..., "audio_s": ..., "elapsed_ms": ..., "rtf": ..., "blocks": ...}
+ * The files are read in blocks of at most block_s seconds, cut at the quietest frame of their last second, so
+ * that memory does not grow with the length of the recordings.
+ * Files already in the output with "ok": true are skipped, so an interrupted run (e.g. Ctrl+C, which lets the
+ * workers finish the block they are transcribing) is resumed by launching it again with the same output.
+ *
+ * Usage:
+ *   whisperBatchTranscribe --model ggml-base.en.bin --input <dir|file.wav|manifest.txt> --output results.jsonl
+ *       [--workers 2] [--block_s 300] [any other parameter of the device, e.g. --threads 4 --long_form_ms 60000]
+ * The plugin is searched in YARP_DATA_DIRS, e.g. <build>/share/yarp when running from the build tree.
+ */
+
+#include <yarp/dev/ISpeechTranscription.h>
+#include <yarp/dev/PolyDriver.h>
+#include <yarp/os/LogStream.h>
+#include <yarp/os/Network.h>
+#include <yarp/os/Property.h>
+#include <yarp/os/ResourceFinder.h>
+#include <yarp/sig/Sound.h>
+#include <yarp/sig/SoundFile.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace yarp::os;
+using namespace yarp::dev;
+namespace fs = std::filesystem;
+
+namespace {
+
+const std::string batch_prefix = "/whisperBatchTranscribe";
+constexpr double cut_search_s = 1.0;
+constexpr double cut_frame_s = 0.02;
+
+std::atomic<bool> interrupted{false};
+
+void onSignal(int)
+{
+    interrupted = true;
+}
+
+std::string jsonEscape(const std::string& str)
+{
+    std::string out;
+    for (char c : str)
+    {
+        if (c == '"' || c == '\\')
+        {
+            out += '\\';
+            out += c;
+        }
+        else if (c == '\n')
+        {
+            out += "\\n";
+        }
+        else if (c == '\r')
+        {
+            out += "\\r";
+        }
+        else if (c == '\t')
+        {
+            out += "\\t";
+        }
+        else if (static_cast<unsigned char>(c) < 0x20)
+        {
+            char code[8];
+            std::snprintf(code, sizeof(code), "\\u%04x", static_cast<unsigned char>(c));
+            out += code;
+        }
+        else
+        {
+            out += c;
+        }
+    }
+    return out;
+}
+
+// The value of the first key of a line written by this tool, i.e. {"file": "...", ...}. False if the line is truncated.
+bool parseFile(const std::string& line, std::string& file)
+{
+    const std::string key = "{\"file\": \"";
+    if (line.compare(0, key.size(), key) != 0)
+    {
+        return false;
+    }
+    file.clear();
+    for (size_t i = key.size(); i < line.size(); i++)
+    {
+        char c = line[i];
+        if (c == '"')
+        {
+            return true;
+        }
+        if (c == '\\' && i + 1 < line.size())
+        {
+            c = line[++i];
+            if (c == 'n') { c = '\n'; }
+            else if (c == 'r') { c = '\r'; }
+            else if (c == 't') { c = '\t'; }
+            else if (c == 'u')
+            {
+                // written only for control characters: a bad escape means the line is corrupted
+                unsigned code = 0;
+                for (size_t k = 1; k <= 4; k++)
+                {
+                    const char h = i + k < line.size() ? line[i + k] : '\0';
+                    if (h >= '0' && h <= '9') { code = code * 16 + unsigned(h - '0'); }
+                    else if (h >= 'a' && h <= 'f') { code = code * 16 + unsigned(h - 'a' + 10); }
+                    else if (h >= 'A' && h <= 'F') { code = code * 16 + unsigned(h - 'A' + 10); }
+                    else { return false; }
+                }
+                if (code > 0xff)
+                {
+                    return false;
+                }
+                c = char(code);
+                i += 4;
+            }
+        }
+        file += c;
+    }
+    return false;
+}
+
+// Files successfully transcribed by a previous run
+std::set<std::string> completedFiles(const std::string& output, bool& ends_with_newline)
+{
+    std::set<std::string> done;
+    ends_with_newline = true;
+    std::ifstream in(output, std::ios::binary);
+    std::string line;
+    while (std::getline(in, line))
+    {
+        std::string file;
+        if (parseFile(line, file) && line.find("\"ok\": true") != std::string::npos)
+        {
+            done.insert(file);
+        }
+        ends_with_newline = !in.eof();
+    }
+    return done;
+}
+
+bool isWav(const fs::path& path)
+{
+    std::string ext = path.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return char(std::tolower(c)); });
+    return ext == ".wav";
+}
+
+bool listInputs(const std::string& input, std::vector<std::string>& files)
+{
+    std::error_code ec;
+    const fs::path path(input);
+    if (fs::is_directory(path, ec))
+    {
+        for (fs::recursive_directory_iterator it(path, ec), end; it != end; it.increment(ec))
+        {
+            if (ec)
+            {
+                yError() << "Unable to read the directory" << input << ":" << ec.message();
+                return false;
+            }
+            if (it->is_regular_file(ec) && isWav(it->path()))
+            {
+                files.push_back(it->path().string());
+            }
+        }
+    }
+    else if (isWav(path))
+    {
+        files.push_back(path.string());
+    }
+    else
+    {
+        std::ifstream manifest(input);
+        if (!manifest)
+        {
+            yError() << "Unable to open" << input;
+            return false;
+        }
+        std::string line;
+        while (std::getline(manifest, line))
+        {
+            line.erase(std::find(line.begin(), line.end(), '#'), line.end());
+            line.erase(line.find_last_not_of(" \t\r") + 1);
+            line.erase(0, line.find_first_not_of(" \t"));
+            if (line.empty())
+            {
+                continue;
+            }
+            fs::path entry(line);
+            files.push_back(entry.is_absolute() ? entry.string() : (path.parent_path() / entry).string());
+        }
+    }
+    std::sort(files.begin(), files.end());
+    files.erase(std::unique(files.begin(), files.end()), files.end());
+    return true;
+}
+
+// Index of the middle of the quietest frame in the last cut_search_s seconds of snd, so that words are not split
+size_t quietestCut(const yarp::sig::Sound& snd)
+{
+    const size_t n = snd.getSamples();
+    const size_t rate = snd.getFrequency() > 0 ? size_t(snd.getFrequency()) : 16000;
+    const size_t frame = std::max<size_t>(1, size_t(cut_frame_s * rate));
+    const size_t search = std::min(n / 2, size_t(cut_search_s * rate));
+    size_t cut = n;
+    double min_energy = -1;
+    for (size_t f = n - search; f + frame <= n; f += frame)
+    {
+        double energy = 0;
+        for (size_t i = f; i < f + frame; i++)
+        {
+            for (size_t c = 0; c < snd.getChannels(); c++)
+            {
+                double v = snd.get(i, c);
+                energy += v * v;
+            }
+        }
+        if (min_energy < 0 || energy < min_energy)
+        {
+            min_energy = energy;
+            cut = f + frame / 2;
+        }
+    }
+    return cut;
+}
+
+struct FileResult
+{
+    bool        ok = false;
+    std::string error;
+    std::string text;
+    double      score = 0;
+    double      audio_s = 0;
+    double      elapsed_ms = 0;
+    size_t      blocks = 0;
+};
+
+// Streams the file in blocks of at most block_samples and transcribes them in order. False if interrupted.
+bool transcribeFile(ISpeechTranscription* istr, const std::string& file, size_t block_s, FileResult& result)
+{
+    auto t0 = std::chrono::steady_clock::now();
+    yarp::sig::file::soundStreamReader reader;
+    if (!reader.open(file.c_str()))
+    {
+        result.error = "unable to read the file";
+        return true;
+    }
+
+    yarp::sig::Sound pending;       // samples read but not transcribed yet
+    yarp::sig::Sound block;
+    double weighted_score = 0;
+    bool eof = false;
+    while (!eof || pending.getSamples() > 0)
+    {
+        if (interrupted)
+        {
+            reader.close();
+            return false;
+        }
+        const size_t rate = pending.getFrequency() > 0 ? size_t(pending.getFrequency()) : 16000;
+        const size_t block_samples = block_s * rate;
+        if (!eof && pending.getSamples() < block_samples)
+        {
+            size_t n = reader.readBlock(block, block_samples - pending.getSamples());
+            if (n < block.getSamples())
+            {
+                block.resize(n, block.getChannels());
+            }
+            eof = n == 0;
+            if (n > 0)
+            {
+                if (pending.getSamples() == 0)
+                {
+                    pending = block;
+                }
+                else
+                {
+                    pending += block;
+                }
+            }
+            continue;
+        }
+
+        //the block ends in a pause, the rest is kept for the next one
+        yarp::sig::Sound current;
+        if (!eof)
+        {
+            size_t cut = quietestCut(pending);
+            current = pending.subSound(0, cut);
+            pending = pending.subSound(cut, pending.getSamples());
+        }
+        else
+        {
+            current = pending;
+            pending.clear();
+        }
+        if (current.getSamples() == 0)
+        {
+            continue;
+        }
+
+        std::string text;
+        double score = 0;
+        if (!istr->transcribe(current, text, score))
+        {
+            reader.close();
+            result.error = "transcription failed at " + std::to_string(result.audio_s) + " s";
+            return true;
+        }
+        if (!text.empty())
+        {
+            //the transcriptions usually start with a space already
+            if (!result.text.empty() && text[0] != ' ')
+            {
+                result.text += ' ';
+            }
+            result.text += text;
+        }
+        weighted_score += score * current.getDuration();
+        result.audio_s += current.getDuration();
+        result.blocks++;
+    }
+    reader.close();
+
+    result.ok = true;
+    result.score = result.audio_s > 0 ? weighted_score / result.audio_s : 0;
+    result.elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    return true;
+}
+
+std::string toJson(const std::string& file, const FileResult& r)
+{
+    std::ostringstream json;
+    json << "{\"file\": \"" << jsonEscape(file) << "\", "
+         << "\"ok\": " << (r.ok ? "true" : "false") << ", ";
+    if (r.ok)
+    {
+        json << "\"text\": \"" << jsonEscape(r.text) << "\", "
+             << "\"score\": " << r.score << ", "
+             << "\"audio_s\": " << r.audio_s << ", "
+             << "\"elapsed_ms\": " << r.elapsed_ms << ", "
+             << "\"rtf\": " << (r.audio_s > 0 ? r.elapsed_ms / 1000.0 / r.audio_s : 0) << ", "
+             << "\"blocks\": " << r.blocks << "}";
+    }
+    else
+    {
+        json << "\"error\": \"" << jsonEscape(r.error) << "\"}";
+    }
+    return json.str();
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    Network yarp;
+    Network::setLocalMode(true);
+
+    ResourceFinder rf;
+    rf.setDefaultContext("whisperTranscribe_demo");
+    rf.configure(argc, argv);
+
+    std::string model = rf.check("model") ? rf.findFile(rf.find("model").asString()) : rf.findFile("ggml-base.en.bin");
+    if (model.empty() || !rf.check("input") || !rf.check("output"))
+    {
+        yError() << "Usage: whisperBatchTranscribe --model <model> --input <dir|file.wav|manifest> --output <results.jsonl> [--workers N] [--block_s 300]";
+        return 1;
+    }
+    const std::string input = rf.find("input").asString();
+    const std::string output = rf.find("output").asString();
+    const int workers = rf.check("workers") ? std::max(1, rf.find("workers").asInt32())
+                                            : std::max(1, int(std::thread::hardware_concurrency() / 4));
+    const size_t block_s = rf.check("block_s") ? size_t(std::max(1, rf.find("block_s").asInt32())) : 300;
+
+    std::vector<std::string> files;
+    if (!listInputs(input, files))
+    {
+        return 1;
+    }
+    bool ends_with_newline = true;
+    const std::set<std::string> done = completedFiles(output, ends_with_newline);
+    files.erase(std::remove_if(files.begin(), files.end(), [&done](const std::string& f) { return done.count(f) > 0; }), files.end());
+    yInfo() << done.size() << "files already transcribed," << files.size() << "to go with" << workers << "workers";
+    if (files.empty())
+    {
+        return 0;
+    }
+
+    //every parameter not used by the tool is passed to the device
+    Property cfg;
+    cfg.fromString(rf.toString());
+    cfg.unput("input");
+    cfg.unput("output");
+    cfg.unput("workers");
+    cfg.unput("block_s");
+    cfg.put("device", "whisperSpeechTranscription");
+    cfg.put("model", model);
+    cfg.put("name", batch_prefix);
+    cfg.put("states", workers);
+    cfg.put("queue_depth", 0);
+    PolyDriver dd;
+    ISpeechTranscription* istr = nullptr;
+    if (!dd.open(cfg) || !dd.view(istr))
+    {
+        yError() << "Unable to open the device with the model" << model;
+        return 1;
+    }
+
+    std::ofstream out(output, std::ios::app | std::ios::binary);
+    if (!out)
+    {
+        yError() << "Unable to open" << output;
+        return 1;
+    }
+    if (!ends_with_newline)
+    {
+        //the last line was truncated by an interruption
+        out << "\n";
+    }
+
+    std::signal(SIGINT, onSignal);
+    std::signal(SIGTERM, onSignal);
+
+    std::mutex out_mutex;
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> completed{0};
+    std::atomic<size_t> failed{0};
+    double total_audio_s = 0;
+    auto t_start = std::chrono::steady_clock::now();
+
+    auto worker = [&]()
+    {
+        for (size_t i = next++; i < files.size() && !interrupted; i = next++)
+        {
+            FileResult result;
+            if (!transcribeFile(istr, files[i], block_s, result))
+            {
+                break;
+            }
+            std::lock_guard<std::mutex> lock(out_mutex);
+            out << toJson(files[i], result) << "\n";
+            out.flush();
+            completed++;
+            if (result.ok)
+            {
+                total_audio_s += result.audio_s;
+                yInfo() << "[" << completed.load() << "/" << files.size() << "]" << files[i]
+                        << result.audio_s << "s in" << result.elapsed_ms << "ms";
+            }
+            else
+            {
+                failed++;
+                yWarning() << "[" << completed.load() << "/" << files.size() << "]" << files[i] << ":" << result.error;
+            }
+        }
+    };
+    std::vector<std::thread> threads;
+    for (int w = 0; w < workers; w++)
+    {
+        threads.emplace_back(worker);
+    }
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+    out.close();
+    dd.close();
+
+    double elapsed_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count();
+    yInfo() << completed.load() << "files," << failed.load() << "failed," << total_audio_s << "s of audio in"
+            << elapsed_s << "s (" << (elapsed_s > 0 ? total_audio_s / elapsed_s : 0) << "x real time)";
+    if (interrupted)
+    {
+        yWarning() << "Interrupted, run again with the same output to resume";
+        return 2;
+    }
+    return failed > 0 ? 1 : 0;
+}
@@ -8,26 +8,49 @@
 #include <yarp/os/Log.h>
 #include <yarp/os/LogStream.h>
 #include <yarp/os/LogComponent.h>
+#include <yarp/os/ConnectionReader.h>
+#include <yarp/os/ConnectionWriter.h>
 
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <algorithm>
 #include <thread>
-#include <regex>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <sstream>
+#include <atomic>
 
 using namespace yarp::os;
 using namespace yarp::dev;
 
 namespace {
 YARP_LOG_COMPONENT(WHISPER_SPEECHTR, "yarp.device.WhisperSpeechTranscription")
+// whisper_full() silently ignores inputs shorter than one second
+constexpr size_t min_input_samples = WHISPER_SAMPLE_RATE + WHISPER_SAMPLE_RATE / 10;
+using stats_clock = std::chrono::steady_clock;
+double elapsedMs(stats_clock::time_point since)
+{
+    return std::chrono::duration<double, std::milli>(stats_clock::now() - since).count();
+}
+
+// silence inserted between the utterances of a batch, so that whisper splits them into different segments
+constexpr size_t batch_gap_samples = WHISPER_SAMPLE_RATE;
+
+// whisper timestamps are in units of 10 ms
+constexpr double timestamp_s = 0.01;
+
+// the language is detected on the first encoder window only
+constexpr size_t language_window_samples = size_t(WHISPER_CHUNK_SIZE) * WHISPER_SAMPLE_RATE;
 }
 
 WhisperSpeechTranscription::WhisperSpeechTranscription()
 {
    m_language = "en";
-   m_wparams.language=m_language.c_str();
    m_wparams = whisper_full_default_params(WHISPER_SAMPLING_GREEDY);
    m_model = "ggml-base.en.bin";
+   m_queueCfg.depth = 0;
 }
 
 WhisperSpeechTranscription::~WhisperSpeechTranscription()
@@ -40,9 +63,18 @@ bool WhisperSpeechTranscription::open(yarp::os::Searchable& config)
     if (config.check("threads","number of threads")){
         m_wparams.n_threads = config.find("threads").asInt16();}
     if (config.check("processors", "number of processors")){
-        m_wparams.n_threads = config.find("processors").asInt16();}
+        n_processors = std::max(1, int(config.find("processors").asInt16()));}
+    LongFormSplitter::Config split_cfg;
+    if (config.check("long_form_ms", "recordings longer than this are transcribed in concurrent chunks, 0 = disabled")) {
+        m_longFormMin = std::max(0, config.find("long_form_ms").asInt32()) / 1000.0;}
+    if (config.check("chunk_ms", "long-form mode: maximum length of a chunk")) {
+        split_cfg.chunk_s = config.find("chunk_ms").asInt32() / 1000.0;}
+    if (config.check("chunk_overlap_ms", "long-form mode: audio shared by two consecutive chunks")) {
+        split_cfg.overlap_s = config.find("chunk_overlap_ms").asInt32() / 1000.0;}
+    m_splitter.setConfig(split_cfg);
     if (config.check("initial_prompt")) {
-        m_wparams.initial_prompt = config.find("initial_prompt").asString().c_str();}
+        m_initialPrompt = config.find("initial_prompt").asString();
+        m_wparams.initial_prompt = m_initialPrompt.c_str();}
     if (config.check("duration","duration of audio to process in milliseconds")) {
         m_wparams.duration_ms = config.find("duration").asInt32();}
     if (config.check("offset_ms")) {
@@ -59,10 +91,41 @@ bool WhisperSpeechTranscription::open(yarp::os::Searchable& config)
         m_wparams.logprob_thold = config.find("print_timestamps").asFloat32();}
     if (config.check("model", "file containing the model")) {
         m_model = config.find("model").asString();}
+    if (config.check("model_variants", "variants of the main model, the one that best fits the host replaces model")) {
+        yarp::os::Bottle* variants = config.find("model_variants").asList();
+        for (size_t i = 0; variants && i < variants->size(); i++) {
+            m_modelVariants.push_back(variants->get(i).asString());}
+    }
+    if (config.check("model_min_accuracy", "model variants less accurate than this weight type are never chosen")) {
+        m_selectorCfg.min_accuracy = config.find("model_min_accuracy").asString();
+        if (ModelSelector::accuracyOf(m_selectorCfg.min_accuracy) < 0)
+        {
+            yCError(WHISPER_SPEECHTR) << "Invalid value for parameter model_min_accuracy:" << m_selectorCfg.min_accuracy;
+            return false;
+        }
+    }
+    if (config.check("model_max_memory_mb", "memory available to the model variant and its states, 0 = available on the host")) {
+        m_selectorCfg.max_memory_bytes = size_t(std::max(0, config.find("model_max_memory_mb").asInt32())) * 1024 * 1024;}
+    if (config.check("model_short", "model used for short utterances")) {
+        m_modelShort = config.find("model_short").asString();}
+    if (config.check("model_multilingual", "model used for the languages not supported by model")) {
+        m_modelMultilingual = config.find("model_multilingual").asString();}
+    if (config.check("short_max_ms", "maximum duration of the utterances served by model_short")) {
+        m_router.setShortMax(config.find("short_max_ms").asInt32() / 1000.0);}
+    if (config.check("model_mmap", "read the model through a memory mapping of the file")) {
+        m_modelMmap = config.find("model_mmap").asBool();}
+    if (config.check("use_gpu", "run the models on the GPU, if whisper was built with a GPU backend")) {
+        m_useGpu = config.find("use_gpu").asBool();}
+    if (config.check("warmup", "run an inference on silence at open")) {
+        m_warmup = config.find("warmup").asBool();}
     if (config.check("translate", "translate from source language to English")) {
         m_wparams.translate = config.find("translate").asBool();}
-//    if (config.check("diarize", "stereo audio diarization")) {
-//        m_wparams.diarize = config.find("diarize").asBool();}
+    if (config.check("diarize", "multichannel audio diarization")) {
+        m_diarize = config.find("diarize").asBool();}
+    if (config.check("tdrz", "speaker turn detection, requires a tinydiarize model")) {
+        m_wparams.tdrz_enable = config.find("tdrz").asBool();}
+    if (config.check("speaker_labels", "prefix the text of each speaker with its label")) {
+        m_speakerLabels = config.find("speaker_labels").asBool();}
     if(config.check("print_realtime", "print_realtime")) {
         m_wparams.print_realtime = config.find("print_realtime").asBool();}
     if(config.check("print_progress", "print_progress")) {
@@ -71,12 +134,10 @@ bool WhisperSpeechTranscription::open(yarp::os::Searchable& config)
         m_wparams.split_on_word = config.find("split_on_word").asBool();}
     if (config.check("best_of", "number of best candidates to keep")) {
         m_wparams.greedy.best_of = config.find("best_of").asInt32();}
-    if (config.check("detect-language", "exit after automatically detecting language")) {
+    if (config.check("detect-language", "detect the spoken language, same as language auto")) {
         m_wparams.detect_language = config.find("detect-language").asBool();}
     if (config.check("language", "spoken language ('auto' for auto-detect)")) {
-        m_wparams.language = config.find("language").asString().c_str();
-        m_language = m_wparams.language;//???
-    }
+        m_language = config.find("language").asString();}
     if (config.check("beam_size", " beam size for beam search")) {
         m_wparams.beam_search.beam_size = config.find("beam_size").asInt32();
         m_wparams.strategy = m_wparams.beam_search.beam_size > 1 ? WHISPER_SAMPLING_BEAM_SEARCH : WHISPER_SAMPLING_GREEDY;
@@ -92,11 +153,203 @@ bool WhisperSpeechTranscription::open(yarp::os::Searchable& config)
         no_fallback = config.find("no-fallback").asBool();}
     if (config.check("remove_symbols","remove [] symbols from the text transcript")) {
         m_no_symbols = config.find("remove_symbols").asBool();}
+    TextPipeline::Config text_cfg;
+    text_cfg.filters.clear();
+    if (config.check("text_filters", "chain of filters applied to the transcription")) {
+        const yarp::os::Value& filters = config.find("text_filters");
+        for (size_t i = 0; filters.isList() && i < filters.asList()->size(); i++) {
+            text_cfg.filters.push_back(filters.asList()->get(i).asString());}
+        if (filters.isString()) {
+            text_cfg.filters.push_back(filters.asString());}
+    }
+    else if (m_no_symbols) {
+        text_cfg.filters.push_back("symbols");}
+    if (config.check("hallucination_max_repeats", "text filter hallucinations: repetitions of a sequence of words kept")) {
+        text_cfg.max_repeats = config.find("hallucination_max_repeats").asInt32();}
+    if (config.check("hallucination_score", "text filter hallucinations: the phrases typical of silence are dropped below this score")) {
+        text_cfg.hallucination_score = config.find("hallucination_score").asFloat64();}
+    if (config.check("profanity_words", "text filter profanity: words masked")) {
+        const yarp::os::Value& words = config.find("profanity_words");
+        for (size_t i = 0; words.isList() && i < words.asList()->size(); i++) {
+            text_cfg.profanity.push_back(words.asList()->get(i).asString());}
+    }
+    {
+        std::string error;
+        if (!m_textPipeline.configure(text_cfg, error))
+        {
+            yCError(WHISPER_SPEECHTR) << "Invalid value for parameter text_filters:" << error;
+            return false;
+        }
+    }
+    if (config.check("result_details", "keep segments and words of the last request for the rpc command last_result")) {
+        m_resultDetails = config.find("result_details").asBool();}
+    if (config.check("downmix", "multichannel to mono policy: first, average, select")) {
+        AudioFrontEnd::Downmix downmix;
+        if (!AudioFrontEnd::parseDownmix(config.find("downmix").asString(), downmix))
+        {
+            yCError(WHISPER_SPEECHTR) << "Invalid value for parameter downmix:" << config.find("downmix").asString();
+            return false;
+        }
+        m_frontEnd.setDownmix(downmix);
+    }
+    if (config.check("downmix_channel", "channel used when downmix=select")) {
+        const int channel = config.find("downmix_channel").asInt32();
+        if (channel < 0)
+        {
+            yCError(WHISPER_SPEECHTR) << "Invalid value for parameter downmix_channel:" << channel;
+            return false;
+        }
+        m_frontEnd.setChannel(channel);
+    }
+    m_frontEnd.setTargetRate(WHISPER_SAMPLE_RATE);
+    if (config.check("states", "number of whisper states, i.e. of requests processed concurrently")) {
+        m_nStates = std::max(1, config.find("states").asInt32());}
+    if (config.check("name", "prefix of the ports opened by the device")) {
+        m_name = config.find("name").asString();}
+    StreamingTranscriber::Config stream_cfg;
+    if (config.check("streaming", "enable the sliding-window streaming mode")) {
+        m_streaming = config.find("streaming").asBool();}
+    if (config.check("shm_input", "streaming mode: read the audio from this shared-memory ring written by a local producer")) {
+        m_shmInput = config.find("shm_input").asString();
+        m_streaming = true;}
+    if (config.check("step_ms", "streaming mode: audio step between two inferences")) {
+        stream_cfg.step_ms = config.find("step_ms").asInt32();}
+    if (config.check("length_ms", "streaming mode: length of the inference window")) {
+        stream_cfg.length_ms = config.find("length_ms").asInt32();}
+    if (config.check("keep_ms", "streaming mode: audio kept from the previous window")) {
+        stream_cfg.keep_ms = config.find("keep_ms").asInt32();}
+    if (config.check("buffer_ms", "streaming mode: capacity of the buffer of pending audio")) {
+        stream_cfg.buffer_ms = config.find("buffer_ms").asInt32();}
+    if (config.check("queue_depth", "max number of requests waiting for a worker, 0 = no queue")) {
+        m_queueCfg.depth = std::max(0, config.find("queue_depth").asInt32());}
+    if (config.check("queue_policy", "what to do when the queue is full: reject, drop_oldest")) {
+        if (!TranscriptionQueue::parsePolicy(config.find("queue_policy").asString(), m_queueCfg.policy))
+        {
+            yCError(WHISPER_SPEECHTR) << "Invalid value for parameter queue_policy:" << config.find("queue_policy").asString();
+            return false;
+        }
+    }
+    if (config.check("queue_max_wait_ms", "requests waiting longer than this are discarded, 0 = no limit")) {
+        m_queueCfg.max_wait_s = config.find("queue_max_wait_ms").asInt32() / 1000.0;}
+    if (config.check("batch_window_ms", "short utterances arriving within this window are batched, 0 = disabled")) {
+        m_queueCfg.batch_window_s = config.find("batch_window_ms").asInt32() / 1000.0;}
+    if (config.check("batch_max_utterance_ms", "only utterances shorter than this are batched")) {
+        m_queueCfg.batch_max_utterance_s = config.find("batch_max_utterance_ms").asInt32() / 1000.0;}
+    if (config.check("batch_max_total_ms", "maximum audio duration of a batch")) {
+        m_queueCfg.batch_max_total_s = config.find("batch_max_total_ms").asInt32() / 1000.0;}
+    VoiceActivityDetector::Config vad_cfg;
+    if (config.check("vad", "skip silent buffers and trim leading/trailing silence")) {
+        m_vadEnabled = config.find("vad").asBool();}
+    if (config.check("vad_energy_thold", "VAD: minimum frame energy (dBFS) to be classified as speech")) {
+        vad_cfg.energy_thold_db = config.find("vad_energy_thold").asFloat32();}
+    if (config.check("vad_zcr_thold", "VAD: maximum zero-crossing rate of a speech frame")) {
+        vad_cfg.zcr_thold = config.find("vad_zcr_thold").asFloat32();}
+    if (config.check("vad_min_speech_ms", "VAD: minimum amount of speech required to run the inference")) {
+        vad_cfg.min_speech_ms = config.find("vad_min_speech_ms").asInt32();}
+    if (config.check("vad_padding_ms", "VAD: silence kept before and after the detected speech")) {
+        vad_cfg.padding_ms = config.find("vad_padding_ms").asInt32();}
+    m_vad.setConfig(vad_cfg);
+    if (config.check("commands", "file with the list of commands, enables the command mode")) {
+        m_commandsFile = config.find("commands").asString();
+        if (!m_commands.loadFile(m_commandsFile)) {
+            return false;}
+    }
+    if (config.check("command_mode", "command mode: score or grammar")) {
+        if (!CommandRecognizer::parseMode(config.find("command_mode").asString(), m_commandMode))
+        {
+            yCError(WHISPER_SPEECHTR) << "Invalid value for parameter command_mode:" << config.find("command_mode").asString();
+            return false;
+        }
+    }
+    if (config.check("command_min_prob", "command mode: commands recognized with a lower probability are discarded")) {
+        m_commandMinProb = config.find("command_min_prob").asFloat64();}
+    if (config.check("command_min_confidence", "command mode: commands whose tokens have a lower mean probability are discarded")) {
+        m_commandMinConfidence = config.find("command_min_confidence").asFloat64();}
+    if (config.check("grammar_penalty", "command mode: logit penalty of the tokens not allowed by the grammar")) {
+        m_grammarPenalty = config.find("grammar_penalty").asFloat32();}
+    KeywordSpotter::Config keyword_cfg;
+    if (config.check("keywords", "wake words: only the utterances beginning with one of them are transcribed")) {
+        const yarp::os::Value& keywords = config.find("keywords");
+        for (size_t i = 0; keywords.isList() && i < keywords.asList()->size(); i++) {
+            keyword_cfg.keywords.push_back(keywords.asList()->get(i).asString());}
+        if (keywords.isString()) {
+            keyword_cfg.keywords.push_back(keywords.asString());}
+    }
+    if (config.check("keyword_window_ms", "wake words: audio at the beginning of the utterance searched for them")) {
+        keyword_cfg.window_ms = size_t(std::max(100, config.find("keyword_window_ms").asInt32()));}
+    if (config.check("keyword_min_similarity", "wake words: minimum similarity between the heard text and a keyword")) {
+        keyword_cfg.min_similarity = config.find("keyword_min_similarity").asFloat64();}
+    if (config.check("keyword_model", "wake words: model used to search them")) {
+        m_keywordModelPath = config.find("keyword_model").asString();}
+    m_spotter.setConfig(keyword_cfg);
+    ConversationContext::Config context_cfg;
+    if (config.check("context_tokens", "conversation mode: tokens of the previous transcriptions used as prompt, 0 = disabled")) {
+        context_cfg.max_tokens = size_t(std::max(0, config.find("context_tokens").asInt32()));}
+    if (config.check("context_timeout_ms", "conversation mode: the history is forgotten after this time without requests")) {
+        context_cfg.timeout_s = config.find("context_timeout_ms").asInt32() / 1000.0;}
+    m_context.setConfig(context_cfg);
+    LanguagePinner::Config pinner_cfg;
+    if (config.check("language_pin_prob", "language auto: the language detected with at least this probability is pinned for the session, 0 = disabled")) {
+        pinner_cfg.min_probability = config.find("language_pin_prob").asFloat64();}
+    if (config.check("language_recheck_score", "language pinning: a request with a lower score drops the pin")) {
+        pinner_cfg.recheck_score = config.find("language_recheck_score").asFloat64();}
+    if (config.check("language_session_ms", "language pinning: the pin is dropped after this time without requests")) {
+        pinner_cfg.timeout_s = std::max(0, config.find("language_session_ms").asInt32()) / 1000.0;}
+    m_pinner.setConfig(pinner_cfg);
+    if (config.check("latency_budget_ms", "latency budget of a request, 0 = disabled")) {
+        DecodingPolicy::Config policy_cfg;
+        policy_cfg.budget_s = std::max(0, config.find("latency_budget_ms").asInt32()) / 1000.0;
+        m_policy.setConfig(policy_cfg);
+    }
+    if (config.check("cache_size", "number of transcriptions kept in the cache, 0 = disabled")) {
+        m_cache.setCapacity(size_t(std::max(0, config.find("cache_size").asInt32())));}
+    if (config.check("cache_file", "file where the cache is loaded from at open and saved to at close")) {
+        m_cacheFile = config.find("cache_file").asString();}
+    if (config.check("metrics_port", "publish the figures of each request on <name>/metrics:o")) {
+        m_metricsPort = config.find("metrics_port").asBool();}
+    if (config.check("metrics_window", "number of requests over which the rolling percentiles are computed")) {
+        m_metrics.setWindow(std::max(1, config.find("metrics_window").asInt32()));}
     m_wparams.n_max_text_ctx = max_context >= 0 ? max_context : m_wparams.n_max_text_ctx;
-    m_wparams.token_timestamps = false || max_len > 0;
+    bool token_timestamps = false;
+    if (config.check("token_timestamps", "compute the timestamps of the tokens")) {
+        token_timestamps = config.find("token_timestamps").asBool();}
+    m_wparams.token_timestamps = token_timestamps || max_len > 0;
     m_wparams.max_len = false && max_len == 0 ? 60 : max_len;
     m_wparams.temperature_inc = no_fallback ? 0.0f : m_wparams.temperature_inc;
 
+    {
+        std::ostringstream sig;
+        sig << m_wparams.strategy << ' ' << m_wparams.greedy.best_of << ' ' << m_wparams.beam_search.beam_size << ' '
+            << m_wparams.temperature << ' ' << m_wparams.temperature_inc << ' '
+            << m_wparams.entropy_thold << ' ' << m_wparams.logprob_thold << ' '
+            << m_wparams.n_max_text_ctx << ' ' << m_wparams.max_len << ' ' << m_wparams.split_on_word << ' '
+            << m_wparams.offset_ms << ' ' << m_wparams.duration_ms << ' '
+            << m_no_symbols << ' ' << text_cfg.max_repeats << ' ' << text_cfg.hallucination_score << ' '
+            << m_vadEnabled << ' ' << m_initialPrompt << ' '
+            << m_commandsFile << ' ' << int(m_commandMode) << ' ' << m_commandMinProb << ' ' << m_commandMinConfidence << ' ' << m_grammarPenalty << ' '
+            << m_longFormMin << ' ' << split_cfg.chunk_s << ' ' << split_cfg.overlap_s << ' '
+            << m_diarize << ' ' << m_wparams.tdrz_enable << ' ' << m_speakerLabels << ' ' << int(m_frontEnd.getDownmix());
+        for (const auto& filter : text_cfg.filters)
+        {
+            sig << ' ' << filter;
+        }
+        for (const auto& word : text_cfg.profanity)
+        {
+            sig << ' ' << word;
+        }
+        //the wake words decide whether the utterance is transcribed at all
+        sig << ' ' << keyword_cfg.window_ms << ' ' << keyword_cfg.min_similarity << ' ' << m_keywordModelPath;
+        for (const auto& keyword : keyword_cfg.keywords)
+        {
+            sig << '|' << keyword;
+        }
+        m_paramsSignature = sig.str();
+    }
+    if (m_cache.isEnabled() && !m_cacheFile.empty())
+    {
+        m_cache.load(m_cacheFile);
+    }
+
     if (m_language != "auto" && whisper_lang_id(m_language.c_str()) == -1)
     {
         yCError(WHISPER_SPEECHTR, "error: unknown language '%s'\n", m_language.c_str());
@@ -109,13 +362,35 @@ bool WhisperSpeechTranscription::open(yarp::os::Searchable& config)
         yCError(WHISPER_SPEECHTR, "Please provide full path to the model file with parameter --model\n");
         return false;
     }
-    m_ctx = whisper_init_from_file(m_model.c_str());
-    if (m_ctx == nullptr)
+    if (m_wparams.detect_language)
+    {
+        //in whisper_full the flag stops the inference after the detection, leaving no transcription
+        m_language = "auto";
+        m_wparams.detect_language = false;
+    }
+    if (!m_modelVariants.empty() && !selectModelVariant())
+    {
+        return false;
+    }
+    if (!loadModel(ModelRouter::Route::main, m_model) ||
+        (!m_modelShort.empty() && !loadModel(ModelRouter::Route::short_utterance, m_modelShort)) ||
+        (!m_modelMultilingual.empty() && !loadModel(ModelRouter::Route::multilingual, m_modelMultilingual)))
     {
         yCError(WHISPER_SPEECHTR, "Failed to initialize whisper context\n");
+        close();
         return false;
     }
 
+    if (m_spotter.isEnabled() && !m_keywordModelPath.empty())
+    {
+        m_keywordModel = ModelInstance::create(m_keywordModelPath, m_nStates, m_frontEnd, m_modelMmap, m_useGpu);
+        if (!m_keywordModel)
+        {
+            close();
+            return false;
+        }
+    }
+
     // print system information
     {
         yCInfo(WHISPER_SPEECHTR, "system_info: n_threads = %d / %d | %s\n",
@@ -124,56 +399,269 @@ bool WhisperSpeechTranscription::open(yarp::os::Searchable& config)
 
     // print some info about the processing
     {
-        if (!whisper_is_multilingual(m_ctx))
+        //the language of each request is applied by requestParams()
+        if (!m_router.get(ModelRouter::Route::main)->multilingual && !m_router.get(ModelRouter::Route::multilingual))
         {
-            if (m_wparams.language != "en" || m_wparams.translate)
+            if (m_language != "en" || m_wparams.translate)
             {
-                m_wparams.language = "en";
-                m_wparams.translate = false;
                 yCWarning(WHISPER_SPEECHTR,"model is not multilingual, ignoring language and translation options");
             }
         }
-        if (m_wparams.detect_language)
-        {
-            m_wparams.language = "auto";
-        }
-        yCDebug(WHISPER_SPEECHTR, "%s: processing (%d samples, %.1f sec), %d threads, %d processors, lang = %s, task = %s, timestamps = %d ...\n",
-            __func__, int(m_pcmf32.size()), float(m_pcmf32.size()) / WHISPER_SAMPLE_RATE,
+        yCDebug(WHISPER_SPEECHTR, "%s: %d states, %d threads, %d processors, lang = %s, task = %s, timestamps = %d ...\n",
+            __func__, int(m_nStates),
             m_wparams.n_threads, n_processors,
-            m_wparams.language,
+            m_language.c_str(),
             m_wparams.translate ? "translate" : "transcribe",
             m_wparams.print_timestamps);
     }
+
+    if (m_queueCfg.depth > 0)
+    {
+        m_queueCfg.workers = m_nStates;
+        if (!m_queue.start(m_queueCfg, [this](std::vector<TranscriptionJob*>& batch) { processBatch(batch); }))
+        {
+            yCError(WHISPER_SPEECHTR) << "Unable to start the request queue";
+            close();
+            return false;
+        }
+    }
+
+    if (!m_rpcPort.open(m_name + "/rpc"))
+    {
+        yCError(WHISPER_SPEECHTR) << "Unable to open the rpc port" << m_name + "/rpc";
+        close();
+        return false;
+    }
+    m_rpcPort.setReader(*this);
+
+    if (!m_alignmentPort.open(m_name + "/alignment:o"))
+    {
+        yCError(WHISPER_SPEECHTR) << "Unable to open the alignment port" << m_name + "/alignment:o";
+        close();
+        return false;
+    }
+
+    if (m_metricsPort && !m_metrics.openPort(m_name + "/metrics:o"))
+    {
+        close();
+        return false;
+    }
+
+    if (m_streaming)
+    {
+        // same settings of the stream example: one segment per window, no context between windows
+        m_streamParams = m_wparams;
+        m_streamParams.print_progress = false;
+        m_streamParams.single_segment = true;
+        m_streamParams.no_context = true;
+
+        m_streamer = std::make_unique<StreamingTranscriber>(
+            [this](const std::vector<float>& pcm, std::string& text, double& score)
+            {
+                if (m_vadEnabled && !m_vad.containsSpeech(pcm))
+                {
+                    text.clear();
+                    score = 0;
+                    return true;
+                }
+                const double duration_s = double(pcm.size()) / WHISPER_SAMPLE_RATE;
+                const std::string language = currentLanguage();
+                auto model = m_router.select(duration_s, language);
+                auto slot = model->pool.acquire();
+                auto t_start = stats_clock::now();
+                slot->stats = InferenceStats();
+                slot->stats.audio_s = duration_s;
+                bool ok = runInference(*slot, pcm, requestParams(m_streamParams, *model, language), text, score);
+                slot->stats.total_ms = elapsedMs(t_start);
+                if (ok) { recordStats(slot->stats); }
+                return ok;
+            },
+            m_frontEnd);
+        if (!m_shmInput.empty())
+        {
+            m_streamer->setSharedInput(m_shmInput);
+        }
+        if (!m_streamer->configure(stream_cfg) ||
+            !m_streamer->openPorts(m_name) ||
+            !m_streamer->start())
+        {
+            yCError(WHISPER_SPEECHTR) << "Unable to start the streaming mode";
+            m_streamer.reset();
+            close();
+            return false;
+        }
+    }
     return true;
 }
 
 bool WhisperSpeechTranscription::close()
 {
-    if (m_ctx)
+    if (m_streamer)
+    {
+        m_streamer->stop();
+        m_streamer->closePorts();
+        m_streamer.reset();
+    }
+    m_rpcPort.interrupt();
+    m_rpcPort.close();
+    m_queue.stop();
+    m_metrics.closePort();
+    m_alignmentPort.interrupt();
+    m_alignmentPort.close();
+    //a model is freed when the last device using it is closed
+    m_router.clear();
+    m_keywordModel.reset();
+    if (m_cache.isEnabled() && !m_cacheFile.empty())
+    {
+        m_cache.save(m_cacheFile);
+        m_cacheFile.clear();
+    }
+    return true;
+}
+
+bool WhisperSpeechTranscription::selectModelVariant()
+{
+    std::vector<ModelSelector::Variant> variants(m_modelVariants.size());
+    for (size_t i = 0; i < m_modelVariants.size(); i++)
+    {
+        if (!ModelSelector::readVariant(m_modelVariants[i], variants[i]))
+        {
+            yCWarning(WHISPER_SPEECHTR) << "Unable to read the header of the model variant" << m_modelVariants[i];
+        }
+    }
+    m_selectorCfg.n_states = m_longFormMin > 0 ? std::max(m_nStates, size_t(n_processors)) : m_nStates;
+    const ModelSelector::CpuFeatures cpu = ModelSelector::detectCpu();
+    std::string reason;
+    int chosen = ModelSelector::select(variants, cpu, m_selectorCfg, ModelSelector::availableMemory(), reason);
+    if (chosen < 0)
+    {
+        yCError(WHISPER_SPEECHTR) << "No usable model variant:" << reason;
+        return false;
+    }
+    m_model = variants[chosen].path;
+    yCInfo(WHISPER_SPEECHTR) << "Model variant" << m_model << ":" << reason << "|" << cpu.toString();
+    return true;
+}
+
+bool WhisperSpeechTranscription::loadModel(ModelRouter::Route route, const std::string& path)
+{
+    if (path.empty())
+    {
+        yCError(WHISPER_SPEECHTR) << "No model file for route" << ModelRouter::routeName(route);
+        return false;
+    }
+    auto t_start = stats_clock::now();
+    //a long-form request can use up to n_processors states
+    const size_t n_states = m_longFormMin > 0 ? std::max(m_nStates, size_t(n_processors)) : m_nStates;
+    auto instance = ModelInstance::create(path, n_states, m_frontEnd, m_modelMmap, m_useGpu);
+    if (!instance)
+    {
+        return false;
+    }
+    if (m_warmup && !warmUp(*instance))
     {
-        whisper_free(m_ctx);
-        m_ctx=nullptr;
+        yCError(WHISPER_SPEECHTR) << "Warm-up inference failed";
+        return false;
     }
+    m_router.set(route, instance);
+    yCInfo(WHISPER_SPEECHTR) << "Route" << ModelRouter::routeName(route) << "served by" << path
+                             << (instance->multilingual ? "(multilingual)" : "(English only)")
+                             << "- ready in" << elapsedMs(t_start) << "ms";
+    return true;
+}
+
+bool WhisperSpeechTranscription::warmUp(ModelInstance& model)
+{
+    auto t_start = stats_clock::now();
+    const std::string language = currentLanguage();
+    whisper_full_params params = requestParams(m_wparams, model, language);
+    params.print_progress = false;
+    params.no_context = true;
+    params.single_segment = true;
+    std::vector<float> silence(min_input_samples, 0.0f);
+
+    //all the slots are leased at the same time, so that each state is used once
+    std::vector<WhisperStatePool::Lease> slots;
+    for (size_t i = 0; i < model.pool.size(); i++)
+    {
+        slots.push_back(model.pool.acquire());
+    }
+    for (auto& slot : slots)
+    {
+        if (!runWhisper(*slot, silence, params))
+        {
+            return false;
+        }
+    }
+    yCInfo(WHISPER_SPEECHTR) << "Warm-up of" << slots.size() << "states completed in" << elapsedMs(t_start) << "ms";
     return true;
 }
 
 ReturnValue WhisperSpeechTranscription::setLanguage(const std::string& language)
 {
-    m_language=language;
+    if (language != "auto" && whisper_lang_id(language.c_str()) == -1)
+    {
+        yCError(WHISPER_SPEECHTR) << "Unknown language" << language;
+        return ReturnValue::return_code::return_value_error_method_failed;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_languageMutex);
+        m_language=language;
+    }
+    //a new language, or a new detection
+    m_pinner.reset();
+    auto model = m_router.select(std::numeric_limits<double>::max(), language);
+    if (model && !model->multilingual && language != "en")
+    {
+        yCWarning(WHISPER_SPEECHTR) << "No multilingual model loaded, the transcription will be in English";
+    }
     yCInfo(WHISPER_SPEECHTR) << "Language set to" << language;
     return ReturnValue_ok;
 }
 
 ReturnValue WhisperSpeechTranscription::getLanguage(std::string& language)
 {
-    language = m_language;
+    language = currentLanguage();
     return ReturnValue_ok;
 }
 
-ReturnValue WhisperSpeechTranscription::transcribe(const yarp::sig::Sound& sound, std::string& transcription, double& score)
+std::string WhisperSpeechTranscription::currentLanguage() const
+{
+    std::lock_guard<std::mutex> lock(m_languageMutex);
+    return m_language;
+}
+
+std::string WhisperSpeechTranscription::requestLanguage()
+{
+    std::string language = currentLanguage();
+    if (language == "auto" && m_pinner.isEnabled())
+    {
+        const char* pinned = m_pinner.pinned();
+        if (pinned)
+        {
+            language = pinned;
+        }
+    }
+    return language;
+}
+
+whisper_full_params WhisperSpeechTranscription::requestParams(const whisper_full_params& base, const ModelInstance& model, const std::string& language) const
 {
-    yCDebug(WHISPER_SPEECHTR)<< "received audio" << sound.getSamples();
+    whisper_full_params params = base;
+    if (model.multilingual)
+    {
+        params.language = language.c_str();
+    }
+    else
+    {
+        params.language = "en";
+        params.translate = false;
+    }
+    return params;
+}
 
+ReturnValue WhisperSpeechTranscription::transcribe(const yarp::sig::Sound& sound, std::string& transcription, double& score)
+{
     score=0;
     transcription="";
 
@@ -184,49 +672,1115 @@ ReturnValue WhisperSpeechTranscription::transcribe(const yarp::sig::Sound& sound
         return ReturnValue::return_code::return_value_error_method_failed;
     }
 
-    //copy the audio data;
-#if 0
-    m_pcmf32.resize(1000);
-    m_pcmf32s.clear();
-#else
-    m_pcmf32.resize(sound.getSamples());
-    size_t channel=0;
-    for (size_t i = 0; i < m_pcmf32.size(); i++)
+    if (!m_router.get(ModelRouter::Route::main))
     {
-        m_pcmf32[i]=float(sound.get(i, channel))/65535.0;
+        yCError(WHISPER_SPEECHTR) << "Device not opened";
+        return ReturnValue::return_code::return_value_error_not_ready;
     }
-    m_pcmf32s.clear();
-#endif
 
-    // run the inference
+    if (m_streamer)
     {
-        if (whisper_full_parallel(m_ctx, m_wparams, m_pcmf32.data(), m_pcmf32.size(), n_processors) != 0)
+        //streaming mode: the chunk is queued and the latest hypothesis is returned
+        if (!m_streamer->push(sound))
         {
-            yCError(WHISPER_SPEECHTR, "failed to process audio");
             return ReturnValue::return_code::return_value_error_method_failed;
         }
+        m_streamer->getHypothesis(transcription, score);
+        return ReturnValue_ok;
+    }
+
+    if (sound.getFrequency() <= 0)
+    {
+        yCWarning(WHISPER_SPEECHTR) << "Sound has no sample rate, assuming" << WHISPER_SAMPLE_RATE << "Hz";
+    }
+    const double duration_s = double(sound.getSamples()) / (sound.getFrequency() > 0 ? sound.getFrequency() : WHISPER_SAMPLE_RATE);
+
+    if (m_queue.isRunning())
+    {
+        //the request is served by a worker thread, this thread only waits for the result
+        TranscriptionJob job;
+        job.sound = &sound;
+        job.duration_s = duration_s;
+        m_queue.submitAndWait(job);
+        switch (job.status)
+        {
+        case TranscriptionJob::Status::done:
+            transcription = job.text;
+            score = job.score;
+            return ReturnValue_ok;
+        case TranscriptionJob::Status::rejected:
+        case TranscriptionJob::Status::dropped:
+        case TranscriptionJob::Status::expired:
+            yCWarning(WHISPER_SPEECHTR) << "Request discarded by the queue (backlog too long)";
+            return ReturnValue::return_code::return_value_error_not_ready;
+        default:
+            return ReturnValue::return_code::return_value_error_method_failed;
+        }
+    }
+
+    //each request uses its own whisper state and scratch buffers, waiting for one to be free
+    const std::string language = requestLanguage();
+    auto model = m_router.select(duration_s, language);
+    auto slot = model->pool.acquire();
+    const whisper_full_params params = requestParams(m_wparams, *model, language);
+    return transcribeSound(*model, *slot, sound, params, cacheSeed(model->path, params), transcription, score);
+}
+
+uint64_t WhisperSpeechTranscription::cacheSeed(const std::string& model_path, const whisper_full_params& params) const
+{
+    if (!m_cache.isEnabled())
+    {
+        return 0;
+    }
+    //chained hashes, to avoid building a string for every request
+    const char* language = params.language ? params.language : "";
+    uint64_t seed = TranscriptionCache::hash(model_path);
+    seed = TranscriptionCache::hash(language, std::strlen(language), seed);
+    seed = TranscriptionCache::hash(&params.translate, sizeof(params.translate), seed);
+    return TranscriptionCache::hash(m_paramsSignature, seed);
+}
+
+ReturnValue WhisperSpeechTranscription::transcribeSound(ModelInstance& model, WhisperSlot& slot, const yarp::sig::Sound& sound, const whisper_full_params& base_params, uint64_t cache_seed, std::string& transcription, double& score)
+{
+    score = 0;
+    transcription.clear();
+    auto t_start = stats_clock::now();
+    slot.stats = InferenceStats();
+    //the word timestamps are derived from the token ones
+    slot.details = detailsRequested();
+    whisper_full_params params = base_params;
+    params.token_timestamps = params.token_timestamps || slot.details;
+    slot.stats.audio_s = double(sound.getSamples()) / (sound.getFrequency() > 0 ? sound.getFrequency() : WHISPER_SAMPLE_RATE);
+
+    //convert the audio data to mono F32 PCM at WHISPER_SAMPLE_RATE, keeping the channels for the diarization
+    std::vector<float>& pcmf32 = slot.pcmf32;
+    const bool diarize = m_diarize && sound.getChannels() > 1;
+    bool converted = diarize ? slot.frontEnd.process(sound, pcmf32, slot.pcmf32s) : slot.frontEnd.process(sound, pcmf32);
+    if (!converted)
+    {
+        yCError(WHISPER_SPEECHTR) << "Unable to convert the received Sound";
+        return ReturnValue::return_code::return_value_error_method_failed;
+    }
+    if (!diarize)
+    {
+        slot.pcmf32s.clear();
+    }
+
+    //skip silent buffers and trim the leading/trailing silence, of the channels too
+    bool speech = true;
+    if (m_vadEnabled)
+    {
+        size_t begin = 0;
+        size_t end = 0;
+        speech = m_vad.detect(pcmf32.data(), pcmf32.size(), begin, end);
+        if (speech)
+        {
+            pcmf32.erase(pcmf32.begin() + end, pcmf32.end());
+            pcmf32.erase(pcmf32.begin(), pcmf32.begin() + begin);
+            for (auto& ch : slot.pcmf32s)
+            {
+                ch.erase(ch.begin() + end, ch.end());
+                ch.erase(ch.begin(), ch.begin() + begin);
+            }
+        }
+    }
+    slot.stats.conversion_ms = elapsedMs(t_start);
+    if (!speech)
+    {
+        yCDebug(WHISPER_SPEECHTR) << "No speech detected, inference skipped";
+        slot.stats.skipped = SkipReason::no_speech;
+        slot.stats.total_ms = elapsedMs(t_start);
+        recordStats(slot.stats);
+        return ReturnValue_ok;
+    }
+
+    //replayed audio: the transcription is already known (the cache does not keep the details,
+    //and it cannot be used when the transcription depends on the conversation history)
+    const bool use_cache = m_cache.isEnabled() && !m_context.isEnabled();
+    uint64_t cache_key = 0;
+    if (use_cache)
+    {
+        cache_key = TranscriptionCache::key(pcmf32, cache_seed);
+        if (!slot.details && m_cache.lookup(cache_key, transcription, score))
+        {
+            slot.stats.cache_hit = true;
+            slot.stats.total_ms = elapsedMs(t_start);
+            recordStats(slot.stats);
+            return ReturnValue_ok;
+        }
+    }
+
+    //wake words: the utterances not addressed to the robot are not transcribed
+    if (m_spotter.isEnabled() && !spotKeyword(slot, pcmf32, params))
+    {
+        slot.stats.skipped = SkipReason::no_keyword;
+        slot.stats.total_ms = elapsedMs(t_start);
+        recordStats(slot.stats);
+        return ReturnValue_ok;
+    }
+
+    if (pcmf32.size() < min_input_samples)
+    {
+        pcmf32.resize(min_input_samples, 0.0f);
+    }
+
+    //language auto: detected here, once per session if it gets pinned
+    const bool detect_language = m_pinner.isEnabled() && params.language && std::strcmp(params.language, "auto") == 0;
+    if (detect_language)
+    {
+        detectLanguage(slot, pcmf32, params);
+    }
+
+    applyPolicy(slot, pcmf32.size(), t_start, params);
+    bool ok = false;
+    if (m_commands.isEnabled())
+    {
+        ok = recognizeCommand(slot, pcmf32, params, transcription, score);
+    }
+    else if (m_longFormMin > 0 && pcmf32.size() > m_longFormMin * WHISPER_SAMPLE_RATE)
+    {
+        ok = transcribeLongForm(model, slot, pcmf32, params, transcription, score);
+    }
+    else
+    {
+        if (m_context.isEnabled())
+        {
+            applyContext(slot, params);
+        }
+        ok = runInference(slot, pcmf32, params, transcription, score);
+        if (ok)
+        {
+            m_context.append(transcription);
+        }
+    }
+    if (!ok)
+    {
+        return ReturnValue::return_code::return_value_error_method_failed;
+    }
+    if (use_cache && !slot.stats.aborted)
+    {
+        m_cache.store(cache_key, transcription, score);
+    }
+    if (!detect_language && !m_commands.isEnabled() && !slot.stats.aborted && !transcription.empty())
+    {
+        m_pinner.confirm(params.language, score);
+    }
+    slot.stats.total_ms = elapsedMs(t_start);
+    recordStats(slot.stats);
+    return ReturnValue_ok;
+}
+
+void WhisperSpeechTranscription::processBatch(std::vector<TranscriptionJob*>& batch)
+{
+    //a batch contains only short utterances: it is routed as its longest one
+    double max_duration_s = 0;
+    for (const auto* job : batch)
+    {
+        max_duration_s = std::max(max_duration_s, job->duration_s);
+    }
+    const std::string language = requestLanguage();
+    auto model = m_router.select(max_duration_s, language);
+    auto slot = model->pool.acquire();
+    whisper_full_params params = requestParams(m_wparams, *model, language);
+    const uint64_t cache_seed = cacheSeed(model->path, params);
+    if (batch.size() == 1 || m_commands.isEnabled() || m_spotter.isEnabled() || m_context.isEnabled())
+    {
+        //commands and wake words are recognized one by one, and each turn of a conversation is the prompt of the next
+        for (auto* job : batch)
+        {
+            bool ok = bool(transcribeSound(*model, *slot, *job->sound, params, cache_seed, job->text, job->score));
+            job->status = ok ? TranscriptionJob::Status::done : TranscriptionJob::Status::failed;
+        }
+        return;
+    }
+
+    //several short utterances: concatenate them, separated by silence, and run a single inference pass
+    auto t_start = stats_clock::now();
+    slot->stats = InferenceStats();
+    slot->details = detailsRequested();
+    params.token_timestamps = params.token_timestamps || slot->details;
+    std::vector<float>& pcm = slot->pcmf32;
+    std::vector<float>& utterance = slot->scratch;
+    std::vector<size_t> begin(batch.size(), 0);
+    std::vector<size_t> end(batch.size(), 0);
+    std::vector<uint64_t> cache_keys(batch.size(), 0);
+    pcm.clear();
+    for (size_t i = 0; i < batch.size(); i++)
+    {
+        TranscriptionJob& job = *batch[i];
+        job.text.clear();
+        job.score = 0;
+        slot->stats.audio_s += job.duration_s;
+        if (!slot->frontEnd.process(*job.sound, utterance))
+        {
+            job.status = TranscriptionJob::Status::failed;
+            continue;
+        }
+        if (m_vadEnabled && !m_vad.trim(utterance))
+        {
+            job.status = TranscriptionJob::Status::done;
+            continue;
+        }
+        if (m_cache.isEnabled())
+        {
+            cache_keys[i] = TranscriptionCache::key(utterance, cache_seed);
+            if (!slot->details && m_cache.lookup(cache_keys[i], job.text, job.score))
+            {
+                job.status = TranscriptionJob::Status::done;
+                continue;
+            }
+        }
+        begin[i] = pcm.size();
+        pcm.insert(pcm.end(), utterance.begin(), utterance.end());
+        end[i] = pcm.size();
+        pcm.resize(pcm.size() + batch_gap_samples, 0.0f);
+    }
+    slot->stats.conversion_ms = elapsedMs(t_start);
+    if (pcm.empty())
+    {
+        return;
+    }
+    if (pcm.size() < min_input_samples)
+    {
+        pcm.resize(min_input_samples, 0.0f);
+    }
+
+    //the utterances of a batch are assumed to be in the language of the first one
+    const bool detect_language = m_pinner.isEnabled() && params.language && std::strcmp(params.language, "auto") == 0;
+    if (detect_language)
+    {
+        detectLanguage(*slot, pcm, params);
+    }
+
+    applyPolicy(*slot, pcm.size(), t_start, params);
+    if (!runWhisper(*slot, pcm, params))
+    {
+        return;
+    }
+    auto t_post = stats_clock::now();
+
+    //each segment goes to the utterance containing its midpoint
+    const int n_segments = whisper_full_n_segments_from_state(slot->state);
+    slot->segments.resize(n_segments);
+    std::vector<int> owner(n_segments, -1);
+    std::vector<ConfidenceAccumulator> confidence(batch.size());
+    for (int s = 0; s < n_segments; s++)
+    {
+        SegmentResult& seg = slot->segments[s];
+        readSegment(*slot, s, 0.0, seg);
+        size_t mid = size_t((seg.t0 + seg.t1) / 2 * WHISPER_SAMPLE_RATE);
+        for (size_t i = 0; i < batch.size(); i++)
+        {
+            if (end[i] > begin[i] && mid >= begin[i] && mid < end[i] + batch_gap_samples)
+            {
+                batch[i]->text += seg.text;
+                confidence[i].add(seg);
+                owner[s] = int(i);
+                break;
+            }
+        }
+    }
+    for (size_t i = 0; i < batch.size(); i++)
+    {
+        if (end[i] > begin[i])
+        {
+            batch[i]->score = confidence[i].score();
+            finalizeTranscription(batch[i]->text, batch[i]->score);
+            batch[i]->status = TranscriptionJob::Status::done;
+            if (m_cache.isEnabled() && !slot->stats.aborted)
+            {
+                m_cache.store(cache_keys[i], batch[i]->text, batch[i]->score);
+            }
+            if (!detect_language && !slot->stats.aborted && !batch[i]->text.empty())
+            {
+                m_pinner.confirm(params.language, batch[i]->score);
+            }
+            if (slot->details)
+            {
+                //times relative to the beginning of the utterance
+                const double offset_s = double(begin[i]) / WHISPER_SAMPLE_RATE;
+                std::vector<SegmentResult> segments;
+                for (int s = 0; s < n_segments; s++)
+                {
+                    if (owner[s] != int(i)) { continue; }
+                    segments.push_back(slot->segments[s]);
+                    SegmentResult& seg = segments.back();
+                    seg.t0 -= offset_s;
+                    seg.t1 -= offset_s;
+                    for (auto& w : seg.words)
+                    {
+                        if (w.t0 >= 0) { w.t0 -= offset_s; }
+                        if (w.t1 >= 0) { w.t1 -= offset_s; }
+                    }
+                    for (auto& t : seg.tokens)
+                    {
+                        if (t.t0 >= 0) { t.t0 -= offset_s; }
+                        if (t.t1 >= 0) { t.t1 -= offset_s; }
+                    }
+                }
+                storeResult(batch[i]->text, batch[i]->score, segments);
+            }
+        }
+    }
+    slot->stats.postprocess_ms = elapsedMs(t_post);
+    slot->stats.total_ms = elapsedMs(t_start);
+    recordStats(slot->stats);
+}
+
+void WhisperSpeechTranscription::applyPolicy(WhisperSlot& slot, size_t n_samples, std::chrono::steady_clock::time_point t_start, whisper_full_params& params)
+{
+    slot.deadline = {};
+    const DecodingPolicy::Config cfg = m_policy.getConfig();
+    if (cfg.budget_s <= 0)
+    {
+        return;
+    }
+    m_policy.apply(double(n_samples) / WHISPER_SAMPLE_RATE, params);
+    slot.deadline = t_start + std::chrono::duration_cast<stats_clock::duration>(std::chrono::duration<double>(cfg.budget_s));
+}
+
+bool WhisperSpeechTranscription::runWhisper(WhisperSlot& slot, const std::vector<float>& pcm, const whisper_full_params& params)
+{
+    //the callbacks mark the beginning of each encoder pass and the first sampled token after it
+    whisper_full_params wparams = params;
+    slot.timer.reset();
+    wparams.encoder_begin_callback = [](whisper_context*, whisper_state*, void* user_data) {
+        static_cast<StageTimer*>(user_data)->onEncoderBegin();
+        return true;
+    };
+    wparams.encoder_begin_callback_user_data = &slot.timer;
+    wparams.logits_filter_callback = [](whisper_context*, whisper_state*, const whisper_token_data*, int n_tokens, float*, void* user_data) {
+        static_cast<StageTimer*>(user_data)->onLogits(n_tokens);
+    };
+    wparams.logits_filter_callback_user_data = &slot.timer;
+    const bool has_deadline = slot.deadline != stats_clock::time_point();
+    if (has_deadline)
+    {
+        wparams.abort_callback = [](void* user_data) {
+            return stats_clock::now() > *static_cast<const stats_clock::time_point*>(user_data);
+        };
+        wparams.abort_callback_user_data = &slot.deadline;
+    }
+
+    auto t_start = stats_clock::now();
+    slot.stats.aborted = false;
+    onInference(true);
+    const int ret = whisper_full_with_state(slot.ctx, slot.state, wparams, pcm.data(), pcm.size());
+    onInference(false);
+    if (ret != 0)
+    {
+        if (!has_deadline || stats_clock::now() <= slot.deadline)
+        {
+            yCError(WHISPER_SPEECHTR, "failed to process audio");
+            return false;
+        }
+        //the segments of the windows completed before the deadline are kept
+        slot.stats.aborted = true;
+        yCWarning(WHISPER_SPEECHTR) << "Latency budget exceeded, returning the partial transcription";
+    }
+    double inference_ms = elapsedMs(t_start);
+
+    slot.stats.encode_ms = slot.timer.encode_ms;
+    slot.stats.decode_ms = inference_ms - slot.timer.encode_ms;
+    slot.stats.windows = slot.timer.windows;
+    slot.stats.fallbacks = slot.timer.fallbacks();
+    slot.stats.segments = whisper_full_n_segments_from_state(slot.state);
+    slot.stats.tokens = 0;
+    for (int i = 0; i < slot.stats.segments; i++)
+    {
+        slot.stats.tokens += whisper_full_n_tokens_from_state(slot.state, i);
+    }
+    if (has_deadline)
+    {
+        const bool beam = wparams.strategy == WHISPER_SAMPLING_BEAM_SEARCH;
+        const double audio_s = double(pcm.size()) / WHISPER_SAMPLE_RATE;
+        if (slot.stats.aborted)
+        {
+            m_policy.recordAborted(beam, audio_s, inference_ms);
+        }
+        else
+        {
+            m_policy.record(beam, audio_s, slot.stats.encode_ms, slot.stats.decode_ms, slot.stats.windows, slot.stats.fallbacks);
+        }
+    }
+    return true;
+}
+
+bool WhisperSpeechTranscription::runInference(WhisperSlot& slot, const std::vector<float>& pcm, const whisper_full_params& params, std::string& transcription, double& score)
+{
+    score = 0;
+    transcription.clear();
+
+    // run the inference
+    if (!runWhisper(slot, pcm, params))
+    {
+        return false;
     }
 
     // output stuff
+    auto t_post = stats_clock::now();
+    ConfidenceAccumulator confidence;
     {
-        const int n_segments = whisper_full_n_segments(m_ctx);
+        const int n_segments = whisper_full_n_segments_from_state(slot.state);
+        slot.segments.resize(n_segments);
         for (int i = 0; i < n_segments; ++i) {
-            const char* text = whisper_full_get_segment_text(m_ctx, i);
-            transcription += std::string(text);
-            yCDebug(WHISPER_SPEECHTR, text);
+            readSegment(slot, i, 0.0, slot.segments[i]);
+        }
+        assignSpeakers(slot.pcmf32s, slot.segments);
+        int last_speaker = -1;
+        for (const auto& seg : slot.segments) {
+            appendSegment(transcription, seg, last_speaker);
+            confidence.add(seg);
+        }
+    }
+
+    score = confidence.score();
+    finalizeTranscription(transcription, score);
+    storeResult(transcription, score, slot.segments);
+    slot.stats.postprocess_ms = elapsedMs(t_post);
+    return true;
+}
+
+bool WhisperSpeechTranscription::transcribeLongForm(ModelInstance& model, WhisperSlot& slot, const std::vector<float>& pcm, const whisper_full_params& params, std::string& transcription, double& score)
+{
+    score = 0;
+    transcription.clear();
+    std::vector<LongFormSplitter::Chunk> chunks;
+    m_splitter.split(pcm.data(), pcm.size(), chunks);
+    if (chunks.size() < 2)
+    {
+        return runInference(slot, pcm, params, transcription, score);
+    }
+
+    //the chunks are shared among the slot of the request and the states not used by other requests:
+    //tryAcquire() never waits, so requests cannot block each other
+    std::vector<WhisperStatePool::Lease> helpers;
+    while (helpers.size() + 1 < size_t(n_processors) && helpers.size() + 1 < chunks.size())
+    {
+        auto lease = model.pool.tryAcquire();
+        if (!lease)
+        {
+            break;
+        }
+        helpers.push_back(std::move(lease));
+    }
+    std::vector<WhisperSlot*> slots = { &slot };
+    for (auto& h : helpers)
+    {
+        slots.push_back(&*h);
+    }
+    yCDebug(WHISPER_SPEECHTR) << "Long-form request:" << chunks.size() << "chunks on" << slots.size() << "states";
+
+    std::vector<std::vector<SegmentResult>> chunk_segments(chunks.size());
+    std::vector<InferenceStats> worker_stats(slots.size());
+    std::atomic<size_t> next_chunk{0};
+    std::atomic<bool> failed{false};
+    auto worker = [&](size_t w) {
+        WhisperSlot& s = *slots[w];
+        s.details = slot.details;
+        s.deadline = slot.deadline;
+        for (size_t c = next_chunk++; c < chunks.size() && !failed; c = next_chunk++)
+        {
+            const LongFormSplitter::Chunk& chunk = chunks[c];
+            s.scratch.assign(pcm.begin() + chunk.begin, pcm.begin() + chunk.end);
+            if (s.scratch.size() < min_input_samples)
+            {
+                s.scratch.resize(min_input_samples, 0.0f);
+            }
+            if (!runWhisper(s, s.scratch, params))
+            {
+                failed = true;
+                return;
+            }
+            //times relative to the beginning of the recording
+            const double offset_s = -double(chunk.begin) / WHISPER_SAMPLE_RATE;
+            const int n_segments = whisper_full_n_segments_from_state(s.state);
+            chunk_segments[c].resize(n_segments);
+            for (int i = 0; i < n_segments; i++)
+            {
+                readSegment(s, i, offset_s, chunk_segments[c][i]);
+            }
+            InferenceStats& ws = worker_stats[w];
+            ws.encode_ms += s.stats.encode_ms;
+            ws.decode_ms += s.stats.decode_ms;
+            ws.windows += s.stats.windows;
+            ws.fallbacks += s.stats.fallbacks;
+            ws.tokens += s.stats.tokens;
+            ws.aborted = ws.aborted || s.stats.aborted;
         }
+    };
+    std::vector<std::thread> threads;
+    for (size_t w = 1; w < slots.size(); w++)
+    {
+        threads.emplace_back(worker, w);
+    }
+    //runWhisper() overwrites the figures of the request slot
+    const InferenceStats request_stats = slot.stats;
+    worker(0);
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+    slot.stats = request_stats;
+    if (failed)
+    {
+        return false;
+    }
+
+    //encode/decode times are summed over the workers
+    auto t_post = stats_clock::now();
+    for (const auto& ws : worker_stats)
+    {
+        slot.stats.encode_ms += ws.encode_ms;
+        slot.stats.decode_ms += ws.decode_ms;
+        slot.stats.windows += ws.windows;
+        slot.stats.fallbacks += ws.fallbacks;
+        slot.stats.tokens += ws.tokens;
+        slot.stats.aborted = slot.stats.aborted || ws.aborted;
+    }
+
+    LongFormSplitter::stitch(chunks, chunk_segments, slot.segments);
+    assignSpeakers(slot.pcmf32s, slot.segments);
+    slot.stats.segments = int(slot.segments.size());
+    ConfidenceAccumulator confidence;
+    int last_speaker = -1;
+    for (const auto& seg : slot.segments)
+    {
+        appendSegment(transcription, seg, last_speaker);
+        confidence.add(seg);
+    }
+    score = confidence.score();
+    finalizeTranscription(transcription, score);
+    storeResult(transcription, score, slot.segments);
+    slot.stats.postprocess_ms = elapsedMs(t_post);
+    return true;
+}
+
+void WhisperSpeechTranscription::applyContext(WhisperSlot& slot, whisper_full_params& params)
+{
+    m_context.get(slot.context);
+    if (slot.context.empty())
+    {
+        return;
+    }
+
+    //whisper ignores initial_prompt when prompt_tokens is set, so the initial prompt is the first part of the prompt.
+    //A token is at least one byte long: the buffer never needs to grow during the tokenization.
+    auto tokenize = [&slot](const std::string& text, size_t offset) {
+        slot.prompt.resize(offset + text.size() + 1);
+        return text.empty() ? 0 : whisper_tokenize(slot.ctx, text.c_str(), slot.prompt.data() + offset, int(text.size() + 1));
+    };
+    const int n_initial = tokenize(m_initialPrompt, 0);
+    const int n_history = n_initial >= 0 ? tokenize(slot.context, size_t(n_initial)) : -1;
+    if (n_history <= 0)
+    {
+        yCWarning(WHISPER_SPEECHTR) << "Unable to tokenize the conversation history, ignored";
+        return;
+    }
+
+    //the oldest tokens of the history are dropped
+    const int max_history = int(m_context.getConfig().max_tokens);
+    int n_tokens = n_initial + n_history;
+    if (n_history > max_history)
+    {
+        auto first = slot.prompt.begin() + n_initial;
+        slot.prompt.erase(first, first + (n_history - max_history));
+        n_tokens = n_initial + max_history;
     }
+    params.prompt_tokens = slot.prompt.data();
+    params.prompt_n_tokens = n_tokens;
+}
+
+void WhisperSpeechTranscription::detectLanguage(WhisperSlot& slot, const std::vector<float>& pcm, whisper_full_params& params)
+{
+    auto t_start = stats_clock::now();
+    const int n_samples = int(std::min(pcm.size(), language_window_samples));
+    slot.lang_probs.resize(size_t(whisper_lang_max_id()) + 1);
+    int lang_id = -1;
+    if (whisper_pcm_to_mel_with_state(slot.ctx, slot.state, pcm.data(), n_samples, params.n_threads) == 0)
+    {
+        lang_id = whisper_lang_auto_detect_with_state(slot.ctx, slot.state, 0, params.n_threads, slot.lang_probs.data());
+    }
+    slot.stats.language_ms = elapsedMs(t_start);
+    if (lang_id < 0)
+    {
+        //whisper_full detects it again
+        yCWarning(WHISPER_SPEECHTR) << "Language detection failed";
+        return;
+    }
+    const char* language = whisper_lang_str(lang_id);
+    const double probability = slot.lang_probs[size_t(lang_id)];
+    yCDebug(WHISPER_SPEECHTR, "Detected language %s, probability %.3f", language, probability);
+    params.language = language;
+    m_pinner.pin(language, probability);
+}
 
-    //remove symbols such as [bla bla]
-    if (m_no_symbols)
+bool WhisperSpeechTranscription::spotKeyword(WhisperSlot& slot, const std::vector<float>& pcm, const whisper_full_params& params)
+{
+    auto t_start = stats_clock::now();
+    KeywordSpotter::Result result;
+    bool ok = false;
+    if (m_keywordModel)
+    {
+        //the keyword model has its own states
+        const std::string language = params.language ? params.language : "en";
+        auto lease = m_keywordModel->pool.acquire();
+        ok = m_spotter.spot(lease->ctx, lease->state, pcm, requestParams(params, *m_keywordModel, language), slot.scratch, result);
+    }
+    else
+    {
+        ok = m_spotter.spot(slot.ctx, slot.state, pcm, params, slot.scratch, result);
+    }
+    slot.stats.keyword_ms = elapsedMs(t_start);
+    if (!ok)
     {
-        std::regex pattern1("\\[[^\\]]*\\]");
-        std::string input = transcription;
-        transcription = std::regex_replace(input, pattern1, "");
+        //better a useless transcription than a lost request
+        yCWarning(WHISPER_SPEECHTR) << "Keyword spotting failed, transcribing the request";
+        return true;
     }
+    yCDebug(WHISPER_SPEECHTR) << "Keyword spotting: heard" << result.heard << "similarity" << result.similarity
+                              << (result.index >= 0 ? "-> transcribing" : "-> skipped");
+    return result.index >= 0;
+}
+
+bool WhisperSpeechTranscription::recognizeCommand(WhisperSlot& slot, const std::vector<float>& pcm, const whisper_full_params& params, std::string& command, double& score)
+{
+    command.clear();
+    score = 0;
+    int index = -1;
+    double probability = 0;
+    double confidence = 0;
+    if (m_commandMode == CommandRecognizer::Mode::grammar)
+    {
+        //decoding constrained to the commands, the score is the confidence of the decoded tokens
+        whisper_full_params gparams = params;
+        m_commands.applyGrammar(gparams, m_grammarPenalty);
+        std::string text;
+        if (!runInference(slot, pcm, gparams, text, probability))
+        {
+            return false;
+        }
+        //the match is on the decoded text: the filters could rewrite it, e.g. "two" into "2"
+        text.clear();
+        for (const auto& seg : slot.segments)
+        {
+            text += seg.text;
+        }
+        index = m_commands.match(text);
+        confidence = probability;
+    }
+    else
+    {
+        CommandRecognizer::Result result;
+        if (!m_commands.score(slot.ctx, slot.state, pcm, params.n_threads, params.language, result))
+        {
+            yCError(WHISPER_SPEECHTR) << "Command scoring failed";
+            return false;
+        }
+        slot.stats.encode_ms = result.encode_ms;
+        slot.stats.decode_ms = result.decode_ms;
+        slot.stats.windows = 1;
+        slot.stats.tokens = result.decoded_tokens;
+        index = result.index;
+        probability = result.probability;
+        confidence = result.confidence;
+        if (result.candidates.size() > 1)
+        {
+            yCDebug(WHISPER_SPEECHTR) << "Best commands:" << result.candidates[0].command << result.candidates[0].probability
+                                      << result.candidates[1].command << result.candidates[1].probability;
+        }
+    }
+
+    if (index >= 0 && probability >= m_commandMinProb && confidence >= m_commandMinConfidence)
+    {
+        command = m_commands.commands()[index];
+        score = probability;
+        finalizeTranscription(command, score);
+    }
+    return true;
+}
+
+void WhisperSpeechTranscription::recordStats(const InferenceStats& stats)
+{
+    m_metrics.record(stats);
+}
+
+void WhisperSpeechTranscription::readSegment(const WhisperSlot& slot, int i_segment, double offset_s, SegmentResult& seg) const
+{
+    seg.text = whisper_full_get_segment_text_from_state(slot.state, i_segment);
+    seg.t0 = whisper_full_get_segment_t0_from_state(slot.state, i_segment) * timestamp_s - offset_s;
+    seg.t1 = whisper_full_get_segment_t1_from_state(slot.state, i_segment) * timestamp_s - offset_s;
+    seg.no_speech_prob = whisper_full_get_segment_no_speech_prob_from_state(slot.state, i_segment);
+    seg.sum_logprob = 0;
+    seg.n_tokens = 0;
+    seg.speaker = -1;
+    seg.speaker_turn = whisper_full_get_segment_speaker_turn_next_from_state(slot.state, i_segment);
+    seg.words.clear();
+    seg.tokens.clear();
+
+    //timestamps and the other special tokens do not contribute to the confidence
+    const whisper_token eot = whisper_token_eot(slot.ctx);
+    const int n_tokens = whisper_full_n_tokens_from_state(slot.state, i_segment);
+    int word_tokens = 0;
+    for (int t = 0; t < n_tokens; t++)
+    {
+        whisper_token_data data = whisper_full_get_token_data_from_state(slot.state, i_segment, t);
+        if (data.id >= eot)
+        {
+            continue;
+        }
+        seg.sum_logprob += std::log(std::max(data.p, 1e-6f));
+        seg.n_tokens++;
+
+        if (slot.details)
+        {
+            TokenResult token;
+            token.id = data.id;
+            token.p = data.p;
+            if (data.t0 >= 0) { token.t0 = data.t0 * timestamp_s - offset_s; }
+            if (data.t1 >= 0) { token.t1 = data.t1 * timestamp_s - offset_s; }
+            seg.tokens.push_back(token);
+
+            //a token starting with a space begins a new word
+            const char* text = whisper_full_get_token_text_from_state(slot.ctx, slot.state, i_segment, t);
+            if (seg.words.empty() || text[0] == ' ')
+            {
+                seg.words.emplace_back();
+                word_tokens = 0;
+            }
+            WordResult& word = seg.words.back();
+            word.text += text;
+            if (data.t0 >= 0 && word.t0 < 0) { word.t0 = data.t0 * timestamp_s - offset_s; }
+            if (data.t1 >= 0) { word.t1 = data.t1 * timestamp_s - offset_s; }
+            word_tokens++;
+            word.confidence += (data.p - word.confidence) / word_tokens;
+        }
+    }
+}
+
+void WhisperSpeechTranscription::assignSpeakers(const std::vector<std::vector<float>>& channels, std::vector<SegmentResult>& segments) const
+{
+    if (channels.size() < 2)
+    {
+        return;
+    }
+    //a segment belongs to the channel whose energy exceeds the ones of all the others by 10%
+    const size_t n = channels.front().size();
+    for (auto& seg : segments)
+    {
+        const size_t i0 = std::min(n, size_t(std::max(0.0, seg.t0) * WHISPER_SAMPLE_RATE));
+        const size_t i1 = std::min(n, size_t(std::max(0.0, seg.t1) * WHISPER_SAMPLE_RATE));
+        double best = 0;
+        double second = 0;
+        int best_channel = -1;
+        for (size_t c = 0; c < channels.size(); c++)
+        {
+            double energy = 0;
+            for (size_t i = i0; i < i1; i++)
+            {
+                energy += std::fabs(channels[c][i]);
+            }
+            if (energy > best)
+            {
+                second = best;
+                best = energy;
+                best_channel = int(c);
+            }
+            else if (energy > second)
+            {
+                second = energy;
+            }
+        }
+        seg.speaker = best > 1.1 * second ? best_channel : -1;
+    }
+}
+
+void WhisperSpeechTranscription::appendSegment(std::string& transcription, const SegmentResult& seg, int& last_speaker) const
+{
+    if (m_speakerLabels && m_diarize && (transcription.empty() || seg.speaker != last_speaker))
+    {
+        transcription += seg.speaker >= 0 ? " Speaker " + std::to_string(seg.speaker) + ":" : std::string(" Speaker ?:");
+        last_speaker = seg.speaker;
+    }
+    transcription += seg.text;
+}
+
+void WhisperSpeechTranscription::finalizeTranscription(std::string& transcription, double& score) const
+{
+    //text filters, e.g. removal of symbols such as [bla bla], (bla bla) and *bla bla*
+    m_textPipeline.apply(transcription, score);
 
-    //assign the score
-    score = 1.0;
     if (transcription.empty()) {score = 0.0;}
-    return ReturnValue_ok;
+}
+
+bool WhisperSpeechTranscription::detailsRequested()
+{
+    return m_resultDetails || m_alignmentPort.getOutputCount() > 0;
+}
+
+void WhisperSpeechTranscription::storeResult(const std::string& transcription, double score, const std::vector<SegmentResult>& segments)
+{
+    if (!m_resultDetails && m_alignmentPort.getOutputCount() == 0)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_resultMutex);
+    if (m_resultDetails)
+    {
+        m_lastResult.text = transcription;
+        m_lastResult.score = score;
+        m_lastResult.segments = segments;
+    }
+    if (m_alignmentPort.getOutputCount() > 0)
+    {
+        AlignmentWriter::write(transcription, score, segments, m_alignmentPort.prepare());
+        m_alignmentPort.write();
+    }
+}
+
+bool WhisperSpeechTranscription::read(yarp::os::ConnectionReader& connection)
+{
+    yarp::os::Bottle cmd;
+    yarp::os::Bottle reply;
+    if (!cmd.read(connection))
+    {
+        return false;
+    }
+
+    std::string command = cmd.get(0).asString();
+    if (command == "help")
+    {
+        reply.addVocab32("many");
+        reply.addString("queue_stats : statistics of the request queue (depth, wait times, drop counters)");
+        reply.addString("last_stats : timings of the last request (conversion, encode, decode, postprocess, real-time factor, tokens, fallbacks)");
+        reply.addString("metrics : rolling percentiles of latency and real-time factor over the last requests");
+        reply.addString("models : models loaded for each route");
+        reply.addString("cache_stats : size, capacity, hits and misses of the transcription cache");
+        reply.addString("cache_clear : empties the transcription cache");
+        reply.addString("context : conversation history used as prompt of the next request");
+        reply.addString("context_reset : forgets the conversation history");
+        reply.addString("language_pin : language pinned for the session (language auto), with its probability and counters");
+        reply.addString("language_reset : drops the pinned language, the language of the next request is detected again");
+        reply.addString("latency_budget [ms] : returns the latency budget of a request, setting it if given (0 = disabled)");
+        reply.addString("load_model <path> [main|short|multilingual] : loads a model and swaps it in, requests already running complete on the previous one");
+        reply.addString("unload_model <short|multilingual> : removes a route");
+        reply.addString("last_result : segments and words of the last request with confidences and timestamps (requires result_details)");
+        reply.addString("last_alignment : segments, words and tokens of the last request in the compact format of the alignment port (requires result_details)");
+    }
+    else if (command == "queue_stats")
+    {
+        TranscriptionQueue::Stats st = m_queue.getStats();
+        auto add = [&reply](const std::string& key, double value) {
+            yarp::os::Bottle& b = reply.addList();
+            b.addString(key);
+            b.addFloat64(value);
+        };
+        add("enabled", m_queue.isRunning() ? 1 : 0);
+        add("depth", double(st.depth));
+        add("max_depth", double(st.max_depth));
+        add("accepted", double(st.accepted));
+        add("processed", double(st.processed));
+        add("rejected", double(st.rejected));
+        add("dropped", double(st.dropped));
+        add("expired", double(st.expired));
+        add("batches", double(st.batches));
+        add("batched_jobs", double(st.batched_jobs));
+        add("last_wait_s", st.last_wait_s);
+        add("avg_wait_s", st.avg_wait_s);
+        add("max_wait_s", st.max_wait_s);
+    }
+    else if (command == "last_stats")
+    {
+        MetricsMonitor::addStats(reply, m_metrics.last());
+    }
+    else if (command == "metrics")
+    {
+        m_metrics.addPercentiles(reply);
+    }
+    else if (command == "cache_stats")
+    {
+        TranscriptionCache::Stats st = m_cache.getStats();
+        auto add = [&reply](const std::string& key, double value) {
+            yarp::os::Bottle& b = reply.addList();
+            b.addString(key);
+            b.addFloat64(value);
+        };
+        add("size", double(st.size));
+        add("capacity", double(st.capacity));
+        add("hits", double(st.hits));
+        add("misses", double(st.misses));
+    }
+    else if (command == "cache_clear")
+    {
+        m_cache.clear();
+        reply.addVocab32("ok");
+    }
+    else if (command == "context")
+    {
+        std::string history;
+        m_context.get(history);
+        yarp::os::Bottle& enabled = reply.addList();
+        enabled.addString("enabled");
+        enabled.addInt32(m_context.isEnabled() ? 1 : 0);
+        yarp::os::Bottle& utterances = reply.addList();
+        utterances.addString("utterances");
+        utterances.addInt32(int(m_context.size()));
+        yarp::os::Bottle& text = reply.addList();
+        text.addString("text");
+        text.addString(history);
+    }
+    else if (command == "latency_budget")
+    {
+        //latency_budget [ms]: sets the budget if given, returns the current one
+        DecodingPolicy::Config cfg = m_policy.getConfig();
+        if (cmd.size() > 1)
+        {
+            cfg.budget_s = std::max(0, cmd.get(1).asInt32()) / 1000.0;
+            m_policy.setConfig(cfg);
+        }
+        yarp::os::Bottle& b = reply.addList();
+        b.addString("latency_budget_ms");
+        b.addInt32(int(std::lround(cfg.budget_s * 1000)));
+    }
+    else if (command == "language_pin")
+    {
+        const LanguagePinner::Stats st = m_pinner.stats();
+        auto add = [&reply](const std::string& key, double value) {
+            yarp::os::Bottle& b = reply.addList();
+            b.addString(key);
+            b.addFloat64(value);
+        };
+        yarp::os::Bottle& lang = reply.addList();
+        lang.addString("language");
+        lang.addString(st.language ? st.language : "");
+        add("probability", st.probability);
+        add("detections", double(st.detections));
+        add("pinned_requests", double(st.pinned_requests));
+        add("rechecks", double(st.rechecks));
+    }
+    else if (command == "language_reset")
+    {
+        m_pinner.reset();
+        reply.addVocab32("ok");
+    }
+    else if (command == "context_reset")
+    {
+        m_context.reset();
+        reply.addVocab32("ok");
+    }
+    else if (command == "models")
+    {
+        for (int r = 0; r < int(ModelRouter::Route::count); r++)
+        {
+            auto route = ModelRouter::Route(r);
+            auto model = m_router.get(route);
+            if (model)
+            {
+                yarp::os::Bottle& b = reply.addList();
+                b.addString(ModelRouter::routeName(route));
+                b.addString(model->path);
+                b.addString(model->multilingual ? "multilingual" : "en");
+            }
+        }
+    }
+    else if (command == "load_model" || command == "unload_model")
+    {
+        ModelRouter::Route route = ModelRouter::Route::main;
+        std::string route_name = command == "load_model" ? cmd.get(2).asString() : cmd.get(1).asString();
+        if (!route_name.empty() && !ModelRouter::parseRoute(route_name, route))
+        {
+            reply.addVocab32("fail");
+            reply.addString("Unknown route " + route_name);
+        }
+        else if (command == "unload_model")
+        {
+            if (route == ModelRouter::Route::main)
+            {
+                reply.addVocab32("fail");
+                reply.addString("The main model cannot be unloaded");
+            }
+            else
+            {
+                m_router.set(route, nullptr);
+                reply.addVocab32("ok");
+            }
+        }
+        else
+        {
+            //this (rpc) thread loads the model, the requests keep running on the current one
+            reply.addVocab32(loadModel(route, cmd.get(1).asString()) ? "ok" : "fail");
+        }
+    }
+    else if (command == "last_alignment")
+    {
+        if (!m_resultDetails)
+        {
+            reply.addVocab32("fail");
+            reply.addString("result_details is disabled");
+        }
+        else
+        {
+            std::lock_guard<std::mutex> lock(m_resultMutex);
+            AlignmentWriter::write(m_lastResult.text, m_lastResult.score, m_lastResult.segments, reply);
+        }
+    }
+    else if (command == "last_result")
+    {
+        if (!m_resultDetails)
+        {
+            reply.addVocab32("fail");
+            reply.addString("result_details is disabled");
+        }
+        else
+        {
+            std::lock_guard<std::mutex> lock(m_resultMutex);
+            auto add = [](yarp::os::Bottle& b, const std::string& key, double value) {
+                yarp::os::Bottle& pair = b.addList();
+                pair.addString(key);
+                pair.addFloat64(value);
+            };
+            yarp::os::Bottle& text = reply.addList();
+            text.addString("text");
+            text.addString(m_lastResult.text);
+            add(reply, "score", m_lastResult.score);
+            yarp::os::Bottle& segments = reply.addList();
+            segments.addString("segments");
+            for (const auto& seg : m_lastResult.segments)
+            {
+                yarp::os::Bottle& sb = segments.addList();
+                yarp::os::Bottle& seg_text = sb.addList();
+                seg_text.addString("text");
+                seg_text.addString(seg.text);
+                add(sb, "t0", seg.t0);
+                add(sb, "t1", seg.t1);
+                add(sb, "confidence", seg.confidence());
+                add(sb, "avg_logprob", seg.avgLogprob());
+                add(sb, "no_speech_prob", seg.no_speech_prob);
+                add(sb, "speaker", seg.speaker);
+                add(sb, "speaker_turn", seg.speaker_turn ? 1 : 0);
+                yarp::os::Bottle& words = sb.addList();
+                words.addString("words");
+                for (const auto& w : seg.words)
+                {
+                    yarp::os::Bottle& wb = words.addList();
+                    wb.addString(w.text);
+                    wb.addFloat64(w.t0);
+                    wb.addFloat64(w.t1);
+                    wb.addFloat64(w.confidence);
+                }
+            }
+        }
+    }
+    else
+    {
+        reply.addVocab32("fail");
+        reply.addString("Unknown command. Type help for the list of commands.");
+    }
+
+    yarp::os::ConnectionWriter* writer = connection.getWriter();
+    if (writer != nullptr)
+    {
+        reply.write(*writer);
+    }
+    return true;
 }
@@ -9,9 +9,32 @@
 #include <yarp/dev/DeviceDriver.h>
 #include <yarp/dev/ISpeechTranscription.h>
 #include <yarp/os/Bottle.h>
+#include <yarp/os/BufferedPort.h>
+#include <yarp/os/Port.h>
+#include <yarp/os/PortReader.h>
 #include <stdio.h>
+#include <memory>
+#include <mutex>
 
 #include "whisper.h"
+#include "AudioFrontEnd.h"
+#include "StreamingTranscriber.h"
+#include "VoiceActivityDetector.h"
+#include "WhisperStatePool.h"
+#include "TranscriptionQueue.h"
+#include "MetricsMonitor.h"
+#include "TranscriptionResult.h"
+#include "ModelRouter.h"
+#include "TranscriptionCache.h"
+#include "CommandRecognizer.h"
+#include "LongFormSplitter.h"
+#include "TextPipeline.h"
+#include "AlignmentWriter.h"
+#include "ConversationContext.h"
+#include "DecodingPolicy.h"
+#include "ModelSelector.h"
+#include "KeywordSpotter.h"
+#include "LanguagePinner.h"
 
 using namespace yarp::os;
 
@@ -20,29 +43,201 @@ using namespace yarp::os;
  *
  * \brief `WhisperSpeechTranscription`: A yarp device which performs audio-to-text transcription using OpenAI Whisper models.
  * This device implements the ISpeechTranscription and can be used with a speechTranscription_nws_yarp device and a AudioRecorderWrapper to transcribe audio in real time.
+ * Additional commands (type `help` for the list) are available on the rpc port `<name>/rpc`.
+ * While a client is connected to `<name>/alignment:o`, the segments, words and tokens of every request are
+ * computed, with their timestamps, and published on it in the compact format of AlignmentWriter.
  *
  *  Parameters required by this device are:
  * | Parameter name | SubParameter   | Type    | Units          | Default Value    | Required     | Description                                                       | Notes |
  * |:--------------:|:--------------:|:-------:|:--------------:|:----------------:|:-----------: |:-----------------------------------------------------------------:|:-----:|
  * | model          |      -         | string  | -              | -                | Yes          | Full path tot the model file, e.g. ggml-base.en.bin               |       |
- * | language       |      -         | string  | -              | auto             | No           | Language (??? TBC)                                                |       |
- * | remove_symbols |      -         | bool    | -              | true             | No           | Removed symbols from output text, i.e. ...[bla bla]...            |       |
+ * | model_short    |      -         | string  | -              | -                | No           | Model used for the utterances not longer than short_max_ms, e.g. ggml-tiny.en.bin | Used only if it supports the current language |
+ * | short_max_ms   |      -         | int     | ms             | 3000             | No           | Maximum duration of the utterances served by model_short           |       |
+ * | model_variants |      -         | list    | -              | -                | No           | Variants of the main model, e.g. (ggml-base.en.bin ggml-base.en-q8_0.bin ggml-base.en-q5_1.bin). Replaces model with the one that best fits the CPU features and the available memory | The choice is logged at open |
+ * | model_min_accuracy | -          | string  | -              | -                | No           | Model variants less accurate than this weight type (f16, q8_0, q6_k, q5_1, q5_0, q4_1, q4_0, ...) are never chosen | |
+ * | model_max_memory_mb | -         | int     | MB             | 0                | No           | Memory available to the model variant and its states. 0 = 90% of the memory available on the host | |
+ * | model_multilingual | -          | string  | -              | -                | No           | Model used when the language set with setLanguage() is not supported by model | Models can be replaced at runtime with the rpc command `load_model` |
+ * | language       |      -         | string  | -              | en               | No           | Spoken language, e.g. en, it, 'auto' to detect it                 | Can be changed at runtime with setLanguage() |
+ * | detect-language |     -         | bool    | -              | false            | No           | Same as language auto                                             |       |
+ * | language_pin_prob | -           | float   | -              | 0                | No           | Language auto: the language detected with at least this probability is pinned for the session, sparing the detection pass of the next requests. 0 = detected at every request | Shown by the rpc command `language_pin`, dropped with `language_reset` or setLanguage(). Not used in streaming mode |
+ * | language_recheck_score | -      | float   | -              | 0.5              | No           | Language pinning: a request decoded with the pinned language and a lower score drops the pin, the language of the next one is detected again | |
+ * | language_session_ms | -         | int     | ms             | 300000           | No           | Language pinning: the pin is dropped after this time without requests. 0 = never |       |
+ * | model_mmap     |      -         | bool    | -              | true             | No           | Reads the model through a memory mapping of the file              | Device instances opening the same model share its weights |
+ * | use_gpu        |      -         | bool    | -              | true             | No           | Runs the models on the GPU, if whisper was built with a GPU backend (CUDA, Metal, ...). false = CPU only |       |
+ * | warmup         |      -         | bool    | -              | false            | No           | Runs an inference on silence with every whisper state at open, so that the first request does not pay first-touch costs | |
+ * | states         |      -         | int     | -              | 1                | No           | Number of whisper states, i.e. of requests processed concurrently | The model weights are loaded only once |
+ * | processors     |      -         | int     | -              | 1                | No           | Long-form mode: max number of chunks of a recording transcribed concurrently, each one with `threads` threads | At least this many states are allocated |
+ * | long_form_ms   |      -         | int     | ms             | 0                | No           | Recordings longer than this are split at silences into overlapping chunks, transcribed concurrently and stitched back together. 0 = disabled | Chunks use the states not busy with other requests |
+ * | chunk_ms       |      -         | int     | ms             | 30000            | No           | Long-form mode: maximum length of a chunk, overlaps included |       |
+ * | chunk_overlap_ms |    -         | int     | ms             | 1000             | No           | Long-form mode: audio shared by two consecutive chunks       |       |
+ * | remove_symbols |      -         | bool    | -              | true             | No           | Removed symbols from output text, i.e. ...[bla bla]..., (bla bla), *bla bla* | Same as text_filters (symbols) |
+ * | text_filters   |      -         | list    | -              | (symbols)        | No           | Filters applied in order to every transcription: symbols, hallucinations (repeated word sequences, "Thank you." on silence), punctuation (spacing and sentence case), lowercase (no punctuation), numbers (English number words to digits), profanity | Each filter rewrites the text in place in a single pass. Replaces remove_symbols |
+ * | hallucination_max_repeats | -   | int     | -              | 3                | No           | Filter hallucinations: a sequence of up to 8 words repeated more times in a row is kept once. 0 = disabled |       |
+ * | hallucination_score | -         | float   | -              | 0.6              | No           | Filter hallucinations: a transcription made only of a phrase typical of silence, e.g. "Thank you.", is dropped if its score is lower |       |
+ * | profanity_words |     -         | list    | -              | -                | No           | Filter profanity: words masked but their first letter. Default: a built-in English list |       |
+ * | result_details |      -         | bool    | -              | false            | No           | Keeps the segments, words and tokens of every request, with their confidences and timestamps, for the rpc commands `last_result` and `last_alignment` | Otherwise they are computed only while a client is connected to `<name>/alignment:o` |
+ * | token_timestamps |    -         | bool    | -              | false            | No           | Computes the timestamps of the tokens of every request | Enabled automatically when the words are needed |
+ * | downmix        |      -         | string  | -              | first            | No           | How multichannel audio is reduced to mono: first, average, select, beamform (delay-and-sum) |       |
+ * | downmix_channel|      -         | int     | -              | 0                | No           | Channel used when downmix=select                                  |       |
+ * | diarize        |      -         | bool    | -              | false            | No           | Multichannel audio: each segment is attributed to the channel where it is loudest, e.g. one speaker per microphone | Not applied to batched utterances |
+ * | tdrz           |      -         | bool    | -              | false            | No           | Speaker turn detection, requires a tinydiarize model (e.g. ggml-small.en-tdrz.bin) | |
+ * | speaker_labels |      -         | bool    | -              | false            | No           | Prefixes the text of each speaker with `Speaker N:` (diarize) | The speakers of each segment are also in the rpc command `last_result` |
+ * | name           |      -         | string  | -              | /whisperSpeechTranscription | No | Prefix of the ports opened by the device                        |       |
+ * | streaming      |      -         | bool    | -              | false            | No           | Enables the sliding-window streaming mode                         | transcribe() then appends the received chunk and returns the latest hypothesis |
+ * | shm_input      |      -         | string  | -              | -                | No           | Name of a SharedAudioRing (e.g. /whisper_audio) written by an audio producer on the same host. Enables the streaming mode, reading the audio from the shared memory | The device attaches to it when the producer creates it; the hypotheses are published on `<name>/stream/text:o` |
+ * | step_ms        |      -         | int     | ms             | 3000             | No           | Streaming mode: audio step between two inferences                 |       |
+ * | length_ms      |      -         | int     | ms             | 10000            | No           | Streaming mode: length of the inference window                    |       |
+ * | keep_ms        |      -         | int     | ms             | 200              | No           | Streaming mode: audio kept from the previous window               |       |
+ * | buffer_ms      |      -         | int     | ms             | 30000            | No           | Streaming mode: capacity of the buffer of pending audio           |       |
+ * | queue_depth    |      -         | int     | -              | 0                | No           | Max number of requests waiting for a worker. 0 runs the inference on the calling thread | One worker per whisper state |
+ * | queue_policy   |      -         | string  | -              | reject           | No           | What to do when the queue is full: reject, drop_oldest            |       |
+ * | queue_max_wait_ms |   -         | int     | ms             | 0                | No           | Requests waiting longer than this are discarded. 0 = no limit     |       |
+ * | batch_window_ms |     -         | int     | ms             | 0                | No           | Short utterances arriving within this window are transcribed in a single inference pass. 0 = disabled | Requires queue_depth > 0 |
+ * | batch_max_utterance_ms | -      | int     | ms             | 3000             | No           | Only utterances shorter than this are batched                     |       |
+ * | batch_max_total_ms |  -         | int     | ms             | 20000            | No           | Maximum audio duration of a batch                                 |       |
+ * | vad            |      -         | bool    | -              | false            | No           | Skips silent buffers and trims leading/trailing silence           |       |
+ * | vad_energy_thold |    -         | float   | dBFS           | -45.0            | No           | VAD: minimum frame energy to be classified as speech              |       |
+ * | vad_zcr_thold  |      -         | float   | crossings/sample | 0.35           | No           | VAD: maximum zero-crossing rate of a speech frame                 |       |
+ * | vad_min_speech_ms |   -         | int     | ms             | 100              | No           | VAD: minimum amount of speech required to run the inference       |       |
+ * | vad_padding_ms |      -         | int     | ms             | 200              | No           | VAD: silence kept before and after the detected speech            |       |
+ * | commands       |      -         | string  | -              | -                | No           | File with the list of commands, one per line. Enables the command mode: transcribe() returns the recognized command, or an empty string | Not used in streaming mode |
+ * | command_mode   |      -         | string  | -              | score            | No           | Command mode: score (each command is scored against the audio) or grammar (grammar-constrained decoding) |       |
+ * | command_min_prob | -            | float   | -              | 0.0              | No           | Command mode: commands recognized with a lower probability are discarded |       |
+ * | command_min_confidence | -      | float   | -              | 0.3              | No           | Command mode: commands whose tokens have a lower mean probability are discarded, so that speech which is not a command returns an empty string | The probability is relative to the other commands, the confidence is not |
+ * | grammar_penalty |     -         | float   | -              | 100.0            | No           | Command mode (grammar): logit penalty of the tokens not allowed by the grammar |       |
+ * | keywords       |      -         | list    | -              | -                | No           | Wake words, e.g. ("hey robot" "ok robot"). Only the utterances beginning with one of them are transcribed, the others return an empty string | The reason is `skipped` in the rpc command `last_stats` (1 = no speech, 2 = no keyword). Not used in streaming mode |
+ * | keyword_window_ms | -           | int     | ms             | 1500             | No           | Wake words: audio at the beginning of the utterance searched for them, with the encoder context shrunk to it |       |
+ * | keyword_min_similarity | -      | float   | -              | 0.7              | No           | Wake words: minimum similarity (1 - normalized edit distance) between the heard text and a keyword |       |
+ * | keyword_model  |      -         | string  | -              | -                | No           | Wake words: model used to search them, e.g. ggml-tiny.en.bin. Default: the model serving the request |       |
+ * | latency_budget_ms |   -         | int     | ms             | 0                | No           | Latency budget of a request: greedy or beam search and the number of temperature fallbacks are chosen to fit it, from the measured speed, and the inference is aborted at the deadline, returning the partial transcription. 0 = disabled | Can be changed with the rpc command `latency_budget` |
+ * | context_tokens |      -         | int     | -              | 0                | No           | Conversation mode: the last transcriptions, up to this number of tokens, are the decoder prompt of the next request. 0 = disabled | Reset with the rpc command `context_reset`. Requests bypass the cache and are not batched |
+ * | context_timeout_ms | -          | int     | ms             | 30000            | No           | Conversation mode: the history is forgotten after this time without requests. 0 = never |       |
+ * | cache_size     |      -         | int     | -              | 0                | No           | Number of transcriptions kept in the LRU cache, keyed on the audio, model, language and decoding parameters. 0 = disabled | Exact matches only, e.g. replayed recordings |
+ * | cache_file     |      -         | string  | -              | -                | No           | File where the cache is loaded from at open and saved to at close |       |
+ * | metrics_port   |      -         | bool    | -              | false            | No           | Publishes the figures of each request on `<name>/metrics:o`       | Also available with the rpc command `metrics` |
+ * | metrics_window |      -         | int     | -              | 100              | No           | Number of requests over which the rolling percentiles are computed |      |
 */
 class WhisperSpeechTranscription :
         public yarp::dev::DeviceDriver,
-        public yarp::dev::ISpeechTranscription
+        public yarp::dev::ISpeechTranscription,
+        public yarp::os::PortReader
 {
 private:
     bool                            m_verbose = true;
     bool                            m_no_symbols = true;
+    TextPipeline                    m_textPipeline;         // post-processing of the transcriptions
     std::string                     m_language="auto";
     std::string                     m_model;
-    std::vector<float>              m_pcmf32;               // mono-channel F32 PCM
-    std::vector<std::vector<float>> m_pcmf32s;              // stereo-channel F32 PCM
-    struct whisper_context*         m_ctx= nullptr;
+    std::string                     m_initialPrompt;
+    AudioFrontEnd                   m_frontEnd;             // int16->F32 conversion, downmix and resampling to WHISPER_SAMPLE_RATE
+    bool                            m_vadEnabled = false;
+    bool                            m_diarize = false;
+    bool                            m_speakerLabels = false;
+    VoiceActivityDetector           m_vad;
+    std::string                     m_modelShort;
+    std::string                     m_modelMultilingual;
+    ModelRouter                     m_router;               // loaded models, each one with its pool of whisper states
+    bool                            m_modelMmap = true;
+    bool                            m_useGpu = true;
+    std::vector<std::string>        m_modelVariants;
+    ModelSelector::Config           m_selectorCfg;
+    bool                            m_warmup = false;
     whisper_full_params             m_wparams;
+    size_t                          m_nStates = 1;
+    mutable std::mutex              m_languageMutex;        // m_language can be changed while requests are running
 
-    int32_t                         n_processors = 1;
+    int32_t                         n_processors = 1;       // concurrent chunks of a long-form request
+    double                          m_longFormMin = 0;      // s, 0 = long-form mode disabled
+    LongFormSplitter                m_splitter;
+
+    std::string                     m_name = "/whisperSpeechTranscription";
+    bool                            m_streaming = false;
+    std::string                     m_shmInput;
+    whisper_full_params             m_streamParams;
+    std::unique_ptr<StreamingTranscriber> m_streamer;
+
+    TranscriptionQueue::Config      m_queueCfg;
+    TranscriptionQueue              m_queue;
+    yarp::os::Port                  m_rpcPort;
+
+    MetricsMonitor                  m_metrics;
+    bool                            m_metricsPort = false;
+
+    CommandRecognizer               m_commands;
+    std::string                     m_commandsFile;
+    CommandRecognizer::Mode         m_commandMode = CommandRecognizer::Mode::score;
+    double                          m_commandMinProb = 0.0;
+    double                          m_commandMinConfidence = 0.3;
+    float                           m_grammarPenalty = 100.0f;
+
+    LanguagePinner                  m_pinner;
+
+    KeywordSpotter                  m_spotter;
+    std::string                     m_keywordModelPath;
+    std::shared_ptr<ModelInstance>  m_keywordModel;
+
+    ConversationContext             m_context;
+    DecodingPolicy                  m_policy;
+
+    TranscriptionCache              m_cache;
+    std::string                     m_cacheFile;
+    std::string                     m_paramsSignature;      // decoding parameters that affect the transcription
+
+    bool                            m_resultDetails = false;
+    yarp::os::BufferedPort<yarp::os::Bottle> m_alignmentPort;
+    mutable std::mutex              m_resultMutex;
+    TranscriptionResult             m_lastResult;
+
+    // Runs one inference on silence with every state of the model.
+    bool warmUp(ModelInstance& model);
+    // Language of the next requests.
+    std::string currentLanguage() const;
+    // Language of a request: the current one, or the language pinned for the session if it is 'auto'.
+    std::string requestLanguage();
+    // Parameters of a request served by model. language must outlive the inference.
+    whisper_full_params requestParams(const whisper_full_params& base, const ModelInstance& model, const std::string& language) const;
+    // Latency budget: adapts params to n_samples of audio and sets the deadline of slot, counted from t_start.
+    void applyPolicy(WhisperSlot& slot, size_t n_samples, std::chrono::steady_clock::time_point t_start, whisper_full_params& params);
+    // Runs whisper_full_with_state on pcm, measuring the encode/decode time and counting the output tokens in slot.stats.
+    bool runWhisper(WhisperSlot& slot, const std::vector<float>& pcm, const whisper_full_params& params);
+    // Runs whisper on pcm using the state of slot and assembles the transcription.
+    bool runInference(WhisperSlot& slot, const std::vector<float>& pcm, const whisper_full_params& params, std::string& transcription, double& score);
+    // Long-form mode: transcribes the chunks of pcm concurrently with slot and the free states of model.
+    bool transcribeLongForm(ModelInstance& model, WhisperSlot& slot, const std::vector<float>& pcm, const whisper_full_params& params, std::string& transcription, double& score);
+    // Conversation mode: sets the initial prompt followed by the recent history as prompt tokens of params.
+    void applyContext(WhisperSlot& slot, whisper_full_params& params);
+    // Language pinning: detects the language of pcm, sets it in params and pins it if it is likely enough.
+    void detectLanguage(WhisperSlot& slot, const std::vector<float>& pcm, whisper_full_params& params);
+    // Wake words: true if pcm begins with one of the keywords.
+    bool spotKeyword(WhisperSlot& slot, const std::vector<float>& pcm, const whisper_full_params& params);
+    // Command mode: recognizes one of the commands in pcm.
+    bool recognizeCommand(WhisperSlot& slot, const std::vector<float>& pcm, const whisper_full_params& params, std::string& command, double& score);
+    // Seed of the cache keys of the requests served by the model at model_path with params.
+    uint64_t cacheSeed(const std::string& model_path, const whisper_full_params& params) const;
+    // Converts the sound and transcribes it with the state of slot, a state of model.
+    yarp::dev::ReturnValue transcribeSound(ModelInstance& model, WhisperSlot& slot, const yarp::sig::Sound& sound, const whisper_full_params& params, uint64_t cache_seed, std::string& transcription, double& score);
+    // Worker side of m_queue: transcribes one or more queued requests.
+    void processBatch(std::vector<TranscriptionJob*>& batch);
+    // Reads segment i_segment of the last inference of slot; times are shifted back by offset_s.
+    void readSegment(const WhisperSlot& slot, int i_segment, double offset_s, SegmentResult& seg) const;
+    // Attributes the segments, with times relative to the beginning of channels, to the loudest channel.
+    void assignSpeakers(const std::vector<std::vector<float>>& channels, std::vector<SegmentResult>& segments) const;
+    // Appends the text of a segment to the transcription, with the label of its speaker when it changes.
+    void appendSegment(std::string& transcription, const SegmentResult& seg, int& last_speaker) const;
+    // Applies the text filters to a complete transcription. An empty transcription gets score 0.
+    void finalizeTranscription(std::string& transcription, double& score) const;
+    // True if the words and tokens of the next request are needed.
+    bool detailsRequested();
+    // Keeps the details of a request for the rpc command last_result, if result_details is enabled,
+    // and publishes them on the alignment port.
+    void storeResult(const std::string& transcription, double score, const std::vector<SegmentResult>& segments);
+    // Stores the figures of a completed request.
+    void recordStats(const InferenceStats& stats);
+
+protected:
+    // Called with true before and false after each whisper_full() of a request, in the thread running it.
+    // The tests override it to tell the allocations of whisper apart from the ones of the device.
+    virtual void onInference(bool /*running*/) {}
 
 public:
     WhisperSpeechTranscription();
@@ -60,6 +255,14 @@ public:
     virtual yarp::dev::ReturnValue setLanguage(const std::string& language) override;
     virtual yarp::dev::ReturnValue getLanguage(std::string& language) override;
     virtual yarp::dev::ReturnValue transcribe(const yarp::sig::Sound& sound, std::string& transcription, double& score) override;
+
+    //PortReader interface (rpc port)
+    bool read(yarp::os::ConnectionReader& connection) override;
+
+    // Replaces m_model with the model variant that best fits the host.
+    bool selectModelVariant();
+    // Loads a model and makes it serve the given route. The requests already running complete on the previous model.
+    bool loadModel(ModelRouter::Route route, const std::string& path);
 };
 
 #endif